@@ -18,6 +18,8 @@
 //#define MQTHREADS 1
 #define THREADS 16
 #define ITHREADS 32 //INITIALIZATION THREADS
+#define PTA_MAX_DIMS 16 //PPARTITIONS grows as 2^(d-1) (cpu/PTA.h)
+#define SLA_MAX_DIMS 16 //skyline partition masks are 32-bit (skyline/common/common.h)
 //#define STATS_EFF true
 //#define WORKLOAD 1024*128
 
@@ -26,69 +28,172 @@
 #include <cstdlib>
 #include <limits>
 
-template <class T, class Z>
-void normalize_transpose(T *&cdata, uint64_t n, uint64_t d){
-	T *mmax = static_cast<T*>(aligned_alloc(32,sizeof(T)*d));
-	T *mmin = static_cast<T*>(aligned_alloc(32,sizeof(T)*d));
+/*
+ * Min/max and scaling kernels used by normalization (AVX2 for float, scalar otherwise).
+ * Columns are contiguous runs of len values; rows are len interleaved records of d attributes.
+ */
+template <class T>
+static inline void minmax_column(const T *p, uint64_t len, T &vmin, T &vmax){
+	for(uint64_t i = 0; i < len; i++){ vmin = std::min(vmin,p[i]); vmax = std::max(vmax,p[i]); }
+}
+
+static inline void minmax_column(const float *p, uint64_t len, float &vmin, float &vmax){
+	__m256 _min = _mm256_set1_ps(vmin);
+	__m256 _max = _mm256_set1_ps(vmax);
+	uint64_t i = 0;
+	for(; i + 8 <= len; i+=8){
+		__m256 v = _mm256_loadu_ps(&p[i]);
+		_min = _mm256_min_ps(_min,v);
+		_max = _mm256_max_ps(_max,v);
+	}
+	float a[8] __attribute__((aligned(32)));
+	float b[8] __attribute__((aligned(32)));
+	_mm256_store_ps(a,_min);
+	_mm256_store_ps(b,_max);
+	for(uint32_t l = 0; l < 8; l++){ vmin = std::min(vmin,a[l]); vmax = std::max(vmax,b[l]); }
+	for(; i < len; i++){ vmin = std::min(vmin,p[i]); vmax = std::max(vmax,p[i]); }
+}
+
+template <class T>
+static inline void scale_column(T *p, uint64_t len, T vmin, T mm){
+	for(uint64_t i = 0; i < len; i++) p[i] = (p[i] - vmin)/mm;
+}
+
+static inline void scale_column(float *p, uint64_t len, float vmin, float mm){
+	__m256 _min = _mm256_set1_ps(vmin);
+	__m256 _mm = _mm256_set1_ps(mm);
+	uint64_t i = 0;
+	for(; i + 8 <= len; i+=8) _mm256_storeu_ps(&p[i],_mm256_div_ps(_mm256_sub_ps(_mm256_loadu_ps(&p[i]),_min),_mm));
+	for(; i < len; i++) p[i] = (p[i] - vmin)/mm;
+}
+
+template <class T>
+static inline void minmax_rows(const T *p, uint64_t len, uint64_t d, T *vmin, T *vmax){
+	for(uint64_t i = 0; i < len; i++){
+		for(uint64_t m = 0; m < d; m++){ vmin[m] = std::min(vmin[m],p[i*d + m]); vmax[m] = std::max(vmax[m],p[i*d + m]); }
+	}
+}
 
-	//Find min and max for each attribute list
-	for(uint64_t m = 0; m < d; m++){
-		mmax[m] = 0;
-		mmin[m] = std::numeric_limits<T>::max();
-		for(uint64_t i = 0; i < n; i++){
-			T value = cdata[m*n + i];
-			//if (m == 0) std::cout << m << " < " << value << "," << value <<"," << mmax[m] << std::endl;
-			mmax[m] = std::max(mmax[m],value);
-			mmin[m] = std::min(mmin[m],value);
+/*
+ * 8 rows of d attributes span d vectors; lane l of vector j holds attribute (8*j + l) % d
+ */
+static inline void minmax_rows(const float *p, uint64_t len, uint64_t d, float *vmin, float *vmax){
+	float *pmin = static_cast<float*>(aligned_alloc(32,sizeof(float)*8*d));
+	float *pmax = static_cast<float*>(aligned_alloc(32,sizeof(float)*8*d));
+	for(uint64_t j = 0; j < 8*d; j++){ pmin[j] = vmin[j % d]; pmax[j] = vmax[j % d]; }
+	uint64_t i = 0;
+	for(; i + 8 <= len; i+=8){
+		const float *rows = &p[i*d];
+		for(uint64_t j = 0; j < d; j++){
+			__m256 v = _mm256_loadu_ps(&rows[j*8]);
+			_mm256_store_ps(&pmin[j*8],_mm256_min_ps(_mm256_load_ps(&pmin[j*8]),v));
+			_mm256_store_ps(&pmax[j*8],_mm256_max_ps(_mm256_load_ps(&pmax[j*8]),v));
 		}
 	}
+	for(uint64_t j = 0; j < 8*d; j++){ vmin[j % d] = std::min(vmin[j % d],pmin[j]); vmax[j % d] = std::max(vmax[j % d],pmax[j]); }
+	minmax_rows<float>(&p[i*d],len - i,d,vmin,vmax);
+	free(pmin);
+	free(pmax);
+}
 
-	//Normalize values
-	for(uint64_t m = 0; m < d; m++){
-		T _max = mmax[m];
-		T _min = mmin[m];
-		T _mm = _max - _min;
-		//if ( _mm == 0 ){ std::cout << m << " <"<< _max << " - " << _min << std::endl; }
-		for(uint64_t i = 0; i < n; i++){
-			T value = cdata[m*n+i];
-			value = (value - _min)/_mm;
-			cdata[m*n + i] = value;
+template <class T>
+static inline void scale_rows(T *p, uint64_t len, uint64_t d, const T *vmin, const T *mm){
+	for(uint64_t i = 0; i < len; i++){
+		for(uint64_t m = 0; m < d; m++) p[i*d + m] = (p[i*d + m] - vmin[m])/mm[m];
+	}
+}
+
+static inline void scale_rows(float *p, uint64_t len, uint64_t d, const float *vmin, const float *mm){
+	float *pmin = static_cast<float*>(aligned_alloc(32,sizeof(float)*8*d));
+	float *pmm = static_cast<float*>(aligned_alloc(32,sizeof(float)*8*d));
+	for(uint64_t j = 0; j < 8*d; j++){ pmin[j] = vmin[j % d]; pmm[j] = mm[j % d]; }
+	uint64_t i = 0;
+	for(; i + 8 <= len; i+=8){
+		float *rows = &p[i*d];
+		for(uint64_t j = 0; j < d; j++){
+			__m256 v = _mm256_loadu_ps(&rows[j*8]);
+			_mm256_storeu_ps(&rows[j*8],_mm256_div_ps(_mm256_sub_ps(v,_mm256_load_ps(&pmin[j*8])),_mm256_load_ps(&pmm[j*8])));
 		}
 	}
-	free(mmax);
-	free(mmin);
+	scale_rows<float>(&p[i*d],len - i,d,vmin,mm);
+	free(pmin);
+	free(pmm);
 }
 
-template<class T, class Z>
-void normalize(T *& cdata, uint64_t n, uint64_t d){
-	T *mmax = static_cast<T*>(aligned_alloc(32,sizeof(T)*d));
+/*
+ * Min-max normalize column-major data. Each thread scans a slice of every column keeping
+ * thread local min/max, the partial results are reduced and the same slices are scaled.
+ */
+template <class T, class Z>
+void normalize_transpose(T *&cdata, uint64_t n, uint64_t d){
+	T *tmin = static_cast<T*>(aligned_alloc(32,sizeof(T)*d*ITHREADS));
+	T *tmax = static_cast<T*>(aligned_alloc(32,sizeof(T)*d*ITHREADS));
 	T *mmin = static_cast<T*>(aligned_alloc(32,sizeof(T)*d));
+	T *mm = static_cast<T*>(aligned_alloc(32,sizeof(T)*d));
 
-	for(uint64_t m = 0; m < d; m++){ mmax[m] = 0; mmin[m] = std::numeric_limits<T>::max(); }
-	//Find min and max for each attribute list
-	for(uint64_t i = 0; i < n; i++){
+#pragma omp parallel num_threads(ITHREADS)
+{
+	uint32_t tid = omp_get_thread_num();
+	uint32_t threads = omp_get_num_threads();
+	uint64_t start = (n * tid) / threads;
+	uint64_t end = (n * (tid+1)) / threads;
+	for(uint64_t m = 0; m < d; m++){//Find min and max for each attribute slice
+		tmin[tid*d + m] = std::numeric_limits<T>::max();
+		tmax[tid*d + m] = std::numeric_limits<T>::lowest();
+		minmax_column(&cdata[m*n + start],end - start,tmin[tid*d + m],tmax[tid*d + m]);
+	}
+	#pragma omp barrier
+	#pragma omp single
+	{
 		for(uint64_t m = 0; m < d; m++){
-			T value = cdata[i*d + m];
-			mmax[m] = std::max(mmax[m],value);
-			mmin[m] = std::min(mmin[m],value);
+			T _min = tmin[m], _max = tmax[m];
+			for(uint32_t t = 1; t < threads; t++){ _min = std::min(_min,tmin[t*d + m]); _max = std::max(_max,tmax[t*d + m]); }
+			mmin[m] = _min;
+			mm[m] = _max - _min;
 		}
 	}
+	for(uint64_t m = 0; m < d; m++) scale_column(&cdata[m*n + start],end - start,mmin[m],mm[m]);//Normalize values
+}
+	free(tmin);
+	free(tmax);
+	free(mmin);
+	free(mm);
+}
 
-	//Normalize values
-	__builtin_prefetch(mmax,0,3);
-	__builtin_prefetch(mmin,0,3);
-	for(uint64_t i = 0; i < n; i++){
+/*
+ * Min-max normalize row-major data (same scheme as normalize_transpose over row slices)
+ */
+template <class T, class Z>
+void normalize(T *& cdata, uint64_t n, uint64_t d){
+	T *tmin = static_cast<T*>(aligned_alloc(32,sizeof(T)*d*ITHREADS));
+	T *tmax = static_cast<T*>(aligned_alloc(32,sizeof(T)*d*ITHREADS));
+	T *mmin = static_cast<T*>(aligned_alloc(32,sizeof(T)*d));
+	T *mm = static_cast<T*>(aligned_alloc(32,sizeof(T)*d));
+
+#pragma omp parallel num_threads(ITHREADS)
+{
+	uint32_t tid = omp_get_thread_num();
+	uint32_t threads = omp_get_num_threads();
+	uint64_t start = (n * tid) / threads;
+	uint64_t end = (n * (tid+1)) / threads;
+	for(uint64_t m = 0; m < d; m++){ tmin[tid*d + m] = std::numeric_limits<T>::max(); tmax[tid*d + m] = std::numeric_limits<T>::lowest(); }
+	minmax_rows(&cdata[start*d],end - start,d,&tmin[tid*d],&tmax[tid*d]);//Find min and max for each attribute
+	#pragma omp barrier
+	#pragma omp single
+	{
 		for(uint64_t m = 0; m < d; m++){
-			T _max = mmax[m];
-			T _min = mmin[m];
-			T _mm = _max - _min;
-			T value = cdata[i*d+m];
-			value = (value - _min)/_mm;
-			cdata[i*d + m] = value;
+			T _min = tmin[m], _max = tmax[m];
+			for(uint32_t t = 1; t < threads; t++){ _min = std::min(_min,tmin[t*d + m]); _max = std::max(_max,tmax[t*d + m]); }
+			mmin[m] = _min;
+			mm[m] = _max - _min;
 		}
 	}
-	free(mmax);
+	scale_rows(&cdata[start*d],end - start,d,mmin,mm);//Normalize values
+}
+	free(tmin);
+	free(tmax);
 	free(mmin);
+	free(mm);
 }
 
 #endif
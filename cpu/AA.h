@@ -7,6 +7,7 @@
 #include <boost/heap/fibonacci_heap.hpp>
 #include <boost/heap/pairing_heap.hpp>
 #include <boost/heap/skew_heap.hpp>
+#include <type_traits>
 
 #define QATTR 1
 #define FIRST(d,qq) ( (QATTR == 0) ? 0 : d - qq)
@@ -83,6 +84,7 @@ class AA{
 		void make_distinct();
 
 		void set_iter(uint32_t iter){this->iter = iter;}
+		void set_normalized(bool normalized){ this->normalized = normalized; }//data already normalized (i.e. during load)
 
 		void reset_clocks(){
 			this->tt_processing = 0;
@@ -98,6 +100,7 @@ class AA{
 		uint64_t d;
 
 		bool initp;// Parallel Initialize
+		bool normalized;// Skip normalization in init
 		bool topkp;// Parallel TopK Calculation
 
 		Time<msecs> t;
@@ -123,6 +126,11 @@ class AA{
 
 template<class T,class Z>
 AA<T,Z>::AA(uint64_t n, uint64_t d){
+	static_assert(std::is_integral<Z>::value && std::is_unsigned<Z>::value && sizeof(Z) >= 4, "Tuple id type Z must be uint32_t or uint64_t");
+	if(n > std::numeric_limits<Z>::max()){
+		std::cout << "n does not fit in the tuple id type (build with TID=64)!!!" << std::endl;
+		exit(1);
+	}
 	this->tt_init = 0;
 	this->tt_processing = 0;
 	this->tt_ranking = 0;
@@ -136,6 +144,7 @@ AA<T,Z>::AA(uint64_t n, uint64_t d){
 	this->d = d;
 	this->cdata = NULL;
 	this->initp = false;
+	this->normalized = false;
 	this->topkp=false;
 	this->algo= this->algo + " ( sequential ) ";
 	this->bt_bytes=sizeof(T)*n*d;
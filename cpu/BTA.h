@@ -0,0 +1,285 @@
+#ifndef CPU_BTA_H
+#define CPU_BTA_H
+
+/*
+ * Bitonic Top-k Aggregation (CPU port of gpu/BTA.h). Full column-major scan like TPAc, but every thread keeps its
+ * top-k in a sorted buffer of kp slots (k rounded up to a power of two, at least 16) instead of a heap. Scores above
+ * the k-th are staged in a candidate buffer of the same size. A full candidate buffer is sorted with AVX2 bitonic
+ * networks (8 lanes per vector, in-register permutes for strides below 8) and merged into the top-k by a bitonic
+ * merge of the elementwise maximum of both buffers (local_sort and merge of the GPU version).
+ */
+
+#include "TopK.h"
+
+/*
+ * Compare-exchange of every row i with row i^j (stride j) inside bitonic sequences of kk rows: the pair is ordered
+ * descending when (i & kk) == 0 and ascending otherwise, all directions reversed when asc is set. Ties never swap,
+ * so the slot carried along with every score stays unique.
+ */
+static inline void bta_step(float *s, int32_t *p, uint32_t size, uint32_t kk, uint32_t j, bool asc){
+	if(j >= 8){
+		for(uint32_t i = 0; i < size; i+=8){
+			if(i & j) continue;
+			bool desc = ((i & kk) == 0) != asc;
+			__m256 a = _mm256_loadu_ps(&s[i]);
+			__m256 b = _mm256_loadu_ps(&s[i+j]);
+			__m256 pa = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i*)&p[i]));
+			__m256 pb = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i*)&p[i+j]));
+			__m256 swap = desc ? _mm256_cmp_ps(a,b,_CMP_LT_OQ) : _mm256_cmp_ps(a,b,_CMP_GT_OQ);
+			_mm256_storeu_ps(&s[i],_mm256_blendv_ps(a,b,swap));
+			_mm256_storeu_ps(&s[i+j],_mm256_blendv_ps(b,a,swap));
+			_mm256_storeu_si256((__m256i*)&p[i],_mm256_castps_si256(_mm256_blendv_ps(pa,pb,swap)));
+			_mm256_storeu_si256((__m256i*)&p[i+j],_mm256_castps_si256(_mm256_blendv_ps(pb,pa,swap)));
+		}
+		return;
+	}
+
+	__m256i _kk = _mm256_set1_epi32(kk);
+	__m256i _j = _mm256_set1_epi32(j);
+	__m256i _flip = asc ? _mm256_set1_epi32(-1) : _mm256_setzero_si256();
+	__m256i _lanes = _mm256_setr_epi32(0,1,2,3,4,5,6,7);
+	for(uint32_t i = 0; i < size; i+=8){
+		__m256 v = _mm256_loadu_ps(&s[i]);
+		__m256 vp = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i*)&p[i]));
+		__m256 w, wp;//partner lanes
+		if(j == 4){
+			w = _mm256_permute2f128_ps(v,v,1); wp = _mm256_permute2f128_ps(vp,vp,1);
+		}else if(j == 2){
+			w = _mm256_permute_ps(v,0x4E); wp = _mm256_permute_ps(vp,0x4E);
+		}else{
+			w = _mm256_permute_ps(v,0xB1); wp = _mm256_permute_ps(vp,0xB1);
+		}
+		__m256i row = _mm256_add_epi32(_mm256_set1_epi32(i),_lanes);
+		__m256i lower = _mm256_cmpeq_epi32(_mm256_and_si256(row,_j),_mm256_setzero_si256());
+		__m256i desc = _mm256_xor_si256(_mm256_cmpeq_epi32(_mm256_and_si256(row,_kk),_mm256_setzero_si256()),_flip);
+		__m256 keepmax = _mm256_castsi256_ps(_mm256_cmpeq_epi32(lower,desc));//lane keeps the larger score of its pair
+		__m256 swap = _mm256_blendv_ps(_mm256_cmp_ps(v,w,_CMP_GT_OQ),_mm256_cmp_ps(v,w,_CMP_LT_OQ),keepmax);
+		_mm256_storeu_ps(&s[i],_mm256_blendv_ps(v,w,swap));
+		_mm256_storeu_si256((__m256i*)&p[i],_mm256_castps_si256(_mm256_blendv_ps(vp,wp,swap)));
+	}
+}
+
+//Bitonic sort of size (power of two, at least 8) scores, descending or ascending (asc)
+static inline void bta_sort(float *s, int32_t *p, uint32_t size, bool asc){
+	for(uint32_t kk = 2; kk <= size; kk<<=1){
+		for(uint32_t j = kk >> 1; j > 0; j>>=1) bta_step(s,p,size,kk,j,asc);
+	}
+}
+
+//Sort a bitonic sequence of size scores descending
+static inline void bta_merge(float *s, int32_t *p, uint32_t size){
+	for(uint32_t j = size >> 1; j > 0; j>>=1) bta_step(s,p,size,size << 1,j,false);
+}
+
+/*
+ * Sorted top-k buffer of one thread. score/slot[0,kp) hold the top-k descending, score/slot[kp,2kp) the staged
+ * candidates; slot indexes id, the tuple ids of both halves.
+ */
+template<class T, class Z>
+class bta_topk{
+	public:
+		bta_topk(uint64_t k){
+			static_assert(sizeof(T) == sizeof(float), "BTA sorts 32-bit float scores");
+			this->k = k;
+			this->kp = 16;
+			while(this->kp < k) this->kp<<=1;
+			this->score.assign(2*this->kp,std::numeric_limits<T>::lowest());
+			this->slot.resize(2*this->kp);
+			this->id.resize(2*this->kp);
+			this->tmp.resize(this->kp);
+			for(uint32_t i = 0; i < this->kp; i++) this->slot[i] = i;
+			this->c = 0;
+			this->seen = 0;
+			this->kth = std::numeric_limits<T>::lowest();
+		}
+
+		//Stage the scores of 16 consecutive tuples (valid lanes in mask) that beat the k-th score
+		inline void push16(const T *s, uint32_t mask, Z id){
+			__m256 _kth = _mm256_set1_ps(this->kth);
+			mask &= _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(&s[0]),_kth,_CMP_GT_OQ)) | (_mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(&s[8]),_kth,_CMP_GT_OQ)) << 8);
+			while(mask){
+				uint32_t l = __builtin_ctz(mask);
+				this->append(s[l],id + l);
+				mask&=mask - 1;
+			}
+		}
+
+		inline void push(T s, Z id){ if(s > this->kth) this->append(s,id); }
+
+		//Sort the staged candidates and merge them into the top-k
+		void flush(){
+			if(this->c == 0) return;
+			this->seen+=this->c;
+			float *cs = &this->score[this->kp];
+			int32_t *cp = &this->slot[this->kp];
+			for(uint32_t i = this->c; i < this->kp; i++) cs[i] = std::numeric_limits<T>::lowest();
+			for(uint32_t i = 0; i < this->kp; i++) cp[i] = this->kp + i;
+			bta_sort(cs,cp,this->kp,true);
+
+			//Descending top-k against ascending candidates, the pairwise maximum is the bitonic top-kp of both
+			for(uint32_t i = 0; i < this->kp; i+=8){
+				__m256 a = _mm256_loadu_ps(&this->score[i]);
+				__m256 b = _mm256_loadu_ps(&cs[i]);
+				__m256 pa = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i*)&this->slot[i]));
+				__m256 pb = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i*)&cp[i]));
+				__m256 gt = _mm256_cmp_ps(b,a,_CMP_GT_OQ);
+				_mm256_storeu_ps(&this->score[i],_mm256_blendv_ps(a,b,gt));
+				_mm256_storeu_si256((__m256i*)&this->slot[i],_mm256_castps_si256(_mm256_blendv_ps(pa,pb,gt)));
+			}
+			bta_merge(&this->score[0],&this->slot[0],this->kp);
+
+			for(uint32_t i = 0; i < this->kp; i++) this->tmp[i] = this->id[this->slot[i]];
+			for(uint32_t i = 0; i < this->kp; i++){ this->id[i] = this->tmp[i]; this->slot[i] = i; }
+			this->c = 0;
+			if(this->seen >= this->k) this->kth = this->score[this->k - 1];
+		}
+
+		//Tuples of another (flushed) buffer
+		void merge(const bta_topk<T,Z> &o){
+			for(uint64_t i = 0; i < o.size(); i++) this->push(o.score[i],o.id[i]);
+		}
+
+		//Number of tuples in the top-k after flush()
+		uint64_t size() const{ return std::min(this->k,this->seen); }
+		T threshold() const{ return this->size() > 0 ? this->score[this->size() - 1] : 0; }
+		tuple_<T,Z> get(uint64_t i) const{ return tuple_<T,Z>(this->id[i],this->score[i]); }
+
+	private:
+		uint64_t k;
+		uint32_t kp;
+		std::vector<float> score;
+		std::vector<int32_t> slot;
+		std::vector<Z> id;
+		std::vector<Z> tmp;
+		uint32_t c;//staged candidates
+		uint64_t seen;//tuples merged into the top-k
+		T kth;
+
+		inline void append(T s, Z id){
+			this->score[this->kp + this->c] = s;
+			this->id[this->kp + this->c] = id;
+			if(++this->c == this->kp) this->flush();
+		}
+};
+
+template<class T, class Z>
+class BTA : public AA<T,Z>{
+	public:
+		BTA(uint64_t n, uint64_t d) : AA<T,Z>(n,d){
+			this->algo = "BTA";
+		}
+
+		void init();
+		void findTopKsimd(uint64_t k,uint8_t qq, T *weights, uint8_t *attr);
+		void findTopKthreads(uint64_t k,uint8_t qq, T *weights, uint8_t *attr);
+
+	private:
+		void scan(bta_topk<T,Z> &q, uint64_t first, uint64_t last, uint8_t qq, T *weights, uint8_t *attr);
+		void result(bta_topk<T,Z> &q);
+};
+
+template<class T, class Z>
+void BTA<T,Z>::init(){
+	if(!this->normalized) normalize_transpose<T,Z>(this->cdata, this->n, this->d);
+	this->t.start();
+	this->tt_init = this->t.lap();
+}
+
+/*
+ * Score rows [first,last) 16 at a time and stage the ones above the k-th score of q
+ */
+template<class T, class Z>
+void BTA<T,Z>::scan(bta_topk<T,Z> &q, uint64_t first, uint64_t last, uint8_t qq, T *weights, uint8_t *attr){
+	float score[16] __attribute__((aligned(32)));
+	__m256 dim_num = _mm256_set1_ps(qq);
+	uint64_t i = first;
+	for(; i + 16 <= last; i+=16){
+		__m256 score00 = _mm256_setzero_ps();
+		__m256 score01 = _mm256_setzero_ps();
+		for(uint8_t m = 0; m < qq; m++){
+			const T *column = &this->cdata[attr[m] * this->n + i];
+			__m256 _weight = _mm256_set1_ps(weights[attr[m]]);
+			score00 = _mm256_add_ps(score00,_mm256_mul_ps(_mm256_loadu_ps(&column[0]),_weight));
+			score01 = _mm256_add_ps(score01,_mm256_mul_ps(_mm256_loadu_ps(&column[8]),_weight));
+
+			#if LD == 2
+				score00 = _mm256_div_ps(score00,dim_num);
+				score01 = _mm256_div_ps(score01,dim_num);
+			#endif
+		}
+		_mm256_store_ps(&score[0],score00);
+		_mm256_store_ps(&score[8],score01);
+		q.push16(score,0xFFFF,i);
+	}
+	for(; i < last; i++){
+		T s = 0;
+		for(uint8_t m = 0; m < qq; m++){
+			s+= this->cdata[attr[m] * this->n + i] * weights[attr[m]];
+			#if LD == 2
+				s/=qq;
+			#endif
+		}
+		q.push(s,i);
+	}
+	q.flush();
+}
+
+template<class T, class Z>
+void BTA<T,Z>::result(bta_topk<T,Z> &q){
+	for(uint64_t i = 0; i < q.size(); i++) this->res.push_back(q.get(i));
+	T threshold = q.threshold();
+	std::cout << std::fixed << std::setprecision(4);
+	std::cout << " threshold=[" << threshold <<"] (" << this->res.size() << ")" << std::endl;
+	this->threshold = threshold;
+}
+
+template<class T, class Z>
+void BTA<T,Z>::findTopKsimd(uint64_t k,uint8_t qq, T *weights, uint8_t *attr){
+	std::cout << this->algo << " find top-" << k << " simd (" << (int)qq << "D) ...";
+	if(STATS_EFF) this->tuple_count = 0;
+	if(STATS_EFF) this->pop_count=0;
+	if(this->res.size() > 0) this->res.clear();
+
+	bta_topk<T,Z> q(k);
+	this->t.start();
+	this->scan(q,0,this->n,qq,weights,attr);
+	this->tt_processing += this->t.lap();
+	if(STATS_EFF) this->tuple_count=this->n;
+	this->result(q);
+}
+
+/*
+ * One contiguous range and top-k buffer per thread, buffers are tree merged across the threads
+ */
+template<class T, class Z>
+void BTA<T,Z>::findTopKthreads(uint64_t k,uint8_t qq, T *weights, uint8_t *attr){
+	std::cout << this->algo << " find top-" << k << " threads (" << (int)qq << "D) ...";
+	if(STATS_EFF) this->tuple_count = 0;
+	if(STATS_EFF) this->pop_count=0;
+	if(this->res.size() > 0) this->res.clear();
+
+	omp_set_num_threads(THREADS);
+	std::vector<bta_topk<T,Z>> q(THREADS,bta_topk<T,Z>(k));
+	this->t.start();
+#pragma omp parallel
+{
+	uint32_t thread_id = omp_get_thread_num();
+	uint64_t start = ((uint64_t)thread_id)*(this->n)/THREADS;
+	uint64_t end = ((uint64_t)(thread_id+1))*(this->n)/THREADS;
+	this->scan(q[thread_id],start,end,qq,weights,attr);
+
+	//pairwise tree merge of the buffers into q[0], log2(THREADS) rounds (see topk_tree_merge)
+	for(uint32_t step = 1; step < THREADS; step<<=1){
+		#pragma omp barrier
+		if(thread_id % (2*step) == 0 && thread_id + step < THREADS){
+			q[thread_id].merge(q[thread_id + step]);
+			q[thread_id].flush();
+		}
+	}
+}
+	this->tt_processing += this->t.lap();
+	if(STATS_EFF) this->tuple_count=this->n;
+	this->result(q[0]);
+}
+
+#endif
@@ -4,7 +4,9 @@
 * Partitioned Threshold Aggregation
 */
 
-#include "AA.h"
+#include "TopK.h"
+#include "../input/File.h"
+#include "index_io.h"
 #include <cmath>
 #include <map>
 
@@ -35,7 +37,11 @@ struct pta_block{
 	Z offset;
 	Z tuple_num;
 	T tarray[NUM_DIMS] __attribute__((aligned(32)));
+	T tmin[NUM_DIMS] __attribute__((aligned(32)));//attribute minimums of this and the following blocks
+	T zmin[NUM_DIMS];//zone map, attribute range of this block
+	T zmax[NUM_DIMS];
 	T tuples[PBLOCK_SIZE * NUM_DIMS] __attribute__((aligned(32)));
+	Z tids[PBLOCK_SIZE];//input row id of every tuple
 };
 
 template<class T, class Z>
@@ -55,41 +61,60 @@ static bool cmp_pta_pair(const pta_pair<T,Z> &a, const pta_pair<T,Z> &b){ return
 template<class T,class Z>
 static bool cmp_pta_pair_asc(const pta_pair<T,Z> &a, const pta_pair<T,Z> &b){ return a.score < b.score; };
 
-template<class T,class Z>
+template<class T, class Z, class S = TopKSum<T>>
 class PTA : public AA<T,Z>{
 	public:
 		PTA(uint64_t n,uint64_t d) : AA<T,Z>(n,d)
 		{
 			this->algo = "PTA";
 			this->part_id = NULL;
+			this->index_map = NULL;
+			this->index_bytes = 0;
 		}
 
 		~PTA(){
 			if(this->part_id!=NULL) free(this->part_id);
+			if(this->index_map!=NULL) munmap(this->index_map,this->index_bytes);
 		}
 
 		void init();
+		void init_stream(File<T> *f);
+		void save_index(std::string fname);
+		void load_index(std::string fname);
 		void findTopKscalar(uint64_t k,uint8_t qq, T *weights, uint8_t *attr);
 		void findTopKsimd(uint64_t k,uint8_t qq, T *weights, uint8_t *attr);
 		void findTopKthreads(uint64_t k,uint8_t qq, T *weights, uint8_t *attr);
 		void findTopKthreads2(uint64_t k,uint8_t qq, T *weights, uint8_t *attr);
 		void findTopKsimdMQ(uint64_t k,uint8_t qq, T *weights, uint8_t *attr, uint32_t tid);
+		void set_scoring(const S &fn){ this->fn = fn; }//scoring function of query(), see score.h
+		TopKResult<T,Z> query(const TopKQuery<T> &query) const;
+		uint64_t query(const TopKQuery<T> &query, tuple_<T,Z> *out) const;
+		uint64_t estimate(const TopKQuery<T> &query, T kth) const;
+		TopKCursor<T,Z> cursor(const TopKQuery<T> &query) const;
+		uint64_t next(TopKCursor<T,Z> &cursor, uint64_t count, tuple_<T,Z> *out) const;
 
 	private:
+		S fn;
 		pta_partition<T,Z> parts[PPARTITIONS];
 		Z *part_id;
 		Z max_part_size;
+		char *index_map;
+		uint64_t index_bytes;
 
 		void polar();
+		void polar_angles(const T *data, uint64_t stride, uint64_t rows, T *pdata, uint64_t pstride);
+		void split_coordinates(T *pdata);
+		void alloc_partitions();
+		void build_partition(uint64_t i, const T *data, uint64_t stride, const Z *rows, pta_pair<T,Z> *list, pta_pos<Z> *pos, T *sorted);
 		void create_partitions();
+		void query_top(const TopKQuery<T> &query, std::vector<tuple_<T,Z>> &top, uint64_t &tuple_count) const;
 };
 
-template<class T, class Z>
-void PTA<T,Z>::polar(){
-	T *pdata = static_cast<T*>(aligned_alloc(32,sizeof(T)*this->n * (this->d-1)));
-	pta_pair<T,Z> *pp = (pta_pair<T,Z>*)malloc(sizeof(pta_pair<T,Z>)*this->n);
-	this->part_id = static_cast<Z*>(aligned_alloc(32,sizeof(Z)*this->n));
-
+/*
+ * Hyperspherical coordinates of rows [0,rows) of data (attribute m at data[m*stride]) into pdata[m*pstride]
+ */
+template<class T, class Z, class S>
+void PTA<T,Z,S>::polar_angles(const T *data, uint64_t stride, uint64_t rows, T *pdata, uint64_t pstride){
 //	omp_set_num_threads(THREADS);
 //#pragma omp parallel
 //	{
@@ -102,20 +127,20 @@ void PTA<T,Z>::polar(){
 //	uint64_t chunk = (this->n-1)/THREADS + 1;
 //	uint64_t start = chunk*(tid);
 //	uint64_t end = chunk*(tid+1);
-	for(uint64_t i = 0; i < this->n; i+=8){//Calculate hyperspherical coordinates for each point
+	for(uint64_t i = 0; i < rows; i+=8){//Calculate hyperspherical coordinates for each point
 	//for(uint64_t i = start; i < end; i+=8){//Calculate hyperspherical coordinates for each point
 		//std::cout << "[" << i << "]" << std::endl;
-		if(i + 7 < this->n){
+		if(i + 7 < rows){
 			__m256 sum = _mm256_setzero_ps();
 			__m256 f = _mm256_setzero_ps();
 			__m256 curr;
 			__m256 next;
 
-			curr = _mm256_load_ps(&this->cdata[(this->d-1)*this->n + i]);
+			curr = _mm256_load_ps(&data[(this->d-1)*stride + i]);
 			curr = _mm256_sub_ps(curr,one);//x_i=x_i - 1.0
 			for(uint32_t m = this->d-1; m > 0;m--){
-				uint64_t offset = (m-1)*this->n + i;
-				next = _mm256_load_ps(&this->cdata[(m-1)*this->n + i]);//x_(i-1)
+				uint64_t offset = (m-1)*pstride + i;
+				next = _mm256_load_ps(&data[(m-1)*stride + i]);//x_(i-1)
 				next = _mm256_sub_ps(next,one);
 				sum = _mm256_add_ps(sum,_mm256_mul_ps(curr,curr));//(sum +=x_i ^ 2)
 				f = _mm256_sqrt_ps(sum);//sqrt(x_i^2+x_(i-1)^2+...)
@@ -133,12 +158,12 @@ void PTA<T,Z>::polar(){
 				curr = next;
 			}
 		}else{
-			for(uint32_t j = i; j < this->n; j++){
-				T curr = this->cdata[(this->d-1)*this->n + j] - _one;
+			for(uint32_t j = i; j < rows; j++){
+				T curr = data[(this->d-1)*stride + j] - _one;
 				T next, sum = 0, f = 0;
 				for(uint32_t m = this->d-1; m > 0;m--){
-					uint64_t offset = (m-1)*this->n + j;
-					next = this->cdata[offset] - _one;
+					uint64_t offset = (m-1)*pstride + j;
+					next = data[(m-1)*stride + j] - _one;
 					sum += curr*curr;
 					f = fabs(atan( sqrt(sum) / next));
 					pdata[offset] = f*PI_2;
@@ -148,6 +173,15 @@ void PTA<T,Z>::polar(){
 		}
 	}
 //}
+}
+
+template<class T, class Z, class S>
+void PTA<T,Z,S>::polar(){
+	T *pdata = static_cast<T*>(aligned_alloc(32,sizeof(T)*this->n * (this->d-1)));
+	pta_pair<T,Z> *pp = (pta_pair<T,Z>*)malloc(sizeof(pta_pair<T,Z>)*this->n);
+	this->part_id = static_cast<Z*>(aligned_alloc(32,sizeof(Z)*this->n));
+
+	this->polar_angles(this->cdata,this->n,this->n,pdata,this->n);
 
 	uint64_t mod = (this->n / PSLITS);
 	uint64_t mul = 1;
@@ -159,6 +193,16 @@ void PTA<T,Z>::polar(){
 		mul*=PSLITS;
 	}
 
+	this->alloc_partitions();
+	free(pp);
+	free(pdata);
+}
+
+/*
+ * Count the points assigned to each partition and allocate its blocks
+ */
+template<class T, class Z, class S>
+void PTA<T,Z,S>::alloc_partitions(){
 	//Count and verify number of points inside each partition//
 	std::map<Z,Z> mm;
 	for(uint64_t i = 0; i < PPARTITIONS;i++) mm.insert(std::pair<Z,Z>(i,0));
@@ -195,12 +239,55 @@ void PTA<T,Z>::polar(){
 	//std::cout << "max_part_size: " << this->max_part_size << std::endl;
 	std::cout << "count_full_parts: " << count_full_parts << std::endl;
 	std::cout << "count_n: " << count_n << " = " << this->n << std::endl;
-	free(pp);
-	free(pdata);
 }
 
-template<class T, class Z>
-void PTA<T,Z>::create_partitions(){
+/*
+ * Order the tuples of partition i by their first appearance in the sorted attribute lists and fill its blocks.
+ * Attribute m of local tuple j is data[m*stride + j] and its input row id rows[j]; only the sorted scores of each list are kept for the thresholds.
+ */
+template<class T, class Z, class S>
+void PTA<T,Z,S>::build_partition(uint64_t i, const T *data, uint64_t stride, const Z *rows, pta_pair<T,Z> *list, pta_pos<Z> *pos, T *sorted){
+	Z size = this->parts[i].size;
+	for(uint64_t j = 0; j < size;j++){ pos[j].id = j; pos[j].pos = size; }//Initialize to max possible position
+
+	for(uint32_t m = 0; m < this->d; m++){//Initialize list of each attribute for given partition//
+		for(uint64_t j = 0; j < size;j++){
+			list[j].id = j;//local tuple id//
+			list[j].score = data[m*stride + j];
+		}
+		__gnu_parallel::sort(list,list + size,cmp_pta_pair<T,Z>);//Sort to create list
+
+		for(uint64_t j = 0; j < size;j++){
+			Z lid = list[j].id;
+			pos[lid].pos = std::min(pos[lid].pos,(Z)j);//Find minimum local position of appearance in list//
+			sorted[m*size + j] = list[j].score;
+		}
+	}
+	__gnu_parallel::sort(&pos[0],(&pos[0]) + size,cmp_pta_pos<Z>);//Sort local tuple ids by minimum position//
+
+	uint64_t b = 0;
+	for(uint64_t j = 0; j < size;j+=PBLOCK_SIZE){//For each block
+		Z upper = ((j + PBLOCK_SIZE) <  size) ? PBLOCK_SIZE : size - j;
+		this->parts[i].blocks[b].tuple_num = upper;
+		this->parts[i].blocks[b].offset = j;
+
+		for(uint64_t l = 0; l < upper; l++){
+			Z lid = pos[j+l].id;//Find local tuple id
+			for(uint32_t m = 0; m < this->d; m++){//Assign attributes to partitions
+				this->parts[i].blocks[b].tuples[ m * PBLOCK_SIZE + l] = data[ m * stride + lid ];
+			}
+			this->parts[i].blocks[b].tids[l] = rows[lid];
+		}
+
+		Z p = pos[j + upper - 1].pos;//Find last point position
+		for(uint32_t m = 0; m < this->d; m++){ this->parts[i].blocks[b].tarray[m] = sorted[m*size + p]; }//Extract threshold
+		b++;
+	}
+	topk_block_bounds<T,PBLOCK_SIZE>(this->parts[i].blocks,b,this->d);//Lower bounds and zone maps
+}
+
+template<class T, class Z, class S>
+void PTA<T,Z,S>::create_partitions(){
 	pta_pos<Z> *ppos = (pta_pos<Z>*)malloc(sizeof(pta_pos<Z>)*this->n);//tupple id, tied to partition id
 	for(uint64_t i = 0; i < this->n; i++){
 		ppos[i].id =i; ppos[i].pos = this->part_id[i];
@@ -209,50 +296,20 @@ void PTA<T,Z>::create_partitions(){
 
 	uint64_t gindex = 0;
 	pta_pos<Z> *pos = (pta_pos<Z>*)malloc(sizeof(pta_pos<Z>)*this->max_part_size);
-	pta_pair<T,Z> **lists = (pta_pair<T,Z>**)malloc(sizeof(pta_pair<T,Z>*)*this->d);
-	for(uint32_t m=0; m<this->d;m++) lists[m] = (pta_pair<T,Z>*)malloc(sizeof(pta_pair<T,Z>)*this->max_part_size);
-	for(uint32_t m = 0; m < this->d; m++){ for(uint64_t j = 0; j < this->max_part_size;j++){ lists[m][j].id = 0; lists[m][j].score = 0; } }
+	pta_pair<T,Z> *list = (pta_pair<T,Z>*)malloc(sizeof(pta_pair<T,Z>)*this->max_part_size);
+	T *staging = (T*)malloc(sizeof(T)*this->max_part_size*this->d);
+	T *sorted = (T*)malloc(sizeof(T)*this->max_part_size*this->d);
+	Z *rows = (Z*)malloc(sizeof(Z)*this->max_part_size);
 
 	for(uint64_t i = 0; i < PPARTITIONS;i++){//Build Partitions
 		if(this->parts[i].size == 0) continue;
-		//INITIALIZE//
-		for(uint64_t j = 0; j < this->max_part_size;j++){ pos[j].id = j; pos[j].pos = this->parts[i].size; }//Initialize to max possible position
-		//for(uint32_t m = 0; m < this->d; m++){ for(uint64_t j = 0; j < this->max_part_size;j++){ lists[m][j].id = 0; lists[m][j].score = 0; } }
-
-		for(uint32_t m = 0; m < this->d; m++){//Initialize lists for given partition//
+		for(uint64_t j = 0; j < this->parts[i].size;j++) rows[j] = ppos[(gindex + j)].id;//global tuple ids
+		for(uint32_t m = 0; m < this->d; m++){//Gather partition tuples
 			for(uint64_t j = 0; j < this->parts[i].size;j++){
-				Z gid = ppos[(gindex + j)].id;//global tuple id
-				lists[m][j].id = j;//local tuple id//
-				//if (gid >= this->n) std::cout << "ERROR: " << gid << std::endl;
-				lists[m][j].score = this->cdata[m*this->n + gid];
-			}
-			__gnu_parallel::sort(lists[m],(lists[m]) + this->parts[i].size,cmp_pta_pair<T,Z>);//Sort to create lists
-
-			for(uint64_t j = 0; j < this->parts[i].size;j++){
-				Z lid = lists[m][j].id;
-				pos[lid].pos = std::min(pos[lid].pos,(Z)j);//Find minimum local position of appearance in list//
+				staging[m*this->max_part_size + j] = this->cdata[m*this->n + rows[j]];
 			}
 		}
-		__gnu_parallel::sort(&pos[0],(&pos[0]) + this->parts[i].size,cmp_pta_pos<Z>);//Sort local tuple ids by minimum position//
-
-		uint64_t b = 0;
-		for(uint64_t j = 0; j < this->parts[i].size;j+=PBLOCK_SIZE){//For each block
-			Z upper = ((j + PBLOCK_SIZE) <  this->parts[i].size) ? PBLOCK_SIZE : this->parts[i].size - j;
-			this->parts[i].blocks[b].tuple_num = upper;
-			this->parts[i].blocks[b].offset = j;
-
-			for(uint64_t l = 0; l < upper; l++){
-				Z lid = pos[j+l].id;//Find local tuple id
-				Z gid = ppos[(gindex + lid)].id;//Find global tuple id
-				for(uint32_t m = 0; m < this->d; m++){//Assign attributes to partitions
-					this->parts[i].blocks[b].tuples[ m * PBLOCK_SIZE + l] = this->cdata[ m * this->n + gid ];
-				}
-			}
-
-			Z p = pos[j + upper - 1].pos;//Find last point position
-			for(uint32_t m = 0; m < this->d; m++){ this->parts[i].blocks[b].tarray[m] = lists[m][p].score; }//Extract threshold
-			b++;
-		}
+		this->build_partition(i,staging,this->max_part_size,rows,list,pos,sorted);
 		this->parts[i].offset = gindex;//Update global index
 		//std::cout << "gindex: " << gindex << std::endl;
 		gindex+=this->parts[i].size;
@@ -260,15 +317,17 @@ void PTA<T,Z>::create_partitions(){
 
 	free(ppos);
 	free(pos);
-	for(uint32_t m = 0; m < this->d; m++){ free(lists[m]); }
-	free(lists);
+	free(list);
+	free(staging);
+	free(sorted);
+	free(rows);
 	free(this->cdata);
 	this->cdata = NULL;
 }
 
-template<class T, class Z>
-void PTA<T,Z>::init(){
-	normalize_transpose<T,Z>(this->cdata, this->n, this->d);
+template<class T, class Z, class S>
+void PTA<T,Z,S>::init(){
+	if(!this->normalized) normalize_transpose<T,Z>(this->cdata, this->n, this->d);
 	this->t.start();
 	std::cout << "computing polar coordinates ..." << std::endl;
 	this->polar();
@@ -277,8 +336,224 @@ void PTA<T,Z>::init(){
 	this->tt_init = this->t.lap();
 }
 
-template<class T, class Z>
-void PTA<T,Z>::findTopKscalar(uint64_t k, uint8_t qq, T *weights, uint8_t *attr){
+/*
+ * Assign partition ids from the hyperspherical coordinates without sorting (id,score) pairs.
+ * Split values are found with nth_element on a copy of each coordinate; rows tied with a split value
+ * fill the lower slice in row order until its rank quota is used, as the rank based split of polar().
+ */
+template<class T, class Z, class S>
+void PTA<T,Z,S>::split_coordinates(T *pdata){
+	T *tmp = (T*)malloc(sizeof(T)*this->n);
+	uint64_t mod = (this->n / PSLITS);
+	uint64_t mul = 1;
+	for(uint64_t i = 0; i < this->n; i++) this->part_id[i] = 0;
+	for(uint32_t m = 0; m < this->d-1; m++){//For each hyperspherical coordinate
+		T *angles = &pdata[m*this->n];
+		T split[PSLITS];
+		uint64_t quota[PSLITS];
+		uint64_t ties[PSLITS];
+		uint32_t splits = 0;
+		memcpy(tmp,angles,sizeof(T)*this->n);
+		for(uint64_t j = 1; j <= PSLITS && j*mod < this->n; j++){//value at rank j*mod
+			uint64_t lo = splits == 0 ? 0 : (j-1)*mod + 1;
+			std::nth_element(tmp + lo, tmp + j*mod, tmp + this->n);
+			split[splits] = tmp[j*mod];
+			uint64_t less = 0;
+			for(uint64_t i = 0; i < this->n; i++) less+=(angles[i] < split[splits]);
+			quota[splits] = j*mod - less;
+			ties[splits] = 0;
+			splits++;
+		}
+		for(uint64_t i = 0; i < this->n; i++){// Assign partition id
+			Z slice = 0;
+			for(uint32_t j = 0; j < splits; j++){
+				if(angles[i] > split[j]){
+					slice++;
+				}else if(angles[i] == split[j]){
+					if(ties[j] >= quota[j]) slice++;
+					ties[j]++;
+				}
+			}
+			this->part_id[i]+=mul*slice;
+		}
+		mul*=PSLITS;
+	}
+	free(tmp);
+}
+
+/*
+ * Build the partitions directly from a binary snapshot in two passes over STREAM_WINDOW rows:
+ * (1) compute the hyperspherical coordinates and assign partition ids,
+ * (2) scatter every row into the blocks of its partition.
+ * Each partition is then ordered through a single staging buffer. The table itself is never held in memory.
+ */
+template<class T, class Z, class S>
+void PTA<T,Z,S>::init_stream(File<T> *f){
+	this->t.start();
+	uint64_t window = std::min((uint64_t)STREAM_WINDOW, ((this->n - 1)/8 + 1)*8);
+	uint8_t all[NUM_DIMS];
+	for(uint8_t m = 0; m < NUM_DIMS; m++) all[m] = m;
+	T *buffer = static_cast<T*>(aligned_alloc(32,sizeof(T)*window*this->d));
+
+	std::cout << "computing polar coordinates ..." << std::endl;
+	T *pdata = static_cast<T*>(aligned_alloc(32,sizeof(T)*this->n * (this->d-1)));
+	this->part_id = static_cast<Z*>(aligned_alloc(32,sizeof(Z)*this->n));
+	for(uint64_t first = 0; first < this->n; first+=window){
+		uint64_t rows = std::min(window, this->n - first);
+		f->read_window_norm(buffer,first,rows,window,this->d,all);
+		this->polar_angles(buffer,window,rows,&pdata[first],this->n);
+	}
+	this->split_coordinates(pdata);
+	free(pdata);
+	this->alloc_partitions();
+
+	std::cout << "creating partitions ..." << std::endl;
+	std::vector<Z> fill(PPARTITIONS,0);
+	for(uint64_t first = 0; first < this->n; first+=window){
+		uint64_t rows = std::min(window, this->n - first);
+		f->read_window_norm(buffer,first,rows,window,this->d,all);
+		for(uint64_t i = 0; i < rows; i++){
+			Z pid = this->part_id[first + i];
+			Z l = fill[pid]++;
+			T *tuples = this->parts[pid].blocks[l >> PBLOCK_SHF].tuples;
+			for(uint32_t m = 0; m < this->d; m++) tuples[m * PBLOCK_SIZE + (l & (PBLOCK_SIZE - 1))] = buffer[m*window + i];
+			this->parts[pid].blocks[l >> PBLOCK_SHF].tids[l & (PBLOCK_SIZE - 1)] = first + i;
+		}
+	}
+	free(buffer);
+	free(this->part_id); this->part_id = NULL;
+
+	uint64_t gindex = 0;
+	pta_pos<Z> *pos = (pta_pos<Z>*)malloc(sizeof(pta_pos<Z>)*this->max_part_size);
+	pta_pair<T,Z> *list = (pta_pair<T,Z>*)malloc(sizeof(pta_pair<T,Z>)*this->max_part_size);
+	T *staging = (T*)malloc(sizeof(T)*this->max_part_size*this->d);
+	T *sorted = (T*)malloc(sizeof(T)*this->max_part_size*this->d);
+	Z *rows = (Z*)malloc(sizeof(Z)*this->max_part_size);
+	for(uint64_t i = 0; i < PPARTITIONS;i++){//Build Partitions
+		if(this->parts[i].size == 0) continue;
+		for(uint64_t j = 0; j < this->parts[i].size;j++){//Gather partition tuples in arrival order
+			T *tuples = this->parts[i].blocks[j >> PBLOCK_SHF].tuples;
+			for(uint32_t m = 0; m < this->d; m++) staging[m*this->max_part_size + j] = tuples[m * PBLOCK_SIZE + (j & (PBLOCK_SIZE - 1))];
+			rows[j] = this->parts[i].blocks[j >> PBLOCK_SHF].tids[j & (PBLOCK_SIZE - 1)];
+		}
+		this->build_partition(i,staging,this->max_part_size,rows,list,pos,sorted);
+		this->parts[i].offset = gindex;
+		gindex+=this->parts[i].size;
+	}
+	free(pos);
+	free(list);
+	free(staging);
+	free(sorted);
+	free(rows);
+	this->tt_init = this->t.lap();
+}
+
+template<class T, class Z, class S>
+void PTA<T,Z,S>::save_index(std::string fname){
+	save_index_file<T,Z,pta_partition<T,Z>,pta_block<T,Z>>(fname,INDEX_PTA,this->n,this->d,PBLOCK_SIZE,this->parts,PPARTITIONS);
+}
+
+template<class T, class Z, class S>
+void PTA<T,Z,S>::load_index(std::string fname){
+	index_header h;
+	this->t.start();
+	this->index_map = map_index_file<T,Z,pta_block<T,Z>>(fname,INDEX_PTA,this->n,this->d,PBLOCK_SIZE,h,this->index_bytes);
+	if(h.part_num != PPARTITIONS){
+		std::cout << "Index partitions (" << h.part_num << ") != PPARTITIONS (" << PPARTITIONS << ")!!!" << std::endl;
+		exit(1);
+	}
+	assign_index_parts<pta_partition<T,Z>,pta_block<T,Z>>(this->index_map,h,this->parts);
+	this->max_part_size = 0;
+	for(uint64_t i = 0; i < PPARTITIONS; i++) this->max_part_size = std::max(this->max_part_size,this->parts[i].size);
+	if(this->cdata != NULL){ free(this->cdata); this->cdata = NULL; }
+	this->tt_init = this->t.lap();
+}
+
+/*
+ * Scan the blocks of each non-empty partition; TOPK_PARALLEL assigns partitions to threads round-robin
+ */
+template<class T, class Z, class S>
+void PTA<T,Z,S>::query_top(const TopKQuery<T> &query, std::vector<tuple_<T,Z>> &top, uint64_t &tuple_count) const{
+	if(query.policy == TOPK_PARALLEL){
+		uint32_t threads = std::max((uint64_t)1,std::min((uint64_t)query.threads,(uint64_t)PPARTITIONS));
+		std::vector<topk_heap<T,Z>> tq(threads);
+		std::vector<std::vector<tuple_<T,Z>>> tt(threads);
+		TopKShared<T> shared;//k-th score published across threads
+		std::vector<uint64_t> tcount(threads,0);
+		#pragma omp parallel num_threads(threads)
+		{
+			uint32_t tid = omp_get_thread_num();
+			uint32_t nt = omp_get_num_threads();
+			for(uint64_t i = tid; i < PPARTITIONS; i+=nt){
+				if(this->parts[i].size == 0) continue;
+				topk_scan_blocks<T,Z,PBLOCK_SIZE>(this->parts[i].blocks,this->parts[i].block_num,query,tq[tid],tcount[tid],this->fn,&shared);
+			}
+			topk_sorted<T,Z>(tq[tid],query.k,tt[tid]);
+			topk_tree_merge<T,Z>(tt.data(),tid,nt,query.k);
+		}
+		std::swap(top,tt[0]);
+		for(uint32_t i = 0; i < threads; i++) tuple_count+=tcount[i];
+	}else{
+		topk_heap<T,Z> q;
+		for(uint64_t i = 0; i < PPARTITIONS; i++){
+			if(this->parts[i].size == 0) continue;
+			topk_scan_blocks<T,Z,PBLOCK_SIZE>(this->parts[i].blocks,this->parts[i].block_num,query,q,tuple_count,this->fn);
+		}
+		topk_sorted<T,Z>(q,query.k,top);
+	}
+}
+
+/*
+ * Re-entrant top-k query (see TopK.h), results in descending score order
+ */
+template<class T, class Z, class S>
+TopKResult<T,Z> PTA<T,Z,S>::query(const TopKQuery<T> &query) const{
+	TopKResult<T,Z> r;
+	this->query_top(query,r.tuples,r.tuple_count);
+	r.threshold = r.tuples.empty() ? 0 : r.tuples.back().score;
+	return r;
+}
+
+template<class T, class Z, class S>
+uint64_t PTA<T,Z,S>::query(const TopKQuery<T> &query, tuple_<T,Z> *out) const{
+	std::vector<tuple_<T,Z>> top;
+	uint64_t tuple_count = 0;
+	this->query_top(query,top,tuple_count);
+	std::copy(top.begin(),top.end(),out);
+	return top.size();
+}
+
+/*
+ * Tuples query() scans when the k-th score is kth (see Planner.h)
+ */
+template<class T, class Z, class S>
+uint64_t PTA<T,Z,S>::estimate(const TopKQuery<T> &query, T kth) const{
+	uint64_t count = 0;
+	for(uint64_t i = 0; i < PPARTITIONS; i++){
+		if(this->parts[i].size == 0) continue;
+		count+=topk_estimate_blocks<T>(this->parts[i].blocks,this->parts[i].block_num,query,kth,this->fn);
+	}
+	return count;
+}
+
+/*
+ * Paged top-k: cursor() opens a scan, next() returns the following count tuples in descending score order
+ * and resumes from the recorded block positions
+ */
+template<class T, class Z, class S>
+TopKCursor<T,Z> PTA<T,Z,S>::cursor(const TopKQuery<T> &query) const{
+	TopKCursor<T,Z> c;
+	c.query = query;
+	return c;
+}
+
+template<class T, class Z, class S>
+uint64_t PTA<T,Z,S>::next(TopKCursor<T,Z> &cursor, uint64_t count, tuple_<T,Z> *out) const{
+	return topk_cursor_next<T,Z,PBLOCK_SIZE>(this->parts,PPARTITIONS,cursor,count,out,this->fn);
+}
+
+template<class T, class Z, class S>
+void PTA<T,Z,S>::findTopKscalar(uint64_t k, uint8_t qq, T *weights, uint8_t *attr){
 	std::cout << this->algo << " find top-" << k << " scalar (" << (int)qq << "D) ...";
 	if(STATS_EFF) this->tuple_count = 0;
 	if(STATS_EFF) this->pop_count=0;
@@ -335,8 +610,7 @@ void PTA<T,Z>::findTopKscalar(uint64_t k, uint8_t qq, T *weights, uint8_t *attr)
 			}
 
 			T threshold = 0;
-			T *tarray = this->parts[p].blocks[b].tarray;
-			for(uint8_t m = 0; m < qq; m++) threshold+=tarray[attr[m]]*weights[attr[m]];
+			threshold+=topk_bound<T>(this->parts[p].blocks[b],qq,weights,attr);
 			if(q.size() >= k && q.top().score >= threshold){ break; }
 		}
 		//std::cout << "p: " <<p << " = " << count << std::endl;
@@ -354,8 +628,8 @@ void PTA<T,Z>::findTopKscalar(uint64_t k, uint8_t qq, T *weights, uint8_t *attr)
 	this->threshold = threshold;
 }
 
-template<class T, class Z>
-void PTA<T,Z>::findTopKsimd(uint64_t k, uint8_t qq, T *weights, uint8_t *attr){
+template<class T, class Z, class S>
+void PTA<T,Z,S>::findTopKsimd(uint64_t k, uint8_t qq, T *weights, uint8_t *attr){
 	std::cout << this->algo << " find top-" << k << " simd (" << (int)qq << "D) ...";
 	if(STATS_EFF) this->tuple_count = 0;
 	if(STATS_EFF) this->pop_count=0;
@@ -365,17 +639,16 @@ void PTA<T,Z>::findTopKsimd(uint64_t k, uint8_t qq, T *weights, uint8_t *attr){
 	float score[16] __attribute__((aligned(32)));
 	this->t.start();
 	__m256 dim_num = _mm256_set_ps(qq,qq,qq,qq,qq,qq,qq,qq);
+	auto c = topk_candidates<T,Z>(q,k);
 	for(uint64_t p = 0; p < PPARTITIONS; p++){
 		if(this->parts[p].size == 0) continue;
-		Z poffset = this->parts[p].offset;
 		//uint32_t count = 0;
 		for(uint64_t b = 0; b < this->parts[p].block_num; b++){
 			__builtin_prefetch(score,1,3);
-			Z id = this->parts[p].offset + poffset;
+			uint64_t id = this->parts[p].offset + this->parts[p].blocks[b].offset;
 			T *tuples = this->parts[p].blocks[b].tuples;
 			//std::cout << b <<"< tuple_num: " << this->parts[p].blocks[b].tuple_num << std::endl;
 			for(uint64_t t = 0; t < this->parts[p].blocks[b].tuple_num; t+=16){
-				id+=t;
 				__m256 score00 = _mm256_setzero_ps();
 				__m256 score01 = _mm256_setzero_ps();
 				for(uint8_t m = 0; m < qq; m++){
@@ -391,19 +664,13 @@ void PTA<T,Z>::findTopKsimd(uint64_t k, uint8_t qq, T *weights, uint8_t *attr){
 				}
 				_mm256_store_ps(&score[0],score00);
 				_mm256_store_ps(&score[8],score01);
-				for(uint8_t l = 0; l < 16; l++){
-					if(q.size() < k){
-						q.push(tuple_<T,Z>(id,score[l]));
-					}else if(q.top().score < score[l]){
-						q.pop(); q.push(tuple_<T,Z>(id,score[l]));
-					}
-				}
+				c.push16(score,topk_lanes(this->parts[p].blocks[b].tuple_num,t),id + t);
 				if(STATS_EFF) this->tuple_count+=16;
 			}
 
+			c.flush();
 			T threshold = 0;
-			T *tarray = this->parts[p].blocks[b].tarray;
-			for(uint8_t m = 0; m < qq; m++) threshold+=tarray[attr[m]]*weights[attr[m]];
+			threshold+=topk_bound<T>(this->parts[p].blocks[b],qq,weights,attr);
 			if(q.size() >= k && q.top().score >= threshold){ break; }
 		}
 	}
@@ -421,8 +688,8 @@ void PTA<T,Z>::findTopKsimd(uint64_t k, uint8_t qq, T *weights, uint8_t *attr){
 	this->threshold = threshold;
 }
 
-template<class T, class Z>
-void PTA<T,Z>::findTopKsimdMQ(uint64_t k, uint8_t qq, T *weights, uint8_t *attr, uint32_t tid){
+template<class T, class Z, class S>
+void PTA<T,Z,S>::findTopKsimdMQ(uint64_t k, uint8_t qq, T *weights, uint8_t *attr, uint32_t tid){
 	Time<msecs> t;
 	if(STATS_EFF) this->tuple_count = 0;
 	if(STATS_EFF) this->pop_count=0;
@@ -432,17 +699,16 @@ void PTA<T,Z>::findTopKsimdMQ(uint64_t k, uint8_t qq, T *weights, uint8_t *attr,
 	float score[16] __attribute__((aligned(32)));
 	t.start();
 	__m256 dim_num = _mm256_set_ps(qq,qq,qq,qq,qq,qq,qq,qq);
+	auto c = topk_candidates<T,Z>(q,k);
 	for(uint64_t p = 0; p < PPARTITIONS; p++){
 		if(this->parts[p].size == 0) continue;
-		Z poffset = this->parts[p].offset;
 		//uint32_t count = 0;
 		for(uint64_t b = 0; b < this->parts[p].block_num; b++){
 			__builtin_prefetch(score,1,3);
-			Z id = this->parts[p].offset + poffset;
+			uint64_t id = this->parts[p].offset + this->parts[p].blocks[b].offset;
 			T *tuples = this->parts[p].blocks[b].tuples;
 			//std::cout << b <<"< tuple_num: " << this->parts[p].blocks[b].tuple_num << std::endl;
 			for(uint64_t t = 0; t < this->parts[p].blocks[b].tuple_num; t+=16){
-				id+=t;
 				__m256 score00 = _mm256_setzero_ps();
 				__m256 score01 = _mm256_setzero_ps();
 				for(uint8_t m = 0; m < qq; m++){
@@ -458,30 +724,24 @@ void PTA<T,Z>::findTopKsimdMQ(uint64_t k, uint8_t qq, T *weights, uint8_t *attr,
 				}
 				_mm256_store_ps(&score[0],score00);
 				_mm256_store_ps(&score[8],score01);
-				for(uint8_t l = 0; l < 16; l++){
-					if(q.size() < k){
-						q.push(tuple_<T,Z>(id,score[l]));
-					}else if(q.top().score < score[l]){
-						q.pop(); q.push(tuple_<T,Z>(id,score[l]));
-					}
-				}
+				c.push16(score,topk_lanes(this->parts[p].blocks[b].tuple_num,t),id + t);
 			}
 
+			c.flush();
 			T threshold = 0;
-			T *tarray = this->parts[p].blocks[b].tarray;
-			for(uint8_t m = 0; m < qq; m++) threshold+=tarray[attr[m]]*weights[attr[m]];
+			threshold+=topk_bound<T>(this->parts[p].blocks[b],qq,weights,attr);
 			if(q.size() >= k && q.top().score >= threshold){ break; }
 		}
 	}
 	this->tt_array[tid] += t.lap();
 }
 
-template<class T, class Z>
-void PTA<T,Z>::findTopKthreads(uint64_t k, uint8_t qq, T *weights, uint8_t *attr){
+template<class T, class Z, class S>
+void PTA<T,Z,S>::findTopKthreads(uint64_t k, uint8_t qq, T *weights, uint8_t *attr){
 	uint32_t threads = THREADS < PPARTITIONS ? THREADS : PPARTITIONS;
 	Z tt_count[threads];
 	std::priority_queue<T, std::vector<tuple_<T,Z>>, MaxCMP<T,Z>> _q[threads];
-	std::priority_queue<T, std::vector<tuple_<T,Z>>, MaxCMP<T,Z>> q;
+	std::vector<tuple_<T,Z>> top[threads];
 	omp_set_num_threads(threads);
 
 	std::cout << this->algo << " find top-" << k << " threads x "<< threads <<" (" << (int)qq << "D) ...";
@@ -489,6 +749,7 @@ void PTA<T,Z>::findTopKthreads(uint64_t k, uint8_t qq, T *weights, uint8_t *attr
 	if(STATS_EFF) this->pop_count=0;
 	if(this->res.size() > 0) this->res.clear();
 
+	TopKShared<T> shared;//k-th score published across threads
 	this->t.start();
 #pragma omp parallel
 {
@@ -497,15 +758,14 @@ void PTA<T,Z>::findTopKthreads(uint64_t k, uint8_t qq, T *weights, uint8_t *attr
 	Z tuple_count = 0;
 	__builtin_prefetch(score,1,3);
 	__m256 dim_num = _mm256_set_ps(qq,qq,qq,qq,qq,qq,qq,qq);
+	auto c = topk_candidates<T,Z>(_q[tid],k,&shared);
 	for(uint64_t p = tid; p < PPARTITIONS; p+=threads){
 		if(this->parts[p].size == 0) continue;
-		Z poffset = this->parts[p].offset;
 		for(uint64_t b = 0; b < this->parts[p].block_num; b++){
-			Z id = this->parts[p].offset + poffset;
+			uint64_t id = this->parts[p].offset + this->parts[p].blocks[b].offset;
 			T *tuples = this->parts[p].blocks[b].tuples;
 
 			for(uint64_t t = 0; t < this->parts[p].blocks[b].tuple_num; t+=16){
-				id+=t;
 				__m256 score00 = _mm256_setzero_ps();
 				__m256 score01 = _mm256_setzero_ps();
 				for(uint8_t m = 0; m < qq; m++){
@@ -522,55 +782,36 @@ void PTA<T,Z>::findTopKthreads(uint64_t k, uint8_t qq, T *weights, uint8_t *attr
 				_mm256_store_ps(&score[0],score00);
 				_mm256_store_ps(&score[8],score01);
 
-				for(uint8_t l = 0; l < 16; l++){
-					if(_q[tid].size() < k){
-						_q[tid].push(tuple_<T,Z>(id,score[l]));
-					}else if(_q[tid].top().score < score[l]){
-						_q[tid].pop(); _q[tid].push(tuple_<T,Z>(id,score[l]));
-					}
-				}
+				c.push16(score,topk_lanes(this->parts[p].blocks[b].tuple_num,t),id + t);
 				if(STATS_EFF) tuple_count+=16;
 			}
 
+			c.flush();
 			T threshold = 0;
-			T *tarray = this->parts[p].blocks[b].tarray;
-			for(uint8_t m = 0; m < qq; m++) threshold+=tarray[attr[m]]*weights[attr[m]];
-			if(_q[tid].size() >= k && _q[tid].top().score >= threshold){ break; }
+			threshold+=topk_bound<T>(this->parts[p].blocks[b],qq,weights,attr);
+			if(c.covers(threshold)){ break; }
 		}
 	}
 	if(STATS_EFF) tt_count[tid] = tuple_count;
+	topk_sorted<T,Z>(_q[tid],k,top[tid]);
+	topk_tree_merge<T,Z>(top,tid,threads,k);
 }
-	for(uint32_t m = 0; m < threads; m++){
-		while(!_q[m].empty()){
-			if(q.size() < k){
-				q.push(_q[m].top());
-			}else if(q.top().score < _q[m].top().score){
-				q.pop();
-				q.push(_q[m].top());
-			}
-			_q[m].pop();
-		}
-	}
 	this->tt_processing += this->t.lap();
 
 	if(STATS_EFF){ for(uint32_t i = 0; i < threads; i++) this->tuple_count +=tt_count[i]; }
-	T threshold = q.top().score;
-	while(!q.empty()){
-		//std::cout << this->algo <<" : " << q.top().tid << "," << q.top().score << std::endl;
-		this->res.push_back(q.top());
-		q.pop();
-	}
+	std::swap(this->res,top[0]);
+	T threshold = this->res.empty() ? 0 : this->res.back().score;
 	std::cout << std::fixed << std::setprecision(4);
 	std::cout << " threshold=[" << threshold <<"] (" << this->res.size() << ")" << std::endl;
 	this->threshold = threshold;
 }
 
-template<class T, class Z>
-void PTA<T,Z>::findTopKthreads2(uint64_t k, uint8_t qq, T *weights, uint8_t *attr){
+template<class T, class Z, class S>
+void PTA<T,Z,S>::findTopKthreads2(uint64_t k, uint8_t qq, T *weights, uint8_t *attr){
 	uint32_t threads = THREADS < PPARTITIONS ? THREADS : PPARTITIONS;
 	Z tt_count[threads];
 	std::priority_queue<T, std::vector<tuple_<T,Z>>, MaxCMP<T,Z>> _q[threads];
-	std::priority_queue<T, std::vector<tuple_<T,Z>>, MaxCMP<T,Z>> q;
+	std::vector<tuple_<T,Z>> top[threads];
 	omp_set_num_threads(threads);
 
 	std::cout << this->algo << " find top-" << k << " threads (2) x "<< threads <<" (" << (int)qq << "D) ...";
@@ -578,6 +819,7 @@ void PTA<T,Z>::findTopKthreads2(uint64_t k, uint8_t qq, T *weights, uint8_t *att
 	if(STATS_EFF) this->pop_count=0;
 	if(this->res.size() > 0) this->res.clear();
 
+	TopKShared<T> shared;//k-th score published across threads
 	this->t.start();
 #pragma omp parallel
 {
@@ -590,12 +832,13 @@ void PTA<T,Z>::findTopKthreads2(uint64_t k, uint8_t qq, T *weights, uint8_t *att
 
 	uint32_t mypart = 0;
 	for(uint64_t p = tid; p < PPARTITIONS; p+=threads){
-		max_block_num = std::max(max_block_num,this->parts[p].block_num);
+		max_block_num = std::max(max_block_num,(uint64_t)this->parts[p].block_num);
 		stop[mypart]=false;
 		mypart++;
 	}
 
 	__m256 dim_num = _mm256_set_ps(qq,qq,qq,qq,qq,qq,qq,qq);
+	auto c = topk_candidates<T,Z>(_q[tid],k,&shared);
 	for(uint64_t b = 0; b < max_block_num; b++){
 		mypart = 0;
 		for(uint64_t p = tid; p < PPARTITIONS; p+=threads){
@@ -603,12 +846,10 @@ void PTA<T,Z>::findTopKthreads2(uint64_t k, uint8_t qq, T *weights, uint8_t *att
 			if(this->parts[p].block_num <= b) continue;
 			if(this->parts[p].size == 0) continue;
 
-			Z poffset = this->parts[p].offset;
-			Z id = this->parts[p].offset + poffset;
+			uint64_t id = this->parts[p].offset + this->parts[p].blocks[b].offset;
 			T *tuples = this->parts[p].blocks[b].tuples;
 
 			for(uint64_t t = 0; t < this->parts[p].blocks[b].tuple_num; t+=16){
-				id+=t;
 				__m256 score00 = _mm256_setzero_ps();
 				__m256 score01 = _mm256_setzero_ps();
 				for(uint8_t m = 0; m < qq; m++){
@@ -625,46 +866,27 @@ void PTA<T,Z>::findTopKthreads2(uint64_t k, uint8_t qq, T *weights, uint8_t *att
 				_mm256_store_ps(&score[0],score00);
 				_mm256_store_ps(&score[8],score01);
 
-				for(uint8_t l = 0; l < 16; l++){
-					if(_q[tid].size() < k){
-						_q[tid].push(tuple_<T,Z>(id,score[l]));
-					}else if(_q[tid].top().score < score[l]){
-						_q[tid].pop(); _q[tid].push(tuple_<T,Z>(id,score[l]));
-					}
-				}
+				c.push16(score,topk_lanes(this->parts[p].blocks[b].tuple_num,t),id + t);
 				if(STATS_EFF) tuple_count+=16;
 			}
 
+			c.flush();
 			T threshold = 0;
-			T *tarray = this->parts[p].blocks[b].tarray;
-			for(uint8_t m = 0; m < qq; m++) threshold+=tarray[attr[m]]*weights[attr[m]];
-			if(_q[tid].size() >= k && _q[tid].top().score >= threshold){ stop[mypart]=true; }
+			threshold+=topk_bound<T>(this->parts[p].blocks[b],qq,weights,attr);
+			if(c.covers(threshold)){ stop[mypart]=true; }
 			mypart++;
 		}
 		//std::cout << "p: " <<p << " = " << count << std::endl;
 	}
 	if(STATS_EFF) tt_count[tid] = tuple_count;
+	topk_sorted<T,Z>(_q[tid],k,top[tid]);
+	topk_tree_merge<T,Z>(top,tid,threads,k);
 }
-	for(uint32_t m = 0; m < threads; m++){
-		while(!_q[m].empty()){
-			if(q.size() < k){
-				q.push(_q[m].top());
-			}else if(q.top().score < _q[m].top().score){
-				q.pop();
-				q.push(_q[m].top());
-			}
-			_q[m].pop();
-		}
-	}
 	this->tt_processing += this->t.lap();
 
 	if(STATS_EFF){ for(uint32_t i = 0; i < threads; i++) this->tuple_count +=tt_count[i]; }
-	T threshold = q.top().score;
-	while(!q.empty()){
-		//std::cout << this->algo <<" : " << q.top().tid << "," << q.top().score << std::endl;
-		this->res.push_back(q.top());
-		q.pop();
-	}
+	std::swap(this->res,top[0]);
+	T threshold = this->res.empty() ? 0 : this->res.back().score;
 	std::cout << std::fixed << std::setprecision(4);
 	std::cout << " threshold=[" << threshold <<"] (" << this->res.size() << ")" << std::endl;
 	this->threshold = threshold;
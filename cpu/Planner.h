@@ -0,0 +1,263 @@
+#ifndef PLANNER_H
+#define PLANNER_H
+
+/*
+ * Cost based routing of queries between TPAc, VTA, PTA and SLA instances that live in the same process.
+ * The k-th score of a query is estimated from a row sample, every executor turns it into the number of tuples
+ * it would scan (estimate()) and the planner picks the smallest predicted time. Each query reports the tuples
+ * it actually scanned and its time back, which recalibrate the per-method estimates (moving averages).
+ */
+
+#include "TPAc.h"
+#include "VTA.h"
+#include "PTA.h"
+#if NUM_DIMS <= SLA_MAX_DIMS
+	#include "SLA.h"
+#endif
+#include <mutex>
+
+#define PLAN_TPAC 0
+#define PLAN_VTA 1
+#define PLAN_PTA 2
+#define PLAN_SLA 3
+#define PLAN_METHODS 4
+
+#ifndef PLAN_SAMPLE
+	#define PLAN_SAMPLE 4096 //rows sampled to estimate the k-th score
+#endif
+#define PLAN_ALPHA 0.2 //weight of a new observation
+#define PLAN_PROBE 32 //every PLAN_PROBE queries run the runner-up so that its cost stays current
+
+const std::string plan_methods[PLAN_METHODS] = { "TPAc", "VTA", "PTA", "SLA" };
+
+template<class T, class Z>
+class Planner{
+	public:
+		Planner(uint64_t n, uint64_t d);
+
+		void set_tpac(const TPAc<T,Z> *tpac){ this->tpac = tpac; }
+		void set_vta(const VTA<T,Z> *vta){ this->vta = vta; }
+		void set_pta(const PTA<T,Z> *pta){ this->pta = pta; }
+#if NUM_DIMS <= SLA_MAX_DIMS
+		void set_sla(const SLA<T,Z> *sla){ this->sla = sla; }
+#endif
+
+		void sample(const T *cdata);
+		T estimate_kth(const TopKQuery<T> &query) const;
+		uint8_t plan(const TopKQuery<T> &query, uint64_t *estimates, double *costs) const;
+		TopKResult<T,Z> query(const TopKQuery<T> &query);
+		void observe(uint8_t method, const TopKQuery<T> &query, uint64_t estimate, uint64_t tuple_count, double elapsed);
+
+		void benchmark();
+		void reset_clocks();
+
+	private:
+		uint64_t n;
+		uint64_t d;
+		const TPAc<T,Z> *tpac;
+		const VTA<T,Z> *vta;
+		const PTA<T,Z> *pta;
+#if NUM_DIMS <= SLA_MAX_DIMS
+		const SLA<T,Z> *sla;
+#endif
+
+		std::vector<T> sdata;//sampled rows, column-major
+		uint64_t s;
+
+		double cost[2][PLAN_METHODS];//msecs per scanned tuple attribute, per execution policy
+		double scale[2][PLAN_METHODS];//scanned / estimated tuples, per execution policy
+		uint64_t queries;
+		uint64_t calls[PLAN_METHODS];
+		double tt_processing[PLAN_METHODS];
+		mutable std::mutex lock;
+
+		bool available(uint8_t method) const;
+		uint64_t estimate(uint8_t method, const TopKQuery<T> &query, T kth) const;
+		TopKResult<T,Z> run(uint8_t method, const TopKQuery<T> &query) const;
+};
+
+template<class T, class Z>
+Planner<T,Z>::Planner(uint64_t n, uint64_t d){
+	this->n = n;
+	this->d = d;
+	this->tpac = NULL;
+	this->vta = NULL;
+	this->pta = NULL;
+#if NUM_DIMS <= SLA_MAX_DIMS
+	this->sla = NULL;
+#endif
+	this->s = 0;
+	this->queries = 0;
+	for(uint8_t p = 0; p < 2; p++){
+		for(uint8_t m = 0; m < PLAN_METHODS; m++){
+			//Initial guess: ~1ns per tuple attribute for a full column scan, block scans pay for their bounds and heap
+			this->cost[p][m] = (m == PLAN_TPAC ? 1e-6 : 2e-6) / (p == TOPK_PARALLEL ? THREADS : 1);
+			this->scale[p][m] = 1.0;
+		}
+	}
+	this->reset_clocks();
+}
+
+/*
+ * Keep PLAN_SAMPLE evenly spaced rows of a normalized column-major table
+ */
+template<class T, class Z>
+void Planner<T,Z>::sample(const T *cdata){
+	this->s = std::min((uint64_t)PLAN_SAMPLE,this->n);
+	this->sdata.resize(this->s * this->d);
+	for(uint64_t j = 0; j < this->s; j++){
+		uint64_t i = (j * this->n) / this->s;
+		for(uint8_t m = 0; m < this->d; m++) this->sdata[m*this->s + j] = cdata[m*this->n + i];
+	}
+}
+
+/*
+ * Score of rank k*s/n among the sampled rows passing the filters (the sample maximum when k is smaller than the
+ * sampling interval, the lowest score when fewer rows pass)
+ */
+template<class T, class Z>
+T Planner<T,Z>::estimate_kth(const TopKQuery<T> &query) const{
+	std::vector<T> score;
+	score.reserve(this->s);
+	for(uint64_t j = 0; j < this->s; j++){
+		if(topk_pass<T>(&this->sdata[j],this->s,query)) score.push_back(topk_score<T>(&this->sdata[j],this->s,query));
+	}
+	if(score.empty()) return std::numeric_limits<T>::lowest();
+	uint64_t r = (query.k * this->s) / this->n;
+	r = std::min(r > 0 ? r - 1 : 0, (uint64_t)score.size() - 1);
+	std::nth_element(score.begin(),score.begin() + r,score.end(),std::greater<T>());
+	return score[r];
+}
+
+template<class T, class Z>
+bool Planner<T,Z>::available(uint8_t method) const{
+	switch(method){
+		case PLAN_TPAC: return this->tpac != NULL;
+		case PLAN_VTA: return this->vta != NULL;
+		case PLAN_PTA: return this->pta != NULL;
+#if NUM_DIMS <= SLA_MAX_DIMS
+		case PLAN_SLA: return this->sla != NULL;
+#endif
+		default: return false;
+	}
+}
+
+template<class T, class Z>
+uint64_t Planner<T,Z>::estimate(uint8_t method, const TopKQuery<T> &query, T kth) const{
+	switch(method){
+		case PLAN_TPAC: return this->tpac->estimate(query,kth);
+		case PLAN_VTA: return this->vta->estimate(query,kth);
+#if NUM_DIMS <= SLA_MAX_DIMS
+		case PLAN_SLA: return this->sla->estimate(query,kth);
+#endif
+		default: return this->pta->estimate(query,kth);
+	}
+}
+
+template<class T, class Z>
+TopKResult<T,Z> Planner<T,Z>::run(uint8_t method, const TopKQuery<T> &query) const{
+	switch(method){
+		case PLAN_TPAC: return this->tpac->query(query);
+		case PLAN_VTA: return this->vta->query(query);
+#if NUM_DIMS <= SLA_MAX_DIMS
+		case PLAN_SLA: return this->sla->query(query);
+#endif
+		default: return this->pta->query(query);
+	}
+}
+
+/*
+ * Predicted cost (msecs) and scanned tuples of every method, returns the cheapest one (PLAN_METHODS if none is set)
+ */
+template<class T, class Z>
+uint8_t Planner<T,Z>::plan(const TopKQuery<T> &query, uint64_t *estimates, double *costs) const{
+	T kth = this->estimate_kth(query);
+	uint8_t p = query.policy == TOPK_PARALLEL ? 1 : 0;
+	uint8_t best = PLAN_METHODS;
+	for(uint8_t m = 0; m < PLAN_METHODS; m++){
+		estimates[m] = 0;
+		costs[m] = std::numeric_limits<double>::max();
+		if(!this->available(m)) continue;
+		estimates[m] = this->estimate(m,query,kth);
+	}
+	std::lock_guard<std::mutex> guard(this->lock);
+	for(uint8_t m = 0; m < PLAN_METHODS; m++){
+		if(!this->available(m)) continue;
+		costs[m] = this->cost[p][m] * this->scale[p][m] * estimates[m] * query.qq;
+		if(best == PLAN_METHODS || costs[m] < costs[best]) best = m;
+	}
+	return best;
+}
+
+/*
+ * Fold one execution into the estimates of a method
+ */
+template<class T, class Z>
+void Planner<T,Z>::observe(uint8_t method, const TopKQuery<T> &query, uint64_t estimate, uint64_t tuple_count, double elapsed){
+	uint8_t p = query.policy == TOPK_PARALLEL ? 1 : 0;
+	std::lock_guard<std::mutex> guard(this->lock);
+	if(estimate > 0) this->scale[p][method] = (1 - PLAN_ALPHA) * this->scale[p][method] + PLAN_ALPHA * ((double)tuple_count / estimate);
+	if(tuple_count > 0) this->cost[p][method] = (1 - PLAN_ALPHA) * this->cost[p][method] + PLAN_ALPHA * (elapsed / (tuple_count * query.qq));
+	this->calls[method]++;
+	this->tt_processing[method]+=elapsed;
+}
+
+/*
+ * Route a query to the method with the lowest predicted cost and recalibrate with the observed one
+ */
+template<class T, class Z>
+TopKResult<T,Z> Planner<T,Z>::query(const TopKQuery<T> &query){
+	uint64_t estimates[PLAN_METHODS];
+	double costs[PLAN_METHODS];
+	uint8_t method = this->plan(query,estimates,costs);
+	if(method == PLAN_METHODS){
+		std::cout << "Planner has no executor!!!" << std::endl;
+		exit(1);
+	}
+
+	bool probe;
+	{
+		std::lock_guard<std::mutex> guard(this->lock);
+		probe = (++this->queries % PLAN_PROBE) == 0;
+	}
+	if(probe){
+		uint8_t next = PLAN_METHODS;
+		for(uint8_t m = 0; m < PLAN_METHODS; m++){
+			if(m == method || !this->available(m)) continue;
+			if(next == PLAN_METHODS || costs[m] < costs[next]) next = m;
+		}
+		if(next != PLAN_METHODS) method = next;
+	}
+
+	Time<msecs> t;
+	t.start();
+	TopKResult<T,Z> r = this->run(method,query);
+	this->observe(method,query,estimates[method],r.tuple_count,t.lap());
+	return r;
+}
+
+template<class T, class Z>
+void Planner<T,Z>::reset_clocks(){
+	for(uint8_t m = 0; m < PLAN_METHODS; m++){
+		this->calls[m] = 0;
+		this->tt_processing[m] = 0;
+	}
+}
+
+/*
+ * Queries routed to each method and their average time
+ */
+template<class T, class Z>
+void Planner<T,Z>::benchmark(){
+	std::cout << std::fixed << std::setprecision(8);
+	std::cout << "< Benchmark for Planner algorithm >" << std::endl;
+	for(uint8_t m = 0; m < PLAN_METHODS; m++){
+		if(!this->available(m)) continue;
+		std::cout << plan_methods[m] << " queries: " << this->calls[m];
+		std::cout << " tt_procesing: " << (this->calls[m] > 0 ? this->tt_processing[m] / this->calls[m] : 0);
+		std::cout << " cost: " << this->cost[0][m] << "," << this->cost[1][m];
+		std::cout << " scale: " << this->scale[0][m] << "," << this->scale[1][m] << std::endl;
+	}
+}
+
+#endif
@@ -7,7 +7,8 @@
 
 #include <unordered_map>
 #include "../skyline/hybrid/hybrid.h"
-#include "AA.h"
+#include "TopK.h"
+#include "index_io.h"
 
 #define SLA_THREADS 16
 #define SLA_ALPHA 1024
@@ -32,7 +33,11 @@ struct sla_block{
 	Z offset;
 	Z tuple_num;
 	T tarray[NUM_DIMS] __attribute__((aligned(32)));
+	T tmin[NUM_DIMS] __attribute__((aligned(32)));//attribute minimums of this and the following blocks
+	T zmin[NUM_DIMS];//zone map, attribute range of this block
+	T zmax[NUM_DIMS];
 	T tuples[SBLOCK_SIZE * NUM_DIMS] __attribute__((aligned(32)));
+	Z tids[SBLOCK_SIZE];//input row id of every tuple
 };
 
 template<class T, class Z>
@@ -49,42 +54,58 @@ static bool cmp_sla_pair(const sla_pair<T,Z> &a, const sla_pair<T,Z> &b){ return
 template<class Z>
 static bool cmp_sla_pos(const sla_pos<Z> &a, const sla_pos<Z> &b){ return a.pos < b.pos; };
 
-template<class T, class Z>
+template<class T, class Z, class S = TopKSum<T>>
 class SLA : public AA<T,Z>{
 	public:
 		SLA(uint64_t n, uint64_t d) : AA<T,Z>(n,d){
 			this->algo = "SLA";
 			this->parts = NULL;
+			this->index_map = NULL;
+			this->index_bytes = 0;
 		};
 
 		~SLA(){
 			if(this->parts!=NULL){
-				for(uint64_t i = 0; i < this->layer_num; i++) free(this->parts[i].blocks);
+				if(this->index_map == NULL){ for(uint64_t i = 0; i < this->layer_num; i++) free(this->parts[i].blocks); }
 				free(this->parts);
 			}
+			if(this->index_map!=NULL) munmap(this->index_map,this->index_bytes);
 		};
 
 		void init();
+		void save_index(std::string fname);
+		void load_index(std::string fname);
 		void findTopKscalar(uint64_t k, uint8_t qq, T *weights, uint8_t *attr);
 		void findTopKsimd(uint64_t k, uint8_t qq, T *weights, uint8_t *attr);
 		void findTopKthreads(uint64_t k, uint8_t qq, T *weights, uint8_t *attr);
 		void findTopKthreads2(uint64_t k, uint8_t qq, T *weights, uint8_t *attr);
+		void set_scoring(const S &fn){ this->fn = fn; }//scoring function of query(), see score.h
+		TopKResult<T,Z> query(const TopKQuery<T> &query) const;
+		uint64_t query(const TopKQuery<T> &query, tuple_<T,Z> *out) const;
+		uint64_t estimate(const TopKQuery<T> &query, T kth) const;
+		TopKCursor<T,Z> cursor(const TopKQuery<T> &query) const;
+		uint64_t next(TopKCursor<T,Z> &cursor, uint64_t count, tuple_<T,Z> *out) const;
 
 	private:
+		S fn;
 		std::vector<std::vector<Z>> layers;
 		sla_partition<T,Z> *parts;
 		uint64_t layer_num;
 		uint64_t max_part_size;
+		char *index_map;
+		uint64_t index_bytes;
 
 		T** sky_data(T **cdata);
 		void build_layers(T **cdata);
 		uint64_t partition_table(uint64_t first, uint64_t last, std::unordered_set<uint64_t> layer_set, T **cdata, Z *offset);
 
 		void create_lists();
+		uint64_t layer_cut(const TopKQuery<T> &query, uint64_t k) const;
+		void query_top(const TopKQuery<T> &query, std::vector<tuple_<T,Z>> &top, uint64_t &tuple_count) const;
 };
 
-template<class T, class Z>
-T** SLA<T,Z>::sky_data(T **cdata){
+template<class T, class Z, class S>
+T** SLA<T,Z,S>::sky_data(T **cdata){
 	if(cdata == NULL){
 		cdata = static_cast<T**>(aligned_alloc(32, sizeof(T*) * (this->n)));
 		for(uint64_t i = 0; i < this->n; i++) cdata[i] = static_cast<T*>(aligned_alloc(32, sizeof(T) * (this->d)));
@@ -98,8 +119,8 @@ T** SLA<T,Z>::sky_data(T **cdata){
 	return cdata;
 }
 
-template<class T, class Z>
-void SLA<T,Z>::build_layers(T **cdata){
+template<class T, class Z, class S>
+void SLA<T,Z,S>::build_layers(T **cdata){
 	Z *offset = (Z*)malloc(sizeof(Z)*this->n);
 	for(uint64_t i = 0; i < this->n; i++) offset[i]=i;
 	uint64_t first = 0;
@@ -127,11 +148,11 @@ void SLA<T,Z>::build_layers(T **cdata){
 		last = this->partition_table(first, last, layer_set, cdata, offset);
 //		std::cout << std::dec << std::setfill('0') << std::setw(10);
 //		std::cout << last << std::endl;
-		this->layers.push_back(layer);
+		this->layers.push_back(std::vector<Z>(layer.begin(),layer.end()));
 	}
 
 	if( last > 0 ){
-		std::vector<uint64_t> layer;
+		std::vector<Z> layer;
 		for(uint64_t i = 0; i < last; i++) layer.push_back(offset[i]);
 		this->layers.push_back(layer);
 	}
@@ -161,8 +182,8 @@ void SLA<T,Z>::build_layers(T **cdata){
 //	std::cout << "set values: <" << st.size() << " ? " << this->n << ">" << std::endl;
 }
 
-template<class T, class Z>
-uint64_t SLA<T,Z>::partition_table(uint64_t first, uint64_t last, std::unordered_set<uint64_t> layer_set, T **cdata, Z *offset){
+template<class T, class Z, class S>
+uint64_t SLA<T,Z,S>::partition_table(uint64_t first, uint64_t last, std::unordered_set<uint64_t> layer_set, T **cdata, Z *offset){
 	while(first < last){
 		while(layer_set.find(first) == layer_set.end()){//Find a skyline point
 			++first;
@@ -180,8 +201,8 @@ uint64_t SLA<T,Z>::partition_table(uint64_t first, uint64_t last, std::unordered
 	return first;
 }
 
-template<class T, class Z>
-void SLA<T,Z>::create_lists(){
+template<class T, class Z, class S>
+void SLA<T,Z,S>::create_lists(){
 	//Initialize partitions based on skyline layers//
 	this->parts = static_cast<sla_partition<T,Z>*>(aligned_alloc(32,sizeof(sla_partition<T,Z>)*this->layers.size()));
 	uint64_t offset = 0;
@@ -240,6 +261,7 @@ void SLA<T,Z>::create_lists(){
 			for(uint64_t l = 0; l < upper; l++){
 				Z lid = pos[j+l].id;//Find local tuple id
 				Z gid = this->layers[i][lid];//Find global tuple id inside layer
+				this->parts[i].blocks[b].tids[l] = gid;
 				for(uint32_t m = 0; m < this->d; m++){
 					this->parts[i].blocks[b].tuples[ m * SBLOCK_SIZE + l] = this->cdata[ m * this->n + gid ];
 				}
@@ -249,15 +271,16 @@ void SLA<T,Z>::create_lists(){
 			for(uint32_t m = 0; m < this->d; m++){ this->parts[i].blocks[b].tarray[m] = lists[m][p].score; }//Extract threshold
 			b++;
 		}
+		topk_block_bounds<T,SBLOCK_SIZE>(this->parts[i].blocks,b,this->d);//Lower bounds and zone maps
 
 	}
 	for(uint32_t m=0; m<this->d;m++) free(lists[m]);
 	free(lists);
 }
 
-template<class T, class Z>
-void SLA<T,Z>::init(){
-	normalize_transpose<T,Z>(this->cdata, this->n, this->d);
+template<class T, class Z, class S>
+void SLA<T,Z,S>::init(){
+	if(!this->normalized) normalize_transpose<T,Z>(this->cdata, this->n, this->d);
 	///////////////////////////////////////
 	//Copy data to compute skyline layers//
 	//////////////////////////////////////
@@ -281,8 +304,123 @@ void SLA<T,Z>::init(){
 	this->tt_init = this->t.lap();
 }
 
-template<class T, class Z>
-void SLA<T,Z>::findTopKscalar(uint64_t k, uint8_t qq, T *weights, uint8_t *attr){
+template<class T, class Z, class S>
+void SLA<T,Z,S>::save_index(std::string fname){
+	save_index_file<T,Z,sla_partition<T,Z>,sla_block<T,Z>>(fname,INDEX_SLA,this->n,this->d,SBLOCK_SIZE,this->parts,this->layer_num);
+}
+
+template<class T, class Z, class S>
+void SLA<T,Z,S>::load_index(std::string fname){
+	index_header h;
+	this->t.start();
+	this->index_map = map_index_file<T,Z,sla_block<T,Z>>(fname,INDEX_SLA,this->n,this->d,SBLOCK_SIZE,h,this->index_bytes);
+	this->layer_num = h.part_num;
+	this->parts = static_cast<sla_partition<T,Z>*>(aligned_alloc(32,sizeof(sla_partition<T,Z>)*this->layer_num));
+	assign_index_parts<sla_partition<T,Z>,sla_block<T,Z>>(this->index_map,h,this->parts);
+	this->max_part_size = 0;
+	for(uint64_t i = 0; i < this->layer_num; i++) this->max_part_size = std::max(this->max_part_size,(uint64_t)this->parts[i].size);
+	if(this->cdata != NULL){ free(this->cdata); this->cdata = NULL; }
+	this->tt_init = this->t.lap();
+}
+
+/*
+ * Skyline layers holding the top-k of a query. A tuple of a deeper layer is dominated by one of a shallower layer,
+ * which only scores at least as high when the score increases in every queried attribute and nothing (filters,
+ * ceiling) can exclude the dominating tuple. Otherwise every layer is scanned and the block bounds prune within it.
+ */
+template<class T, class Z, class S>
+uint64_t SLA<T,Z,S>::layer_cut(const TopKQuery<T> &query, uint64_t k) const{
+	if(query.fq != 0 || query.ceiling != std::numeric_limits<T>::max()) return this->layer_num;
+	for(uint8_t m = 0; m < query.qq; m++){
+		uint8_t a = query.attr[m];
+		if(!this->fn.increasing(a,query.weights[a])) return this->layer_num;
+	}
+	return std::min(this->layer_num,k + 1);
+}
+
+/*
+ * Scan the blocks of the skyline layers holding the top-k (see layer_cut); TOPK_PARALLEL assigns layers to threads round-robin
+ */
+template<class T, class Z, class S>
+void SLA<T,Z,S>::query_top(const TopKQuery<T> &query, std::vector<tuple_<T,Z>> &top, uint64_t &tuple_count) const{
+	uint64_t layers = this->layer_cut(query,query.k);
+	if(query.policy == TOPK_PARALLEL){
+		uint32_t threads = std::max((uint64_t)1,std::min((uint64_t)query.threads,layers));
+		std::vector<topk_heap<T,Z>> tq(threads);
+		std::vector<std::vector<tuple_<T,Z>>> tt(threads);
+		TopKShared<T> shared;//k-th score published across threads
+		std::vector<uint64_t> tcount(threads,0);
+		#pragma omp parallel num_threads(threads)
+		{
+			uint32_t tid = omp_get_thread_num();
+			uint32_t nt = omp_get_num_threads();
+			for(uint64_t l = tid; l < layers; l+=nt){
+				topk_scan_blocks<T,Z,SBLOCK_SIZE>(this->parts[l].blocks,this->parts[l].block_num,query,tq[tid],tcount[tid],this->fn,&shared);
+			}
+			topk_sorted<T,Z>(tq[tid],query.k,tt[tid]);
+			topk_tree_merge<T,Z>(tt.data(),tid,nt,query.k);
+		}
+		std::swap(top,tt[0]);
+		for(uint32_t i = 0; i < threads; i++) tuple_count+=tcount[i];
+	}else{
+		topk_heap<T,Z> q;
+		for(uint64_t l = 0; l < layers; l++){
+			topk_scan_blocks<T,Z,SBLOCK_SIZE>(this->parts[l].blocks,this->parts[l].block_num,query,q,tuple_count,this->fn);
+		}
+		topk_sorted<T,Z>(q,query.k,top);
+	}
+}
+
+/*
+ * Re-entrant top-k query (see TopK.h), results in descending score order
+ */
+template<class T, class Z, class S>
+TopKResult<T,Z> SLA<T,Z,S>::query(const TopKQuery<T> &query) const{
+	TopKResult<T,Z> r;
+	this->query_top(query,r.tuples,r.tuple_count);
+	r.threshold = r.tuples.empty() ? 0 : r.tuples.back().score;
+	return r;
+}
+
+template<class T, class Z, class S>
+uint64_t SLA<T,Z,S>::query(const TopKQuery<T> &query, tuple_<T,Z> *out) const{
+	std::vector<tuple_<T,Z>> top;
+	uint64_t tuple_count = 0;
+	this->query_top(query,top,tuple_count);
+	std::copy(top.begin(),top.end(),out);
+	return top.size();
+}
+
+/*
+ * Tuples query() scans when the k-th score is kth (see Planner.h), over the layers it reads
+ */
+template<class T, class Z, class S>
+uint64_t SLA<T,Z,S>::estimate(const TopKQuery<T> &query, T kth) const{
+	uint64_t count = 0;
+	uint64_t layers = this->layer_cut(query,query.k);
+	for(uint64_t l = 0; l < layers; l++) count+=topk_estimate_blocks<T>(this->parts[l].blocks,this->parts[l].block_num,query,kth,this->fn);
+	return count;
+}
+
+/*
+ * Paged top-k: cursor() opens a scan, next() returns the following count tuples in descending score order
+ * and resumes from the recorded block positions. Layers are added as pages grow (see layer_cut).
+ */
+template<class T, class Z, class S>
+TopKCursor<T,Z> SLA<T,Z,S>::cursor(const TopKQuery<T> &query) const{
+	TopKCursor<T,Z> c;
+	c.query = query;
+	return c;
+}
+
+template<class T, class Z, class S>
+uint64_t SLA<T,Z,S>::next(TopKCursor<T,Z> &cursor, uint64_t count, tuple_<T,Z> *out) const{
+	uint64_t layers = this->layer_cut(cursor.query,cursor.emitted + count);
+	return topk_cursor_next<T,Z,SBLOCK_SIZE>(this->parts,layers,cursor,count,out,this->fn);
+}
+
+template<class T, class Z, class S>
+void SLA<T,Z,S>::findTopKscalar(uint64_t k, uint8_t qq, T *weights, uint8_t *attr){
 	std::cout << this->algo << " find top-" << k << " scalar (" << (int)qq << "D) ...";
 	if(STATS_EFF) this->tuple_count = 0;
 	if(STATS_EFF) this->pop_count=0;
@@ -338,8 +476,7 @@ void SLA<T,Z>::findTopKscalar(uint64_t k, uint8_t qq, T *weights, uint8_t *attr)
 			}
 
 			T threshold = 0;
-			T *tarray = this->parts[l].blocks[b].tarray;
-			for(uint8_t m = 0; m < qq; m++) threshold+=tarray[attr[m]]*weights[attr[m]];
+			threshold+=topk_bound<T>(this->parts[l].blocks[b],qq,weights,attr);
 			if(q.size() >= k && q.top().score >= threshold){ break; }
 		}
 	}
@@ -352,8 +489,8 @@ void SLA<T,Z>::findTopKscalar(uint64_t k, uint8_t qq, T *weights, uint8_t *attr)
 	this->threshold = threshold;
 }
 
-template<class T, class Z>
-void SLA<T,Z>::findTopKsimd(uint64_t k, uint8_t qq, T *weights, uint8_t *attr){
+template<class T, class Z, class S>
+void SLA<T,Z,S>::findTopKsimd(uint64_t k, uint8_t qq, T *weights, uint8_t *attr){
 	std::cout << this->algo << " find top-" << k << " simd (" << (int)qq << "D) ...";
 	if(STATS_EFF) this->tuple_count = 0;
 	if(STATS_EFF) this->pop_count=0;
@@ -363,15 +500,14 @@ void SLA<T,Z>::findTopKsimd(uint64_t k, uint8_t qq, T *weights, uint8_t *attr){
 	float score[16] __attribute__((aligned(32)));
 	this->t.start();
 	__m256 dim_num = _mm256_set_ps(qq,qq,qq,qq,qq,qq,qq,qq);
+	auto c = topk_candidates<T,Z>(q,k);
 	for(uint64_t l = 0; l < this->layer_num; l++){
 		if ( l  > k ) break;
-		Z poffset = this->parts[l].offset;
 		for(uint64_t b = 0; b < this->parts[l].block_num; b++){
-			Z id = this->parts[l].offset + poffset;
+			uint64_t id = this->parts[l].offset + this->parts[l].blocks[b].offset;
 			T *tuples = this->parts[l].blocks[b].tuples;
 
 			for(uint64_t t = 0; t < this->parts[l].blocks[b].tuple_num; t+=16){
-				id+=t;
 				__m256 score00 = _mm256_setzero_ps();
 				__m256 score01 = _mm256_setzero_ps();
 				for(uint8_t m = 0; m < qq; m++){
@@ -388,19 +524,13 @@ void SLA<T,Z>::findTopKsimd(uint64_t k, uint8_t qq, T *weights, uint8_t *attr){
 				_mm256_store_ps(&score[0],score00);
 				_mm256_store_ps(&score[8],score01);
 
-				for(uint8_t l = 0; l < 16; l++){
-					if(q.size() < k){
-						q.push(tuple_<T,Z>(id,score[l]));
-					}else if(q.top().score < score[l]){
-						q.pop(); q.push(tuple_<T,Z>(id,score[l]));
-					}
-				}
+				c.push16(score,topk_lanes(this->parts[l].blocks[b].tuple_num,t),id + t);
 				if(STATS_EFF) this->tuple_count+=16;
 			}
 
+			c.flush();
 			T threshold = 0;
-			T *tarray = this->parts[l].blocks[b].tarray;
-			for(uint8_t m = 0; m < qq; m++) threshold+=tarray[attr[m]]*weights[attr[m]];
+			threshold+=topk_bound<T>(this->parts[l].blocks[b],qq,weights,attr);
 			if(q.size() >= k && q.top().score >= threshold){ break; }
 		}
 	}
@@ -413,12 +543,12 @@ void SLA<T,Z>::findTopKsimd(uint64_t k, uint8_t qq, T *weights, uint8_t *attr){
 	this->threshold = threshold;
 }
 
-template<class T, class Z>
-void SLA<T,Z>::findTopKthreads(uint64_t k, uint8_t qq, T *weights, uint8_t *attr){
+template<class T, class Z, class S>
+void SLA<T,Z,S>::findTopKthreads(uint64_t k, uint8_t qq, T *weights, uint8_t *attr){
 	uint32_t threads = THREADS;
 	Z tt_count[threads];
 	std::priority_queue<T, std::vector<tuple_<T,Z>>, MaxCMP<T,Z>> _q[threads];
-	std::priority_queue<T, std::vector<tuple_<T,Z>>, MaxCMP<T,Z>> q;
+	std::vector<tuple_<T,Z>> top[threads];
 	omp_set_num_threads(threads);
 
 	std::cout << this->algo << " find top-" << k << " threads (2) x "<< threads <<" (" << (int)qq << "D) ...";
@@ -435,11 +565,11 @@ void SLA<T,Z>::findTopKthreads(uint64_t k, uint8_t qq, T *weights, uint8_t *attr
 	Z tuple_count = 0;
 	__builtin_prefetch(score,1,3);
 	__m256 dim_num = _mm256_set_ps(qq,qq,qq,qq,qq,qq,qq,qq);
+	auto c = topk_candidates<T,Z>(_q[tid],k);
 	for(uint64_t l = 0; l < this->layer_num; l++){
 		if ( l  > k ) break;
-		Z poffset = this->parts[l].offset;
 		for(uint64_t b = 0; b < this->parts[l].block_num; b++){
-			Z id = this->parts[l].offset + poffset;
+			uint64_t id = this->parts[l].offset + this->parts[l].blocks[b].offset;
 			T *tuples = this->parts[l].blocks[b].tuples;
 
 			uint64_t chunk =(this->parts[l].blocks[b].tuple_num - 1)/threads + 1;
@@ -447,7 +577,6 @@ void SLA<T,Z>::findTopKthreads(uint64_t k, uint8_t qq, T *weights, uint8_t *attr
 			uint64_t end = (tid+1)*(chunk);
 
 			for(uint64_t t = start; t < end; t+=16){
-				id+=t;
 				__m256 score00 = _mm256_setzero_ps();
 				__m256 score01 = _mm256_setzero_ps();
 				for(uint8_t m = 0; m < qq; m++){
@@ -464,20 +593,14 @@ void SLA<T,Z>::findTopKthreads(uint64_t k, uint8_t qq, T *weights, uint8_t *attr
 				_mm256_store_ps(&score[0],score00);
 				_mm256_store_ps(&score[8],score01);
 
-				for(uint8_t l = 0; l < 16; l++){
-					if(_q[tid].size() < k){
-						_q[tid].push(tuple_<T,Z>(id,score[l]));
-					}else if(_q[tid].top().score < score[l]){
-						_q[tid].pop(); _q[tid].push(tuple_<T,Z>(id,score[l]));
-					}
-				}
+				c.push16(score,topk_lanes(this->parts[l].blocks[b].tuple_num,t),id + t);
 				if(STATS_EFF) tuple_count+=16;
 			}
 
+			c.flush();
 			if(tid==0){
 				threshold = 0;
-				T *tarray = this->parts[l].blocks[b].tarray;
-				for(uint8_t m = 0; m < qq; m++) threshold+=tarray[attr[m]]*weights[attr[m]];
+				threshold+=topk_bound<T>(this->parts[l].blocks[b],qq,weights,attr);
 			}
 			#pragma omp_barrier
 			for(uint8_t m = 0; m < qq; m++) if(_q[m].size() >= k && _q[m].top().score >= threshold){ break; }
@@ -485,34 +608,26 @@ void SLA<T,Z>::findTopKthreads(uint64_t k, uint8_t qq, T *weights, uint8_t *attr
 		}
 	}
 	if(STATS_EFF) tt_count[tid] = tuple_count;
+	topk_sorted<T,Z>(_q[tid],k,top[tid]);
+	topk_tree_merge<T,Z>(top,tid,threads,k);
 }
 
-	for(uint32_t m = 0; m < threads; m++){
-		while(!_q[m].empty()){
-			if(q.size() < k){
-				q.push(_q[m].top());
-			}else if(q.top().score < _q[m].top().score){
-				q.pop();
-				q.push(_q[m].top());
-			}
-			_q[m].pop();
-		}
-	}
 	this->tt_processing+=this->t.lap();
 
 	if(STATS_EFF){ for(uint32_t i = 0; i < threads; i++) this->tuple_count +=tt_count[i]; }
-	threshold = q.top().score;
+	std::swap(this->res,top[0]);
+	threshold = this->res.empty() ? 0 : this->res.back().score;
 	std::cout << std::fixed << std::setprecision(4);
-	std::cout << " threshold=[" << threshold <<"] (" << q.size() << ")" << std::endl;
+	std::cout << " threshold=[" << threshold <<"] (" << this->res.size() << ")" << std::endl;
 	this->threshold = threshold;
 }
 
-template<class T, class Z>
-void SLA<T,Z>::findTopKthreads2(uint64_t k, uint8_t qq, T *weights, uint8_t *attr){
+template<class T, class Z, class S>
+void SLA<T,Z,S>::findTopKthreads2(uint64_t k, uint8_t qq, T *weights, uint8_t *attr){
 	uint32_t threads = THREADS;
 	Z tt_count[threads];
 	std::priority_queue<T, std::vector<tuple_<T,Z>>, MaxCMP<T,Z>> _q[threads];
-	std::priority_queue<T, std::vector<tuple_<T,Z>>, MaxCMP<T,Z>> q;
+	std::vector<tuple_<T,Z>> top[threads];
 	omp_set_num_threads(threads);
 
 	std::cout << this->algo << " find top-" << k << " threads (2) x "<< threads <<" (" << (int)qq << "D) ...";
@@ -528,11 +643,11 @@ void SLA<T,Z>::findTopKthreads2(uint64_t k, uint8_t qq, T *weights, uint8_t *att
 	Z tuple_count = 0;
 	__builtin_prefetch(score,1,3);
 	__m256 dim_num = _mm256_set_ps(qq,qq,qq,qq,qq,qq,qq,qq);
+	auto c = topk_candidates<T,Z>(_q[tid],k);
 	for(uint64_t l = 0; l < this->layer_num; l++){
 		if ( l  > k ) break;
-		Z poffset = this->parts[l].offset;
 		for(uint64_t b = 0; b < this->parts[l].block_num; b++){
-			Z id = this->parts[l].offset + poffset;
+			uint64_t id = this->parts[l].offset + this->parts[l].blocks[b].offset;
 			T *tuples = this->parts[l].blocks[b].tuples;
 
 			uint64_t chunk =(this->parts[l].blocks[b].tuple_num - 1)/threads + 1;
@@ -540,7 +655,6 @@ void SLA<T,Z>::findTopKthreads2(uint64_t k, uint8_t qq, T *weights, uint8_t *att
 			uint64_t end = (tid+1)*(chunk);
 
 			for(uint64_t t = start; t < end; t+=16){
-				id+=t;
 				__m256 score00 = _mm256_setzero_ps();
 				__m256 score01 = _mm256_setzero_ps();
 				for(uint8_t m = 0; m < qq; m++){
@@ -557,43 +671,29 @@ void SLA<T,Z>::findTopKthreads2(uint64_t k, uint8_t qq, T *weights, uint8_t *att
 				_mm256_store_ps(&score[0],score00);
 				_mm256_store_ps(&score[8],score01);
 
-				for(uint8_t l = 0; l < 16; l++){
-					if(_q[tid].size() < k){
-						_q[tid].push(tuple_<T,Z>(id,score[l]));
-					}else if(_q[tid].top().score < score[l]){
-						_q[tid].pop(); _q[tid].push(tuple_<T,Z>(id,score[l]));
-					}
-				}
+				c.push16(score,topk_lanes(this->parts[l].blocks[b].tuple_num,t),id + t);
 				if(STATS_EFF) tuple_count+=16;
 			}
 
+			c.flush();
 			T threshold = 0;
-			T *tarray = this->parts[l].blocks[b].tarray;
-			for(uint8_t m = 0; m < qq; m++) threshold+=tarray[attr[m]]*weights[attr[m]];
+			threshold+=topk_bound<T>(this->parts[l].blocks[b],qq,weights,attr);
 			//for(uint8_t m = 0; m < qq; m++) if(_q[m].size() >= k && _q[m].top().score >= threshold){ break; }
 			if(_q[tid].size() >= k && _q[tid].top().score >= threshold){ break; }
 		}
 	}
 	if(STATS_EFF) tt_count[tid] = tuple_count;
+	topk_sorted<T,Z>(_q[tid],k,top[tid]);
+	topk_tree_merge<T,Z>(top,tid,threads,k);
 }
 
-	for(uint32_t m = 0; m < threads; m++){
-		while(!_q[m].empty()){
-			if(q.size() < k){
-				q.push(_q[m].top());
-			}else if(q.top().score < _q[m].top().score){
-				q.pop();
-				q.push(_q[m].top());
-			}
-			_q[m].pop();
-		}
-	}
 	this->tt_processing+=this->t.lap();
 
 	if(STATS_EFF){ for(uint32_t i = 0; i < threads; i++) this->tuple_count +=tt_count[i]; }
-	T threshold = q.top().score;
+	std::swap(this->res,top[0]);
+	T threshold = this->res.empty() ? 0 : this->res.back().score;
 	std::cout << std::fixed << std::setprecision(4);
-	std::cout << " threshold=[" << threshold <<"] (" << q.size() << ")" << std::endl;
+	std::cout << " threshold=[" << threshold <<"] (" << this->res.size() << ")" << std::endl;
 	this->threshold = threshold;
 }
 
@@ -1,7 +1,7 @@
 #ifndef TA_H
 #define TA_H
 
-#include "AA.h"
+#include "TopK.h"
 #include <queue>
 #include <unordered_set>
 
@@ -32,15 +32,18 @@ class TA : public AA<T,Z>{
 
 		void init();
 		void findTopK(uint64_t k,uint8_t qq, T *weights, uint8_t *attr);
+		TopKResult<T,Z> query(const TopKQuery<T> &query) const;
+		uint64_t query(const TopKQuery<T> &query, tuple_<T,Z> *out) const;
 
 	private:
 		pred<T,Z> **alists;
+		void query_heap(const TopKQuery<T> &query, topk_heap<T,Z> &q, uint64_t &tuple_count) const;
 };
 
 template<class T,class Z>
 void TA<T,Z>::init(){
 	//this->lists.resize(this->d);
-	normalize<T,Z>(this->cdata, this->n, this->d);
+	if(!this->normalized) normalize<T,Z>(this->cdata, this->n, this->d);
 	this->alists = (pred<T,Z>**)malloc(sizeof(pred<T,Z>*)*this->d);
 	for(uint32_t m = 0; m < this->d; m++){ this->alists[m] = (pred<T,Z>*)malloc(sizeof(pred<T,Z>)*this->n); }
 
@@ -57,6 +60,50 @@ void TA<T,Z>::init(){
 	this->tt_init = this->t.lap();
 }
 
+/*
+ * Round-robin over the sorted lists until the k-th score reaches the threshold (sequential under both policies).
+ * Lists of negatively weighted attributes are read from the bottom.
+ */
+template<class T,class Z>
+void TA<T,Z>::query_heap(const TopKQuery<T> &query, topk_heap<T,Z> &q, uint64_t &tuple_count) const{
+	std::unordered_set<Z> eset;
+	for(uint64_t i = 0; i < this->n;i++){
+		T threshold=0;
+		for(uint8_t m = 0; m < query.qq; m++){
+			T weight = query.weights[query.attr[m]];
+			pred<T,Z> p = this->alists[query.attr[m]][weight < 0 ? this->n - 1 - i : i];
+			threshold+=p.attr*weight;
+			if(eset.find(p.tid) == eset.end()){
+				eset.insert(p.tid);
+				const T *tuple = &this->cdata[p.tid * this->d];
+				if(topk_pass<T>(tuple,1,query)) topk_push<T,Z>(q,query,p.tid,topk_score<T>(tuple,1,query));
+				tuple_count+=1;
+			}
+		}
+		if(q.size() >= query.k && ((q.top().score) >= threshold) ){ break; }
+	}
+}
+
+/*
+ * Re-entrant top-k query (see TopK.h), results in descending score order
+ */
+template<class T, class Z>
+TopKResult<T,Z> TA<T,Z>::query(const TopKQuery<T> &query) const{
+	TopKResult<T,Z> r;
+	topk_heap<T,Z> q;
+	this->query_heap(query,q,r.tuple_count);
+	topk_result<T,Z>(q,query.k,r);
+	return r;
+}
+
+template<class T, class Z>
+uint64_t TA<T,Z>::query(const TopKQuery<T> &query, tuple_<T,Z> *out) const{
+	topk_heap<T,Z> q;
+	uint64_t tuple_count = 0;
+	this->query_heap(query,q,tuple_count);
+	return topk_copy<T,Z>(q,query.k,out);
+}
+
 template<class T,class Z>
 void TA<T,Z>::findTopK(uint64_t k,uint8_t qq, T *weights, uint8_t *attr){
 	std::cout << this->algo << " find top-" << k << " (" << (int)qq << "D) ...";
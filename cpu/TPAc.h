@@ -1,18 +1,30 @@
 #ifndef TPA_C_F
 #define TPA_C_F
 
-#include "AA.h"
+#include "TopK.h"
+#include "../input/File.h"
+#include "quant.h"
+#include "radix_select.h"
+#include <type_traits>
 
-template<class T, class Z>
+#define TBATCH_ROWS 1024 //rows of a chunk shared by all queries of a batch
+#define TBATCH_QUERIES 4 //queries scored per column load
+
+template<class T, class Z, class S = TopKSum<T>>
 class  TPAc : public AA<T,Z>{
 	public:
 		TPAc(uint64_t n, uint64_t d) : AA<T,Z>(n,d){
 			this->algo = "TPAc";
 			this->scores = NULL;
+			this->stream = NULL;
+			this->qdata = NULL;
+			this->rkeys = NULL;
 		}
 
 		~TPAc(){
 			if(this->scores!=NULL) free(this->scores);
+			if(this->qdata!=NULL) free(this->qdata);
+			if(this->rkeys!=NULL) free(this->rkeys);
 		}
 
 		void init();
@@ -20,19 +32,271 @@ class  TPAc : public AA<T,Z>{
 		void findTopKsimd(uint64_t k,uint8_t qq, T *weights, uint8_t *attr);
 		void findTopKthreads(uint64_t k,uint8_t qq, T *weights, uint8_t *attr);
 		void findTopKsimdMQ(uint64_t k,uint8_t qq, T *weights, uint8_t *attr, uint32_t tid);
+		void findTopKstream(uint64_t k,uint8_t qq, T *weights, uint8_t *attr);
+		void findTopKquant(uint64_t k,uint8_t qq, T *weights, uint8_t *attr);
+		void findTopKradix(uint64_t k,uint8_t qq, T *weights, uint8_t *attr);
+		void set_scoring(const S &fn){ this->fn = fn; }//scoring function of query(), see score.h
+		TopKResult<T,Z> query(const TopKQuery<T> &query) const;
+		uint64_t query(const TopKQuery<T> &query, tuple_<T,Z> *out) const;
+		uint64_t estimate(const TopKQuery<T> &query, T kth) const;
+		void query_batch(const TopKQuery<T> *queries, uint64_t nq, TopKResult<T,Z> *results) const;
+
+		void set_stream(File<T> *stream){ this->stream = stream; }
 	private:
+		S fn;
 		T *scores;
+		uint32_t *rkeys;//radix select key column of findTopKradix
+		File<T> *stream;
+
+		qtype *qdata;
+		uint64_t qn;
+		std::vector<T> qmin;
+		std::vector<T> qscale;
+
+		void quantize_columns();
+
+		void load_window(T *buffer, uint64_t first, uint64_t window, uint8_t qq, uint8_t *attr);
+		void score_window(std::priority_queue<T, std::vector<tuple_<T,Z>>, MaxCMP<T,Z>> &q, T *buffer, uint64_t first, uint64_t window, uint64_t k, uint8_t qq, T *weights, uint8_t *attr);
+		void query_top(const TopKQuery<T> &query, std::vector<tuple_<T,Z>> &top, uint64_t &tuple_count) const;
+		uint64_t query_radix(const TopKQuery<T> &query, uint32_t *keys, tuple_<T,Z> *out) const;
+		void batch_range(const TopKQuery<T> *queries, uint64_t nq, uint64_t first, uint64_t last, topk_heap<T,Z> *q) const;
 };
 
-template<class T, class Z>
-void TPAc<T,Z>::init(){
-	normalize_transpose<T,Z>(this->cdata, this->n, this->d);
+template<class T, class Z, class S>
+void TPAc<T,Z,S>::init(){
+	if(!this->normalized) normalize_transpose<T,Z>(this->cdata, this->n, this->d);
 	this->t.start();
+	if(QBITS > 0) this->quantize_columns();
 	this->tt_init = this->t.lap();
 }
 
-template<class T, class Z>
-void TPAc<T,Z>::findTopKscalar(uint64_t k,uint8_t qq, T *weights, uint8_t *attr){
+/*
+ * Build quantized copy of each column (padded to a multiple of 16 rows)
+ */
+template<class T, class Z, class S>
+void TPAc<T,Z,S>::quantize_columns(){
+	this->qn = ((this->n - 1)/16 + 1)*16;
+	this->qdata = static_cast<qtype*>(aligned_alloc(32,sizeof(qtype)*this->qn*this->d));
+	this->qmin.resize(this->d);
+	this->qscale.resize(this->d);
+	for(uint64_t m = 0; m < this->d; m++){
+		T *column = &this->cdata[m*this->n];
+		T vmin = column[0], vmax = column[0];
+		for(uint64_t i = 0; i < this->n; i++){ vmin = std::min(vmin,column[i]); vmax = std::max(vmax,column[i]); }
+		quant_params<T>(vmin,vmax,this->qmin[m],this->qscale[m]);
+		qtype *qcolumn = &this->qdata[m*this->qn];
+		for(uint64_t i = 0; i < this->n; i++) qcolumn[i] = quantize<T>(column[i],this->qmin[m],this->qscale[m]);
+		for(uint64_t i = this->n; i < this->qn; i++) qcolumn[i] = 0;
+	}
+}
+
+/*
+ * Scan all rows; TOPK_PARALLEL splits them into one contiguous range per thread
+ */
+template<class T, class Z, class S>
+void TPAc<T,Z,S>::query_top(const TopKQuery<T> &query, std::vector<tuple_<T,Z>> &top, uint64_t &tuple_count) const{
+	if(query.policy == TOPK_PARALLEL){
+		uint32_t threads = std::max((uint32_t)1,query.threads);
+		std::vector<topk_heap<T,Z>> tq(threads);
+		std::vector<std::vector<tuple_<T,Z>>> tt(threads);
+		TopKShared<T> shared;//k-th score published across threads
+		#pragma omp parallel num_threads(threads)
+		{
+			uint32_t tid = omp_get_thread_num();
+			uint32_t nt = omp_get_num_threads();
+			uint64_t first = ((uint64_t)tid)*this->n/nt;
+			uint64_t last = ((uint64_t)(tid+1))*this->n/nt;
+			topk_scan_columns<T,Z>(this->cdata,this->n,first,last,query,tq[tid],this->fn,&shared);
+			topk_sorted<T,Z>(tq[tid],query.k,tt[tid]);
+			topk_tree_merge<T,Z>(tt.data(),tid,nt,query.k);
+		}
+		std::swap(top,tt[0]);
+	}else{
+		topk_heap<T,Z> q;
+		topk_scan_columns<T,Z>(this->cdata,this->n,0,this->n,query,q,this->fn);
+		topk_sorted<T,Z>(q,query.k,top);
+	}
+	tuple_count = this->n;
+}
+
+/*
+ * Score every row into the key column and select the top-k by radix select (see radix_select.h),
+ * TOPK_PARALLEL splits both into one contiguous range per thread
+ */
+template<class T, class Z, class S>
+uint64_t TPAc<T,Z,S>::query_radix(const TopKQuery<T> &query, uint32_t *keys, tuple_<T,Z> *out) const{
+	uint32_t threads = query.policy == TOPK_PARALLEL ? std::max((uint32_t)1,query.threads) : 1;
+	#pragma omp parallel num_threads(threads)
+	{
+		for(uint32_t c = omp_get_thread_num(); c < threads; c+=omp_get_num_threads()){
+			radix_score_columns<T,S>(this->cdata,this->n,radix_first(this->n,threads,c),radix_first(this->n,threads,c+1),query,keys,this->fn);
+		}
+	}
+	return radix_select_topk<T,Z>(keys,this->n,query.k,threads,out);
+}
+
+/*
+ * Re-entrant top-k query (see TopK.h), results in descending score order. Large k use radix select (see radix_query).
+ */
+template<class T, class Z, class S>
+TopKResult<T,Z> TPAc<T,Z,S>::query(const TopKQuery<T> &query) const{
+	TopKResult<T,Z> r;
+	if(radix_query<T>(query)){
+		std::vector<uint32_t> keys(this->n);
+		r.tuples.resize(std::min(query.k,this->n));
+		r.tuples.resize(this->query_radix(query,keys.data(),r.tuples.data()));
+		r.threshold = r.tuples.empty() ? 0 : r.tuples.back().score;
+		r.tuple_count = this->n;
+		return r;
+	}
+	this->query_top(query,r.tuples,r.tuple_count);
+	r.threshold = r.tuples.empty() ? 0 : r.tuples.back().score;
+	return r;
+}
+
+template<class T, class Z, class S>
+uint64_t TPAc<T,Z,S>::query(const TopKQuery<T> &query, tuple_<T,Z> *out) const{
+	if(radix_query<T>(query)){
+		std::vector<uint32_t> keys(this->n);
+		return this->query_radix(query,keys.data(),out);
+	}
+	std::vector<tuple_<T,Z>> top;
+	uint64_t tuple_count = 0;
+	this->query_top(query,top,tuple_count);
+	std::copy(top.begin(),top.end(),out);
+	return top.size();
+}
+
+/*
+ * Tuples scanned by query(), the whole table
+ */
+template<class T, class Z, class S>
+uint64_t TPAc<T,Z,S>::estimate(const TopKQuery<T> &query, T kth) const{
+	return this->n;
+}
+
+/*
+ * Rows [first,last) for nq queries with one heap each. Every chunk of TBATCH_ROWS rows is scored by all queries
+ * before moving on, and each column vector loaded from it is applied to TBATCH_QUERIES queries at once
+ * (weights of attributes a query does not use are zero). Scores are pushed only when they beat the heap top
+ * and pass the filters of their query.
+ */
+template<class T, class Z, class S>
+void TPAc<T,Z,S>::batch_range(const TopKQuery<T> *queries, uint64_t nq, uint64_t first, uint64_t last, topk_heap<T,Z> *q) const{
+	#if LD == 2
+		for(uint64_t j = 0; j < nq; j++) topk_scan_columns<T,Z>(this->cdata,this->n,first,last,queries[j],q[j],this->fn);
+	#else
+		if(!std::is_same<S,TopKSum<T>>::value){//the shared kernel is a weighted sum
+			for(uint64_t j = 0; j < nq; j++) topk_scan_columns<T,Z>(this->cdata,this->n,first,last,queries[j],q[j],this->fn);
+			return;
+		}
+		uint64_t nqb = ((nq - 1)/TBATCH_QUERIES + 1)*TBATCH_QUERIES;
+		std::vector<T> w(nqb*NUM_DIMS,0);
+		std::vector<uint32_t> used(nqb/TBATCH_QUERIES,0);//attributes queried by a group
+		std::vector<T> thres(nq,std::numeric_limits<T>::lowest());
+		for(uint64_t j = 0; j < nq; j++){
+			for(uint8_t m = 0; m < queries[j].qq; m++){
+				uint8_t a = queries[j].attr[m];
+				w[j*NUM_DIMS + a] = queries[j].weights[a];
+				used[j/TBATCH_QUERIES] |= 1u << a;
+			}
+		}
+		float score[8] __attribute__((aligned(32)));
+
+		for(uint64_t c = first; c < last; c+=TBATCH_ROWS){
+			uint64_t cend = std::min(c + TBATCH_ROWS, last);
+			for(uint64_t j0 = 0; j0 < nq; j0+=TBATCH_QUERIES){
+				uint64_t jn = std::min((uint64_t)TBATCH_QUERIES, nq - j0);
+				uint32_t mask = used[j0/TBATCH_QUERIES];
+				const T *wq = &w[j0*NUM_DIMS];
+				uint64_t i = c;
+				for(; i + 8 <= cend; i+=8){
+					__m256 acc[TBATCH_QUERIES];
+					for(uint8_t jj = 0; jj < TBATCH_QUERIES; jj++) acc[jj] = _mm256_setzero_ps();
+					for(uint8_t m = 0; m < this->d; m++){
+						if(!(mask & (1u << m))) continue;
+						__m256 x = _mm256_loadu_ps(&this->cdata[m*this->n + i]);
+						for(uint8_t jj = 0; jj < TBATCH_QUERIES; jj++){
+							acc[jj] = _mm256_add_ps(acc[jj],_mm256_mul_ps(x,_mm256_broadcast_ss(&wq[jj*NUM_DIMS + m])));
+						}
+					}
+					for(uint8_t jj = 0; jj < jn; jj++){
+						uint64_t j = j0 + jj;
+						uint32_t bits = _mm256_movemask_ps(_mm256_cmp_ps(acc[jj],_mm256_set1_ps(thres[j]),_CMP_GT_OQ));
+						if(bits != 0 && queries[j].fq > 0) bits &= topk_filter8<T>(&this->cdata[i],this->n,queries[j]);
+						if(bits == 0) continue;
+						_mm256_store_ps(score,acc[jj]);
+						while(bits){
+							uint32_t l = __builtin_ctz(bits);
+							bits &= bits - 1;
+							topk_push<T,Z>(q[j],queries[j],i + l,score[l]);
+						}
+						if(q[j].size() >= queries[j].k) thres[j] = q[j].top().score;
+					}
+				}
+				for(; i < cend; i++){
+					for(uint64_t jj = 0; jj < jn; jj++){
+						if(!topk_pass<T>(&this->cdata[i],this->n,queries[j0 + jj])) continue;
+						T s = 0;
+						for(uint8_t m = 0; m < this->d; m++) s+=this->cdata[m*this->n + i]*wq[jj*NUM_DIMS + m];
+						topk_push<T,Z>(q[j0 + jj],queries[j0 + jj],i,s);
+					}
+				}
+			}
+		}
+	#endif
+}
+
+/*
+ * Evaluate nq queries with one shared pass over the table; the execution policy and threads of queries[0] apply
+ * to the whole batch (TOPK_PARALLEL gives every thread a contiguous row range and its own nq heaps, tree merged per query).
+ */
+template<class T, class Z, class S>
+void TPAc<T,Z,S>::query_batch(const TopKQuery<T> *queries, uint64_t nq, TopKResult<T,Z> *results) const{
+	if(nq == 0) return;
+	if(queries[0].policy == TOPK_PARALLEL){
+		uint32_t threads = std::max((uint32_t)1,queries[0].threads);
+		std::vector<topk_heap<T,Z>> tq(threads*nq);
+		std::vector<std::vector<tuple_<T,Z>>> tt(threads*nq);
+		#pragma omp parallel num_threads(threads)
+		{
+			uint32_t tid = omp_get_thread_num();
+			uint32_t nt = omp_get_num_threads();
+			uint64_t first = ((uint64_t)tid)*this->n/nt;
+			uint64_t last = ((uint64_t)(tid+1))*this->n/nt;
+			this->batch_range(queries,nq,first,last,&tq[tid*nq]);
+			for(uint64_t j = 0; j < nq; j++) topk_sorted<T,Z>(tq[tid*nq + j],queries[j].k,tt[tid*nq + j]);
+
+			//tree merge of all nq queries at once, same rounds as topk_tree_merge
+			std::vector<tuple_<T,Z>> merged;
+			for(uint32_t step = 1; step < nt; step<<=1){
+				#pragma omp barrier
+				if(tid % (2*step) == 0 && tid + step < nt){
+					for(uint64_t j = 0; j < nq; j++){
+						topk_merge_sorted<T,Z>(tt[tid*nq + j],tt[(tid + step)*nq + j],queries[j].k,merged);
+						std::swap(tt[tid*nq + j],merged);
+					}
+				}
+			}
+		}
+		for(uint64_t j = 0; j < nq; j++){
+			std::swap(results[j].tuples,tt[j]);
+			results[j].threshold = results[j].tuples.empty() ? 0 : results[j].tuples.back().score;
+			results[j].tuple_count = this->n;
+		}
+		return;
+	}
+
+	std::vector<topk_heap<T,Z>> q(nq);
+	this->batch_range(queries,nq,0,this->n,&q[0]);
+	for(uint64_t j = 0; j < nq; j++){
+		topk_result<T,Z>(q[j],queries[j].k,results[j]);
+		results[j].tuple_count = this->n;
+	}
+}
+
+template<class T, class Z, class S>
+void TPAc<T,Z,S>::findTopKscalar(uint64_t k,uint8_t qq, T *weights, uint8_t *attr){
 	std::cout << this->algo << " find top-" << k << " scalar (" << (int)qq << "D) ...";
 	if(STATS_EFF) this->tuple_count = 0;
 	if(STATS_EFF) this->pop_count=0;
@@ -114,8 +378,8 @@ void TPAc<T,Z>::findTopKscalar(uint64_t k,uint8_t qq, T *weights, uint8_t *attr)
 	this->threshold = threshold;
 }
 
-template<class T, class Z>
-void TPAc<T,Z>::findTopKsimd(uint64_t k,uint8_t qq, T *weights, uint8_t *attr){
+template<class T, class Z, class S>
+void TPAc<T,Z,S>::findTopKsimd(uint64_t k,uint8_t qq, T *weights, uint8_t *attr){
 	std::cout << this->algo << " find top-" << k << " simd (" << (int)qq << "D) ...";
 	if(STATS_EFF) this->tuple_count = 0;
 	if(STATS_EFF) this->pop_count=0;
@@ -206,8 +470,8 @@ void TPAc<T,Z>::findTopKsimd(uint64_t k,uint8_t qq, T *weights, uint8_t *attr){
 	this->threshold = threshold;
 }
 
-template<class T, class Z>
-void TPAc<T,Z>::findTopKsimdMQ(uint64_t k,uint8_t qq, T *weights, uint8_t *attr, uint32_t tid){
+template<class T, class Z, class S>
+void TPAc<T,Z,S>::findTopKsimdMQ(uint64_t k,uint8_t qq, T *weights, uint8_t *attr, uint32_t tid){
 	Time<msecs> t;
 	//std::cout << this->algo << " find top-" << k << " simdMQ (" << (int)qq << "D) ...";
 	if(STATS_EFF) this->tuple_count = 0;
@@ -253,8 +517,8 @@ void TPAc<T,Z>::findTopKsimdMQ(uint64_t k,uint8_t qq, T *weights, uint8_t *attr,
 	this->tt_array[tid] += t.lap();
 }
 
-template<class T, class Z>
-void TPAc<T,Z>::findTopKthreads(uint64_t k,uint8_t qq, T *weights, uint8_t *attr){
+template<class T, class Z, class S>
+void TPAc<T,Z,S>::findTopKthreads(uint64_t k,uint8_t qq, T *weights, uint8_t *attr){
 	std::cout << this->algo << " find top-" << k << " threads (" << (int)qq << "D) ...";
 	if(STATS_EFF) this->tuple_count = 0;
 	if(STATS_EFF) this->pop_count=0;
@@ -262,7 +526,9 @@ void TPAc<T,Z>::findTopKthreads(uint64_t k,uint8_t qq, T *weights, uint8_t *attr
 
 	omp_set_num_threads(THREADS);
 	std::priority_queue<T, std::vector<tuple_<T,Z>>, MaxCMP<T,Z>> q[THREADS];
+	std::vector<tuple_<T,Z>> top[THREADS];
 	//boost::heap::priority_queue<tuple_<T,Z>,boost::heap::compare<MaxCMP<T,Z>>> q[THREADS];
+	TopKShared<T> shared;//k-th score published across threads
 	this->t.start();
 #pragma omp parallel
 {
@@ -271,6 +537,7 @@ void TPAc<T,Z>::findTopKthreads(uint64_t k,uint8_t qq, T *weights, uint8_t *attr
 	__builtin_prefetch(score,1,3);
 	uint64_t start = ((uint64_t)thread_id)*(this->n)/THREADS;
 	uint64_t end = ((uint64_t)(thread_id+1))*(this->n)/THREADS;
+	auto c = topk_candidates<T,Z>(q[thread_id],k,&shared);
 
 	__m256 dim_num = _mm256_set_ps(qq,qq,qq,qq,qq,qq,qq,qq);
 	for(uint64_t i = start; i < end; i+=16){
@@ -295,66 +562,242 @@ void TPAc<T,Z>::findTopKthreads(uint64_t k,uint8_t qq, T *weights, uint8_t *attr
 		}
 		_mm256_store_ps(&score[0],score00);
 		_mm256_store_ps(&score[8],score01);
-		if(q[thread_id].size() < k){//insert if empty space in queue
-			q[thread_id].push(tuple_<T,Z>(i,score[0]));
-			q[thread_id].push(tuple_<T,Z>(i+1,score[1]));
-			q[thread_id].push(tuple_<T,Z>(i+2,score[2]));
-			q[thread_id].push(tuple_<T,Z>(i+3,score[3]));
-			q[thread_id].push(tuple_<T,Z>(i+4,score[4]));
-			q[thread_id].push(tuple_<T,Z>(i+5,score[5]));
-			q[thread_id].push(tuple_<T,Z>(i+6,score[6]));
-			q[thread_id].push(tuple_<T,Z>(i+7,score[7]));
-			q[thread_id].push(tuple_<T,Z>(i+8,score[8]));
-			q[thread_id].push(tuple_<T,Z>(i+9,score[9]));
-			q[thread_id].push(tuple_<T,Z>(i+10,score[10]));
-			q[thread_id].push(tuple_<T,Z>(i+11,score[11]));
-			q[thread_id].push(tuple_<T,Z>(i+12,score[12]));
-			q[thread_id].push(tuple_<T,Z>(i+13,score[13]));
-			q[thread_id].push(tuple_<T,Z>(i+14,score[14]));
-			q[thread_id].push(tuple_<T,Z>(i+15,score[15]));
-		}else{//delete smallest element if current score is bigger
-			if(q[thread_id].top().score < score[0]){ q[thread_id].pop(); q[thread_id].push(tuple_<T,Z>(i,score[0])); }
-			if(q[thread_id].top().score < score[1]){ q[thread_id].pop(); q[thread_id].push(tuple_<T,Z>(i+1,score[1])); }
-			if(q[thread_id].top().score < score[2]){ q[thread_id].pop(); q[thread_id].push(tuple_<T,Z>(i+2,score[2])); }
-			if(q[thread_id].top().score < score[3]){ q[thread_id].pop(); q[thread_id].push(tuple_<T,Z>(i+3,score[3])); }
-			if(q[thread_id].top().score < score[4]){ q[thread_id].pop(); q[thread_id].push(tuple_<T,Z>(i+4,score[4])); }
-			if(q[thread_id].top().score < score[5]){ q[thread_id].pop(); q[thread_id].push(tuple_<T,Z>(i+5,score[5])); }
-			if(q[thread_id].top().score < score[6]){ q[thread_id].pop(); q[thread_id].push(tuple_<T,Z>(i+6,score[6])); }
-			if(q[thread_id].top().score < score[7]){ q[thread_id].pop(); q[thread_id].push(tuple_<T,Z>(i+7,score[7])); }
-			if(q[thread_id].top().score < score[8]){ q[thread_id].pop(); q[thread_id].push(tuple_<T,Z>(i+8,score[8])); }
-			if(q[thread_id].top().score < score[9]){ q[thread_id].pop(); q[thread_id].push(tuple_<T,Z>(i+9,score[9])); }
-			if(q[thread_id].top().score < score[10]){ q[thread_id].pop(); q[thread_id].push(tuple_<T,Z>(i+10,score[10])); }
-			if(q[thread_id].top().score < score[11]){ q[thread_id].pop(); q[thread_id].push(tuple_<T,Z>(i+11,score[11])); }
-			if(q[thread_id].top().score < score[12]){ q[thread_id].pop(); q[thread_id].push(tuple_<T,Z>(i+12,score[12])); }
-			if(q[thread_id].top().score < score[13]){ q[thread_id].pop(); q[thread_id].push(tuple_<T,Z>(i+13,score[13])); }
-			if(q[thread_id].top().score < score[14]){ q[thread_id].pop(); q[thread_id].push(tuple_<T,Z>(i+14,score[14])); }
-			if(q[thread_id].top().score < score[15]){ q[thread_id].pop(); q[thread_id].push(tuple_<T,Z>(i+15,score[15])); }
+		c.push16(score,topk_lanes(end,i),i);
+		if(((i - start) % TOPK_SYNC) == 0) c.flush();
+	}
+	c.flush();
+	topk_sorted<T,Z>(q[thread_id],k,top[thread_id]);
+	topk_tree_merge<T,Z>(top,thread_id,THREADS,k);
+}
+	this->tt_processing += this->t.lap();
+
+	std::swap(this->res,top[0]);
+	T threshold = this->res.empty() ? 0 : this->res.back().score;
+	std::cout << std::fixed << std::setprecision(4);
+	std::cout << " threshold=[" << threshold <<"] (" << this->res.size() << ")" << std::endl;
+	this->threshold = threshold;
+}
+
+/*
+ * Read one window of the queried columns and normalize it with the snapshot min/max
+ */
+template<class T, class Z, class S>
+void TPAc<T,Z,S>::load_window(T *buffer, uint64_t first, uint64_t window, uint8_t qq, uint8_t *attr){
+	uint64_t rows = std::min(window, this->n - first);
+	this->stream->read_window_norm(buffer, first, rows, window, qq, attr);
+	for(uint8_t m = 0; m < qq; m++){
+		T *column = &buffer[m*window];
+		for(uint64_t i = rows; i < window; i++){ column[i] = 0; }
+	}
+}
+
+template<class T, class Z, class S>
+void TPAc<T,Z,S>::score_window(std::priority_queue<T, std::vector<tuple_<T,Z>>, MaxCMP<T,Z>> &q, T *buffer, uint64_t first, uint64_t window, uint64_t k, uint8_t qq, T *weights, uint8_t *attr){
+	float score[16] __attribute__((aligned(32)));
+	uint64_t rows = std::min(window, this->n - first);
+	__m256 dim_num = _mm256_set_ps(qq,qq,qq,qq,qq,qq,qq,qq);
+	for(uint64_t i = 0; i < rows; i+=16){
+		__m256 score00 = _mm256_setzero_ps();
+		__m256 score01 = _mm256_setzero_ps();
+		for(uint8_t m = 0; m < qq; m++){
+			uint64_t offset00 = m * window + i;
+			uint64_t offset01 = m * window + i + 8;
+			T weight = weights[attr[m]];
+			__m256 _weight = _mm256_set_ps(weight,weight,weight,weight,weight,weight,weight,weight);
+			__m256 load00 = _mm256_load_ps(&buffer[offset00]);
+			__m256 load01 = _mm256_load_ps(&buffer[offset01]);
+			load00 = _mm256_mul_ps(load00,_weight);
+			load01 = _mm256_mul_ps(load01,_weight);
+			score00 = _mm256_add_ps(score00,load00);
+			score01 = _mm256_add_ps(score01,load01);
+			#if LD == 2
+				score00 = _mm256_div_ps(score00,dim_num);
+				score01 = _mm256_div_ps(score01,dim_num);
+			#endif
+		}
+		_mm256_store_ps(&score[0],score00);
+		_mm256_store_ps(&score[8],score01);
+
+		uint64_t valid = std::min((uint64_t)16, rows - i);
+		for(uint8_t l = 0; l < valid; l++){
+			if(q.size() < k){
+				q.push(tuple_<T,Z>(first + i + l,score[l]));
+			}else if(q.top().score < score[l]){
+				q.pop(); q.push(tuple_<T,Z>(first + i + l,score[l]));
+			}
 		}
 	}
 }
-	std::priority_queue<T, std::vector<tuple_<T,Z>>, PQComparison<T,Z>> _q;
-	for(uint32_t m = 0; m < THREADS; m++){
-		while(!q[m].empty()){
-			if(_q.size() < k){
-				_q.push(q[m].top());
-			}else if(_q.top().score < q[m].top().score){
-				_q.pop();
-				_q.push(q[m].top());
+
+/*
+ * Scan a binary snapshot in windows of STREAM_WINDOW rows keeping a single top-k heap.
+ * One thread reads and normalizes window i+1 while the other scores window i, so memory
+ * is bounded by two windows of the queried columns instead of n*d.
+ */
+template<class T, class Z, class S>
+void TPAc<T,Z,S>::findTopKstream(uint64_t k,uint8_t qq, T *weights, uint8_t *attr){
+	std::cout << this->algo << " find top-" << k << " stream (" << (int)qq << "D) ...";
+	if(STATS_EFF) this->tuple_count = 0;
+	if(STATS_EFF) this->pop_count=0;
+	if(this->res.size() > 0) this->res.clear();
+	if(this->stream == NULL){
+		std::cout << "Stream is not set!!!" << std::endl;
+		exit(1);
+	}
+
+	uint64_t window = std::min((uint64_t)STREAM_WINDOW, ((this->n - 1)/16 + 1)*16);
+	uint64_t windows = (this->n - 1)/window + 1;
+	T *buffer[2];
+	buffer[0] = static_cast<T*>(aligned_alloc(32,sizeof(T)*window*qq));
+	buffer[1] = static_cast<T*>(aligned_alloc(32,sizeof(T)*window*qq));
+
+	std::priority_queue<T, std::vector<tuple_<T,Z>>, MaxCMP<T,Z>> q;
+	this->t.start();
+	this->load_window(buffer[0],0,window,qq,attr);
+#pragma omp parallel num_threads(2)
+{
+	uint32_t tid = omp_get_thread_num();
+	uint32_t nt = omp_get_num_threads();
+	for(uint64_t w = 0; w < windows; w++){
+		if(w + 1 < windows && (tid == 1 || nt == 1)) this->load_window(buffer[(w+1) & 1],(w+1)*window,window,qq,attr);//read ahead
+		if(tid == 0) this->score_window(q,buffer[w & 1],w*window,window,k,qq,weights,attr);
+		#pragma omp barrier
+	}
+}
+	this->tt_processing += this->t.lap();
+	if(STATS_EFF) this->tuple_count=this->n;
+	free(buffer[0]);
+	free(buffer[1]);
+
+	while(q.size() > k){ q.pop(); }
+	T threshold = q.top().score;
+	while(!q.empty()){
+		this->res.push_back(q.top());
+		q.pop();
+	}
+	std::cout << std::fixed << std::setprecision(4);
+	std::cout << " threshold=[" << threshold <<"] (" << this->res.size() << ")" << std::endl;
+	this->threshold = threshold;
+}
+
+/*
+ * Scan quantized columns computing lower/upper score bounds. Rows whose upper bound reaches the
+ * k-th largest lower bound seen so far are kept as candidates and rescored from the float columns.
+ */
+template<class T, class Z, class S>
+void TPAc<T,Z,S>::findTopKquant(uint64_t k,uint8_t qq, T *weights, uint8_t *attr){
+	std::cout << this->algo << " find top-" << k << " quant (" << (int)qq << "D) ...";
+	if(STATS_EFF) this->tuple_count = 0;
+	if(STATS_EFF) this->pop_count=0;
+	if(this->res.size() > 0) this->res.clear();
+	if(this->qdata == NULL){
+		std::cout << "Quantized columns are not initialized (QBITS=0)!!!" << std::endl;
+		exit(1);
+	}
+
+	T ew[NUM_DIMS];
+	quant_weights<T>(qq,weights,attr,ew);
+	T base, delta;
+	quant_bounds<T>(qq,ew,attr,this->qmin.data(),this->qscale.data(),base,delta);
+
+	std::priority_queue<T, std::vector<T>, std::greater<T>> lq;//k largest lower bounds
+	std::vector<tuple_<T,Z>> cand;//candidate id, upper bound
+	float lb[16] __attribute__((aligned(32)));
+	T thr = std::numeric_limits<T>::lowest();
+	this->t.start();
+	for(uint64_t i = 0; i < this->n; i+=16){
+		__m256 lb00 = _mm256_set1_ps(base);
+		__m256 lb01 = _mm256_set1_ps(base);
+		for(uint8_t m = 0; m < qq; m++){
+			const qtype *qcolumn = &this->qdata[attr[m]*this->qn + i];
+			__m256 _ws = _mm256_set1_ps(ew[m]*this->qscale[attr[m]]);
+			lb00 = _mm256_add_ps(lb00,_mm256_mul_ps(qload_ps(qcolumn),_ws));
+			lb01 = _mm256_add_ps(lb01,_mm256_mul_ps(qload_ps(qcolumn + 8),_ws));
+		}
+		__m256 _thr = _mm256_set1_ps(thr - delta);
+		uint32_t mask = _mm256_movemask_ps(_mm256_cmp_ps(lb00,_thr,_CMP_GE_OQ));
+		mask |= _mm256_movemask_ps(_mm256_cmp_ps(lb01,_thr,_CMP_GE_OQ)) << 8;
+		if(mask == 0) continue;
+
+		_mm256_store_ps(&lb[0],lb00);
+		_mm256_store_ps(&lb[8],lb01);
+		while(mask){
+			uint32_t l = __builtin_ctz(mask);
+			mask &= mask - 1;
+			if(i + l >= this->n) break;
+			if(lb[l] + delta < thr) continue;
+			cand.push_back(tuple_<T,Z>(i+l,lb[l] + delta));
+			if(lq.size() < k){
+				lq.push(lb[l]);
+			}else if(lq.top() < lb[l]){
+				lq.pop(); lq.push(lb[l]);
 			}
-			q[m].pop();
+			if(lq.size() >= k) thr = lq.top();
+		}
+	}
+
+	//Refine candidates with exact scores
+	std::priority_queue<T, std::vector<tuple_<T,Z>>, MaxCMP<T,Z>> q;
+	for(uint64_t c = 0; c < cand.size(); c++){
+		if(cand[c].score < thr) continue;
+		Z id = cand[c].tid;
+		T score = 0;
+		for(uint8_t m = 0; m < qq; m++){
+			score+= this->cdata[attr[m]*this->n + id] * weights[attr[m]];
+			#if LD == 2
+				score/=qq;
+			#endif
+		}
+		if(q.size() < k){
+			q.push(tuple_<T,Z>(id,score));
+		}else if(q.top().score < score){
+			q.pop(); q.push(tuple_<T,Z>(id,score));
 		}
 	}
 	this->tt_processing += this->t.lap();
+	if(STATS_EFF) this->tuple_count=this->n;
 
-	while(_q.size() > k){ _q.pop(); }
-	T threshold = _q.top().score;
-	while(!_q.empty()){
-		this->res.push_back(_q.top());
-		_q.pop();
+	while(q.size() > k){ q.pop(); }
+	T threshold = q.top().score;
+	while(!q.empty()){
+		this->res.push_back(q.top());
+		q.pop();
 	}
 	std::cout << std::fixed << std::setprecision(4);
 	std::cout << " threshold=[" << threshold <<"] (" << this->res.size() << ")" << std::endl;
 	this->threshold = threshold;
 }
 
+/*
+ * Score every row into the key column and select the top-k with radix select (see radix_select.h),
+ * IMP=2 splits the scan and the selection passes over THREADS threads.
+ */
+template<class T, class Z, class S>
+void TPAc<T,Z,S>::findTopKradix(uint64_t k,uint8_t qq, T *weights, uint8_t *attr){
+	std::cout << this->algo << " find top-" << k << " radix (" << (int)qq << "D) ...";
+	if(STATS_EFF) this->tuple_count = 0;
+	if(STATS_EFF) this->pop_count=0;
+	if(this->res.size() > 0) this->res.clear();
+	if(this->rkeys == NULL) this->rkeys = (uint32_t*)malloc(sizeof(uint32_t)*this->n);
+
+	TopKQuery<T> query;
+	query.k = k;
+	query.qq = qq;
+	for(uint8_t m = 0; m < qq; m++) query.attr[m] = attr[m];
+	for(uint8_t m = 0; m < NUM_DIMS; m++) query.weights[m] = weights[m];
+	query.policy = IMP == 2 ? TOPK_PARALLEL : TOPK_SEQUENTIAL;
+	query.threads = THREADS;
+
+	this->res.resize(std::min(k,this->n));
+	this->t.start();
+	this->res.resize(this->query_radix(query,this->rkeys,this->res.data()));
+	this->tt_processing += this->t.lap();
+	if(STATS_EFF) this->tuple_count=this->n;
+
+	T threshold = this->res.empty() ? 0 : this->res.back().score;
+	std::cout << std::fixed << std::setprecision(4);
+	std::cout << " threshold=[" << threshold <<"] (" << this->res.size() << ")" << std::endl;
+	this->threshold = threshold;
+}
+
 #endif
@@ -1,7 +1,8 @@
 #ifndef TPA_R_H
 #define TPA_R_H
 
-#include "AA.h"
+#include "TopK.h"
+#include "radix_select.h"
 
 template<class T, class Z>
 class  TPAr : public AA<T,Z>{
@@ -9,29 +10,119 @@ class  TPAr : public AA<T,Z>{
 		TPAr(uint64_t n, uint64_t d) : AA<T,Z>(n,d){
 			this->algo = "TPAr";
 			this->scores = NULL;
+			this->rkeys = NULL;
 		}
 
 		~TPAr(){
 			if(this->scores!=NULL) free(this->scores);
+			if(this->rkeys!=NULL) free(this->rkeys);
 		}
 
 		void init();
 		void findTopKscalar(uint64_t k,uint8_t qq, T *weights, uint8_t *attr);
 		void findTopKsimd(uint64_t k,uint8_t qq, T *weights, uint8_t *attr);
 		void findTopKthreads(uint64_t k,uint8_t qq, T *weights, uint8_t *attr);
+		void findTopKradix(uint64_t k,uint8_t qq, T *weights, uint8_t *attr);
+		TopKResult<T,Z> query(const TopKQuery<T> &query) const;
+		uint64_t query(const TopKQuery<T> &query, tuple_<T,Z> *out) const;
 
 	private:
 		T *scores;
+		uint32_t *rkeys;//radix select key column of findTopKradix
+		void query_top(const TopKQuery<T> &query, std::vector<tuple_<T,Z>> &top, uint64_t &tuple_count) const;
+		uint64_t query_radix(const TopKQuery<T> &query, uint32_t *keys, tuple_<T,Z> *out) const;
 };
 
 template<class T, class Z>
 void TPAr<T,Z>::init(){
 	this->scores = (T*) malloc(sizeof(T)*this->n);
-	normalize<T,Z>(this->cdata, this->n, this->d);
+	if(!this->normalized) normalize<T,Z>(this->cdata, this->n, this->d);
 	this->t.start();
 	this->tt_init = this->t.lap();
 }
 
+/*
+ * Scan all rows; TOPK_PARALLEL splits them into one contiguous range per thread
+ */
+template<class T, class Z>
+void TPAr<T,Z>::query_top(const TopKQuery<T> &query, std::vector<tuple_<T,Z>> &top, uint64_t &tuple_count) const{
+	if(query.policy == TOPK_PARALLEL){
+		uint32_t threads = std::max((uint32_t)1,query.threads);
+		std::vector<topk_heap<T,Z>> tq(threads);
+		std::vector<std::vector<tuple_<T,Z>>> tt(threads);
+		#pragma omp parallel num_threads(threads)
+		{
+			uint32_t tid = omp_get_thread_num();
+			uint32_t nt = omp_get_num_threads();
+			uint64_t first = ((uint64_t)tid)*this->n/nt;
+			uint64_t last = ((uint64_t)(tid+1))*this->n/nt;
+			for(uint64_t i = first; i < last; i++){
+				const T *tuple = &this->cdata[i*this->d];
+				if(topk_pass<T>(tuple,1,query)) topk_push<T,Z>(tq[tid],query,i,topk_score<T>(tuple,1,query));
+			}
+			topk_sorted<T,Z>(tq[tid],query.k,tt[tid]);
+			topk_tree_merge<T,Z>(tt.data(),tid,nt,query.k);
+		}
+		std::swap(top,tt[0]);
+	}else{
+		topk_heap<T,Z> q;
+		for(uint64_t i = 0; i < this->n; i++){
+			const T *tuple = &this->cdata[i*this->d];
+			if(topk_pass<T>(tuple,1,query)) topk_push<T,Z>(q,query,i,topk_score<T>(tuple,1,query));
+		}
+		topk_sorted<T,Z>(q,query.k,top);
+	}
+	tuple_count = this->n;
+}
+
+/*
+ * Score every row into the key column and select the top-k by radix select (see radix_select.h),
+ * TOPK_PARALLEL splits both into one contiguous range per thread
+ */
+template<class T, class Z>
+uint64_t TPAr<T,Z>::query_radix(const TopKQuery<T> &query, uint32_t *keys, tuple_<T,Z> *out) const{
+	uint32_t threads = query.policy == TOPK_PARALLEL ? std::max((uint32_t)1,query.threads) : 1;
+	#pragma omp parallel num_threads(threads)
+	{
+		for(uint32_t c = omp_get_thread_num(); c < threads; c+=omp_get_num_threads()){
+			radix_score_rows<T>(this->cdata,this->d,radix_first(this->n,threads,c),radix_first(this->n,threads,c+1),query,keys);
+		}
+	}
+	return radix_select_topk<T,Z>(keys,this->n,query.k,threads,out);
+}
+
+/*
+ * Re-entrant top-k query (see TopK.h), results in descending score order. Large k use radix select (see radix_query).
+ */
+template<class T, class Z>
+TopKResult<T,Z> TPAr<T,Z>::query(const TopKQuery<T> &query) const{
+	TopKResult<T,Z> r;
+	if(radix_query<T>(query)){
+		std::vector<uint32_t> keys(this->n);
+		r.tuples.resize(std::min(query.k,this->n));
+		r.tuples.resize(this->query_radix(query,keys.data(),r.tuples.data()));
+		r.threshold = r.tuples.empty() ? 0 : r.tuples.back().score;
+		r.tuple_count = this->n;
+		return r;
+	}
+	this->query_top(query,r.tuples,r.tuple_count);
+	r.threshold = r.tuples.empty() ? 0 : r.tuples.back().score;
+	return r;
+}
+
+template<class T, class Z>
+uint64_t TPAr<T,Z>::query(const TopKQuery<T> &query, tuple_<T,Z> *out) const{
+	if(radix_query<T>(query)){
+		std::vector<uint32_t> keys(this->n);
+		return this->query_radix(query,keys.data(),out);
+	}
+	std::vector<tuple_<T,Z>> top;
+	uint64_t tuple_count = 0;
+	this->query_top(query,top,tuple_count);
+	std::copy(top.begin(),top.end(),out);
+	return top.size();
+}
+
 template<class T, class Z>
 void TPAr<T,Z>::findTopKscalar(uint64_t k,uint8_t qq, T *weights, uint8_t *attr){
 	std::cout << this->algo << " find top-" << k << " scalar (" << (int)qq << "D) ...";
@@ -224,6 +315,7 @@ void TPAr<T,Z>::findTopKthreads(uint64_t k,uint8_t qq, T *weights, uint8_t *attr
 
 	omp_set_num_threads(THREADS);
 	std::priority_queue<T, std::vector<tuple_<T,Z>>, MaxCMP<T,Z>> q[THREADS];
+	std::vector<tuple_<T,Z>> top[THREADS];
 	this->t.start();
 #pragma omp parallel
 {
@@ -322,27 +414,45 @@ void TPAr<T,Z>::findTopKthreads(uint64_t k,uint8_t qq, T *weights, uint8_t *attr
 			if(q[thread_id].top().score < score[15]){ q[thread_id].pop(); q[thread_id].push(tuple_<T,Z>(i+15,score[15])); }
 		}
 	}
+	topk_sorted<T,Z>(q[thread_id],k,top[thread_id]);
+	topk_tree_merge<T,Z>(top,thread_id,THREADS,k);
 }
-	std::priority_queue<T, std::vector<tuple_<T,Z>>, PQComparison<T,Z>> _q;
-	for(uint32_t m = 0; m < THREADS; m++){
-		while(!q[m].empty()){
-			if(_q.size() < k){
-				_q.push(q[m].top());
-			}else if(_q.top().score < q[m].top().score){
-				_q.pop();
-				_q.push(q[m].top());
-			}
-			q[m].pop();
-		}
-	}
 	this->tt_processing += this->t.lap();
 
-	while(_q.size() > k){ _q.pop(); }
-	T threshold = _q.top().score;
-	while(!_q.empty()){
-		this->res.push_back(_q.top());
-		_q.pop();
-	}
+	std::swap(this->res,top[0]);
+	T threshold = this->res.empty() ? 0 : this->res.back().score;
+	std::cout << std::fixed << std::setprecision(4);
+	std::cout << " threshold=[" << threshold <<"] (" << this->res.size() << ")" << std::endl;
+	this->threshold = threshold;
+}
+
+/*
+ * Score every row into the key column and select the top-k with radix select (see radix_select.h),
+ * IMP=2 splits the scan and the selection passes over THREADS threads.
+ */
+template<class T, class Z>
+void TPAr<T,Z>::findTopKradix(uint64_t k,uint8_t qq, T *weights, uint8_t *attr){
+	std::cout << this->algo << " find top-" << k << " radix (" << (int)qq << "D) ...";
+	if(STATS_EFF) this->tuple_count = 0;
+	if(STATS_EFF) this->pop_count=0;
+	if(this->res.size() > 0) this->res.clear();
+	if(this->rkeys == NULL) this->rkeys = (uint32_t*)malloc(sizeof(uint32_t)*this->n);
+
+	TopKQuery<T> query;
+	query.k = k;
+	query.qq = qq;
+	for(uint8_t m = 0; m < qq; m++) query.attr[m] = attr[m];
+	for(uint8_t m = 0; m < NUM_DIMS; m++) query.weights[m] = weights[m];
+	query.policy = IMP == 2 ? TOPK_PARALLEL : TOPK_SEQUENTIAL;
+	query.threads = THREADS;
+
+	this->res.resize(std::min(k,this->n));
+	this->t.start();
+	this->res.resize(this->query_radix(query,this->rkeys,this->res.data()));
+	this->tt_processing += this->t.lap();
+	if(STATS_EFF) this->tuple_count=this->n;
+
+	T threshold = this->res.empty() ? 0 : this->res.back().score;
 	std::cout << std::fixed << std::setprecision(4);
 	std::cout << " threshold=[" << threshold <<"] (" << this->res.size() << ")" << std::endl;
 	this->threshold = threshold;
@@ -0,0 +1,540 @@
+#ifndef TOPK_H
+#define TOPK_H
+
+/*
+ * Query interface shared by the aggregation algorithms.
+ * query() is const, keeps all of its state on the stack and does no I/O, so a single initialized
+ * (or mapped) index can serve concurrent queries. findTopK* remain the benchmarking entry points.
+ * The kernels below take a scoring functor (score.h), the weighted sum unless given.
+ */
+
+#include "AA.h"
+#include "score.h"
+#include <queue>
+#include <atomic>
+
+#define TOPK_SEQUENTIAL 0 //single thread scan
+#define TOPK_PARALLEL 1 //scan split across TopKQuery::threads threads
+
+#define TOPK_MAX 1 //larger attribute values rank higher
+#define TOPK_MIN -1 //smaller attribute values rank higher (price, latency)
+
+template<class T>
+struct TopKQuery{
+	TopKQuery(){
+		k = 0; qq = 0; policy = TOPK_SEQUENTIAL; threads = THREADS; ceiling = std::numeric_limits<T>::max(); fq = 0;
+		for(uint8_t m = 0; m < NUM_DIMS; m++){
+			attr[m] = m; weights[m] = 1;
+			fattr[m] = m; flo[m] = std::numeric_limits<T>::lowest(); fhi[m] = std::numeric_limits<T>::max();
+		}
+	}
+	uint64_t k;
+	uint8_t qq;//number of queried attributes
+	uint8_t attr[NUM_DIMS];//queried attribute ids
+	T weights[NUM_DIMS];//weight of each attribute id (weights[attr[m]])
+	uint8_t policy;//TOPK_SEQUENTIAL or TOPK_PARALLEL
+	uint32_t threads;
+	T ceiling;//only tuples scoring at most ceiling qualify (resume below a cached result, see TopKCache.h)
+
+	uint8_t fq;//number of filtered attributes
+	uint8_t fattr[NUM_DIMS];//filtered attribute ids, any attribute (queried or not)
+	T flo[NUM_DIMS];//only tuples with flo[a] <= value <= fhi[a] on every filtered attribute a qualify
+	T fhi[NUM_DIMS];
+
+	//Weights are signed, minimizing an attribute is the same ranking as a negative weight on it
+	void set_weight(uint8_t a, T w, int8_t dir = TOPK_MAX){ weights[a] = (dir == TOPK_MIN) ? -w : w; }
+
+	//Range predicate on the stored (normalized) values of attribute a, replaces an earlier one on a
+	void set_filter(uint8_t a, T lo, T hi){
+		uint8_t f = 0;
+		while(f < fq && fattr[f] != a) f++;
+		if(f == fq) fattr[fq++] = a;
+		flo[a] = lo; fhi[a] = hi;
+	}
+};
+
+template<class T, class Z>
+struct TopKResult{
+	TopKResult(){ threshold = 0; tuple_count = 0; }
+	std::vector<tuple_<T,Z>> tuples;//descending score
+	T threshold;//k-th score
+	uint64_t tuple_count;//tuples scored
+};
+
+template<class T, class Z>
+using topk_heap = std::priority_queue<tuple_<T,Z>, std::vector<tuple_<T,Z>>, MaxCMP<T,Z>>;
+
+template<class T, class Z>
+static inline void topk_push(topk_heap<T,Z> &q, uint64_t k, Z id, T score){
+	if(q.size() < k){
+		q.push(tuple_<T,Z>(id,score));
+	}else if(q.top().score < score){
+		q.pop(); q.push(tuple_<T,Z>(id,score));
+	}
+}
+
+template<class T, class Z>
+static inline void topk_push(topk_heap<T,Z> &q, const TopKQuery<T> &query, Z id, T score){
+	if(score <= query.ceiling) topk_push<T,Z>(q,query.k,id,score);
+}
+
+/*
+ * k-th score shared by the threads of a parallel scan. A thread publishes the k-th score of its own heap once it
+ * holds k tuples; those tuples never leave the heap, so the largest published score bounds the global k-th score
+ * from below and every thread may prune against it (insert filter and block stop test).
+ */
+template<class T>
+struct TopKShared{
+	TopKShared(){ kth.store(std::numeric_limits<T>::lowest()); }
+	std::atomic<T> kth;
+
+	inline T load() const{ return this->kth.load(std::memory_order_relaxed); }
+	inline bool valid(T v) const{ return v != std::numeric_limits<T>::lowest(); }
+
+	//Lock-free maximum
+	inline void publish(T v){
+		T cur = this->load();
+		while(cur < v && !this->kth.compare_exchange_weak(cur,v,std::memory_order_relaxed));
+	}
+};
+
+#ifndef TOPK_SYNC
+	#define TOPK_SYNC 4096 //rows between refreshes of the shared k-th score in full scans
+#endif
+
+/*
+ * Candidate buffer in front of a top-k heap (topk_heap or the PQComparison heaps of findTopK*). push16 compares
+ * 16 scores with the k-th score of the heap in one AVX compare and appends only the lanes above it, the heap
+ * is updated in batches when the buffer fills (flush). kth is refreshed on every flush and only rises, so a
+ * stale kth lets extra candidates into the buffer but never drops a top-k tuple. Flush before reading the heap.
+ * With a TopKShared bound every flush publishes the local k-th score and prunes against the larger of both.
+ */
+#ifndef TOPK_CBUF
+	#define TOPK_CBUF 256 //candidate buffer capacity in tuples (multiple of 16)
+#endif
+
+template<class T, class Z, class Q = topk_heap<T,Z>>
+class TopKCandidates{
+	public:
+		TopKCandidates(Q &q, uint64_t k, T ceiling = std::numeric_limits<T>::max(), TopKShared<T> *shared = NULL) : q(q){
+			this->k = k;
+			this->size = 0;
+			this->ceiling = _mm256_set1_ps(ceiling);
+			this->shared = shared;
+			this->refresh();
+		}
+
+		//Lanes of score[0..15] set in mask, above the k-th score and at most the ceiling, become candidates id + lane
+		inline void push16(const T *score, uint32_t mask, uint64_t id){
+			mask = this->survivors(score,mask);
+			while(mask){
+				uint32_t l = __builtin_ctz(mask);
+				this->buffer[this->size++] = tuple_<T,Z>(id + l,score[l]);
+				mask&=mask - 1;
+			}
+			if(this->size + 16 > TOPK_CBUF) this->flush();
+		}
+
+		//As above, candidate lane l takes the id ids[l]
+		inline void push16(const T *score, uint32_t mask, const Z *ids){
+			mask = this->survivors(score,mask);
+			while(mask){
+				uint32_t l = __builtin_ctz(mask);
+				this->buffer[this->size++] = tuple_<T,Z>(ids[l],score[l]);
+				mask&=mask - 1;
+			}
+			if(this->size + 16 > TOPK_CBUF) this->flush();
+		}
+
+		inline void flush(){
+			for(uint32_t i = 0; i < this->size; i++){
+				if(this->q.size() < this->k){
+					this->q.push(this->buffer[i]);
+				}else if(this->q.top().score < this->buffer[i].score){
+					this->q.pop(); this->q.push(this->buffer[i]);
+				}
+			}
+			this->size = 0;
+			this->refresh();
+		}
+
+		//k tuples score at least threshold as of the last flush, the tuples it bounds cannot enter the top-k
+		inline bool covers(T threshold) const{ return this->full && this->bound >= threshold; }
+
+	private:
+		Q &q;
+		uint64_t k;
+		uint32_t size;
+		bool full;//k tuples score at least bound (own heap or the shared k-th score)
+		T bound;
+		__m256 kth;
+		__m256 ceiling;
+		TopKShared<T> *shared;
+		tuple_<T,Z> buffer[TOPK_CBUF];
+
+		inline void refresh(){
+			this->full = this->q.size() >= this->k;
+			this->bound = this->q.empty() ? std::numeric_limits<T>::max() : this->q.top().score;
+			if(this->shared != NULL){
+				if(this->full) this->shared->publish(this->bound);
+				T g = this->shared->load();
+				if(this->shared->valid(g) && (!this->full || g > this->bound)){ this->bound = g; this->full = true; }
+			}
+			this->kth = _mm256_set1_ps(this->bound);
+		}
+
+		//Lanes of mask at most the ceiling and, once full, above the k-th score
+		inline uint32_t survivors(const T *score, uint32_t mask) const{
+			__m256 score00 = _mm256_loadu_ps(&score[0]);
+			__m256 score01 = _mm256_loadu_ps(&score[8]);
+			mask&=_mm256_movemask_ps(_mm256_cmp_ps(score00,this->ceiling,_CMP_LE_OQ)) | (_mm256_movemask_ps(_mm256_cmp_ps(score01,this->ceiling,_CMP_LE_OQ)) << 8);
+			if(this->full){
+				mask&=_mm256_movemask_ps(_mm256_cmp_ps(score00,this->kth,_CMP_GT_OQ)) | (_mm256_movemask_ps(_mm256_cmp_ps(score01,this->kth,_CMP_GT_OQ)) << 8);
+			}
+			return mask;
+		}
+};
+
+template<class T, class Z, class Q>
+static inline TopKCandidates<T,Z,Q> topk_candidates(Q &q, uint64_t k, TopKShared<T> *shared = NULL){ return TopKCandidates<T,Z,Q>(q,k,std::numeric_limits<T>::max(),shared); }
+
+//Valid lanes of the 16 tuples at position t of a block holding tuple_num tuples
+static inline uint32_t topk_lanes(uint64_t tuple_num, uint64_t t){
+	if(t >= tuple_num) return 0;
+	return tuple_num - t < 16 ? (1 << (tuple_num - t)) - 1 : 0xFFFF;
+}
+
+/*
+ * Upper bound of the scores of the tuples following a block. tarray bounds their attributes from above and
+ * tmin from below, so negative weights take the lower bound of their attribute.
+ */
+template<class T, class BLOCK>
+static inline T topk_bound(const BLOCK &block, uint8_t qq, const T *weights, const uint8_t *attr){
+	T threshold = 0;
+	for(uint8_t m = 0; m < qq; m++){
+		T w = weights[attr[m]];
+		threshold+=(w < 0 ? block.tmin[attr[m]] : block.tarray[attr[m]])*w;
+	}
+	return threshold;
+}
+
+/*
+ * Same bound for the tuples passing the filters of a query, whose filtered attributes also lie in [flo,fhi]:
+ * the score function evaluated at the upper (or, where it decreases, lower) bound of every attribute
+ */
+template<class T, class BLOCK, class S = TopKSum<T>>
+static inline T topk_bound(const BLOCK &block, const TopKQuery<T> &query, const S &fn = S()){
+	T threshold = fn.init();
+	for(uint8_t m = 0; m < query.qq; m++){
+		uint8_t a = query.attr[m];
+		T w = query.weights[a];
+		T x = fn.increasing(a,w) ? std::min(block.tarray[a],query.fhi[a]) : std::max(block.tmin[a],query.flo[a]);
+		threshold = fn.combine(threshold,fn.term(a,x,w));
+		#if LD == 2
+			threshold/=query.qq;
+		#endif
+	}
+	return threshold;
+}
+
+/*
+ * Fill the zone map (zmin/zmax, attribute range of the block itself) and tmin (attribute minimums of the block
+ * and all blocks after it) of every block of a partition (tuples[m*B + t]). tmin is non-decreasing along the
+ * partition, so block bounds stay non-increasing for any signs.
+ */
+template<class T, uint64_t B, class BLOCK>
+static inline void topk_block_bounds(BLOCK *blocks, uint64_t block_num, uint64_t d){
+	T vmin[NUM_DIMS];
+	for(uint8_t m = 0; m < NUM_DIMS; m++) vmin[m] = std::numeric_limits<T>::max();
+	for(uint64_t b = block_num; b > 0; b--){
+		BLOCK &block = blocks[b-1];
+		for(uint8_t m = 0; m < NUM_DIMS; m++){ block.zmin[m] = 0; block.zmax[m] = 0; block.tmin[m] = 0; }
+		for(uint8_t m = 0; m < d; m++){
+			T zmin = std::numeric_limits<T>::max();
+			T zmax = std::numeric_limits<T>::lowest();
+			for(uint64_t t = 0; t < block.tuple_num; t++){
+				zmin = std::min(zmin,block.tuples[m*B + t]);
+				zmax = std::max(zmax,block.tuples[m*B + t]);
+			}
+			vmin[m] = std::min(vmin[m],zmin);
+			block.zmin[m] = zmin; block.zmax[m] = zmax; block.tmin[m] = vmin[m];
+		}
+	}
+}
+
+/*
+ * False when the zone map of a block rules out every tuple for the filters of a query
+ */
+template<class T, class BLOCK>
+static inline bool topk_zone(const BLOCK &block, const TopKQuery<T> &query){
+	for(uint8_t f = 0; f < query.fq; f++){
+		uint8_t a = query.fattr[f];
+		if(block.zmax[a] < query.flo[a] || block.zmin[a] > query.fhi[a]) return false;
+	}
+	return true;
+}
+
+/*
+ * Filters of a query on one tuple (attribute a at tuples[a*stride])
+ */
+template<class T>
+static inline bool topk_pass(const T *tuples, uint64_t stride, const TopKQuery<T> &query){
+	for(uint8_t f = 0; f < query.fq; f++){
+		uint8_t a = query.fattr[f];
+		T v = tuples[a*stride];
+		if(v < query.flo[a] || v > query.fhi[a]) return false;
+	}
+	return true;
+}
+
+/*
+ * Filters of a query on 8 consecutive tuples of a column-major table, bit l set when tuple l passes
+ */
+template<class T>
+static inline uint32_t topk_filter8(const T *tuples, uint64_t stride, const TopKQuery<T> &query){
+	__m256 pass = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+	for(uint8_t f = 0; f < query.fq; f++){
+		uint8_t a = query.fattr[f];
+		__m256 v = _mm256_loadu_ps(&tuples[a*stride]);
+		pass = _mm256_and_ps(pass,_mm256_cmp_ps(v,_mm256_set1_ps(query.flo[a]),_CMP_GE_OQ));
+		pass = _mm256_and_ps(pass,_mm256_cmp_ps(v,_mm256_set1_ps(query.fhi[a]),_CMP_LE_OQ));
+	}
+	return _mm256_movemask_ps(pass);
+}
+
+template<class T>
+static inline uint32_t topk_filter16(const T *tuples, uint64_t stride, const TopKQuery<T> &query){
+	if(query.fq == 0) return 0xFFFF;
+	return topk_filter8<T>(&tuples[0],stride,query) | (topk_filter8<T>(&tuples[8],stride,query) << 8);
+}
+
+/*
+ * Scores of 16 consecutive tuples of a column-major table (attribute m at tuples[m*stride])
+ */
+template<class T, class S = TopKSum<T>>
+static inline void topk_score16(const T *tuples, uint64_t stride, const TopKQuery<T> &query, T *score, const S &fn = S()){
+	__m256 score00 = fn.init_ps();
+	__m256 score01 = fn.init_ps();
+	for(uint8_t m = 0; m < query.qq; m++){
+		uint8_t a = query.attr[m];
+		const T *column = &tuples[a*stride];
+		__m256 _weight = _mm256_set1_ps(query.weights[a]);
+		score00 = fn.combine_ps(score00,fn.term_ps(a,_mm256_loadu_ps(&column[0]),_weight));
+		score01 = fn.combine_ps(score01,fn.term_ps(a,_mm256_loadu_ps(&column[8]),_weight));
+		#if LD == 2
+			score00 = _mm256_div_ps(score00,_mm256_set1_ps(query.qq));
+			score01 = _mm256_div_ps(score01,_mm256_set1_ps(query.qq));
+		#endif
+	}
+	_mm256_storeu_ps(&score[0],score00);
+	_mm256_storeu_ps(&score[8],score01);
+}
+
+template<class T, class S = TopKSum<T>>
+static inline T topk_score(const T *tuples, uint64_t stride, const TopKQuery<T> &query, const S &fn = S()){
+	T score = fn.init();
+	for(uint8_t m = 0; m < query.qq; m++){
+		uint8_t a = query.attr[m];
+		score = fn.combine(score,fn.term(a,tuples[a*stride],query.weights[a]));
+		#if LD == 2
+			score/=query.qq;
+		#endif
+	}
+	return score;
+}
+
+/*
+ * Rows [first,last) of a column-major table with n rows
+ */
+template<class T, class Z, class S = TopKSum<T>>
+static inline void topk_scan_columns(const T *cdata, uint64_t n, uint64_t first, uint64_t last, const TopKQuery<T> &query, topk_heap<T,Z> &q, const S &fn = S(), TopKShared<T> *shared = NULL){
+	T score[16];
+	TopKCandidates<T,Z> c(q,query.k,query.ceiling,shared);
+	uint64_t i = first;
+	for(; i + 16 <= last; i+=16){
+		topk_score16<T,S>(&cdata[i],n,query,score,fn);
+		c.push16(score,topk_filter16<T>(&cdata[i],n,query),i);
+		if(shared != NULL && ((i - first) % TOPK_SYNC) == 0) c.flush();
+	}
+	c.flush();
+	for(; i < last; i++) if(topk_pass<T>(&cdata[i],n,query)) topk_push<T,Z>(q,query,i,topk_score<T,S>(&cdata[i],n,query,fn));
+}
+
+/*
+ * Blocks of one partition (tuples[m*B + t]); topk_bound bounds the scores of all following blocks,
+ * so the scan stops once the k-th score reaches it. Blocks outside the filters (zone maps) are skipped. Tuple ids are the
+ * input row ids kept in each block (tids), so every executor returns the same ids for the same rows.
+ */
+template<class T, class Z, uint64_t B, class BLOCK, class S = TopKSum<T>>
+static inline void topk_scan_blocks(const BLOCK *blocks, uint64_t block_num, const TopKQuery<T> &query, topk_heap<T,Z> &q, uint64_t &tuple_count, const S &fn = S(), TopKShared<T> *shared = NULL){
+	T score[16];
+	TopKCandidates<T,Z> c(q,query.k,query.ceiling,shared);
+	for(uint64_t b = 0; b < block_num; b++){
+		const T *tuples = blocks[b].tuples;
+		uint64_t tuple_num = blocks[b].tuple_num;
+		if(topk_zone<T>(blocks[b],query)){
+			for(uint64_t t = 0; t < tuple_num; t+=16){
+				topk_score16<T,S>(&tuples[t],B,query,score,fn);
+				c.push16(score,topk_filter16<T>(&tuples[t],B,query) & topk_lanes(tuple_num,t),&blocks[b].tids[t]);
+			}
+			c.flush();
+			tuple_count+=tuple_num;
+		}
+
+		T threshold = topk_bound<T,BLOCK,S>(blocks[b],query,fn);
+		if(c.covers(threshold)) break;
+	}
+}
+
+/*
+ * Tuples topk_scan_blocks visits when the k-th score is kth. The block bounds are non-increasing,
+ * so the first block whose bound drops to kth (the last one scanned) is found by binary search.
+ */
+template<class T, class BLOCK, class S = TopKSum<T>>
+static inline uint64_t topk_estimate_blocks(const BLOCK *blocks, uint64_t block_num, const TopKQuery<T> &query, T kth, const S &fn = S()){
+	uint64_t lo = 0;
+	uint64_t hi = block_num;
+	while(lo < hi){
+		uint64_t mid = (lo + hi)/2;
+		T threshold = topk_bound<T,BLOCK,S>(blocks[mid],query,fn);
+		if(threshold <= kth) hi = mid; else lo = mid + 1;
+	}
+	uint64_t last = std::min(lo + 1, block_num);
+	uint64_t count = 0;
+	for(uint64_t b = 0; b < last; b++) count+=blocks[b].tuple_num;
+	return count;
+}
+
+template<class T, class Z>
+struct TopKCursorCMP{
+	bool operator() (const tuple_<T,Z>& lhs, const tuple_<T,Z>& rhs) const{
+		return (lhs.score<rhs.score);
+	}
+};
+
+/*
+ * Position of a paged scan over partitioned blocks: the next block of every partition, the bound of the
+ * remaining blocks of each partition (tid = partition) and every scanned tuple not returned yet.
+ * Candidates are kept unbounded because later pages may need tuples a top-k heap would have evicted.
+ */
+template<class T, class Z>
+struct TopKCursor{
+	TopKCursor(){ active = 0; emitted = 0; tuple_count = 0; }
+	TopKQuery<T> query;//k is ignored, every call to next() asks for a page
+	std::vector<uint64_t> pos;
+	std::priority_queue<tuple_<T,Z>, std::vector<tuple_<T,Z>>, TopKCursorCMP<T,Z>> bounds;
+	std::priority_queue<tuple_<T,Z>, std::vector<tuple_<T,Z>>, TopKCursorCMP<T,Z>> candidates;
+	uint64_t active;//partitions added to bounds so far
+	uint64_t emitted;//tuples returned so far
+	uint64_t tuple_count;//tuples scanned so far
+};
+
+/*
+ * Write the next count tuples of the cursor into out (descending score), return the number written.
+ * Partitions [0,part_num) take part; the block with the highest bound is scanned until the best candidate
+ * reaches the bound of every unscanned block, so each page scans only the blocks it needs.
+ */
+template<class T, class Z, uint64_t B, class PART, class S = TopKSum<T>>
+static inline uint64_t topk_cursor_next(const PART *parts, uint64_t part_num, TopKCursor<T,Z> &c, uint64_t count, tuple_<T,Z> *out, const S &fn = S()){
+	const TopKQuery<T> &query = c.query;
+	if(c.pos.size() < part_num) c.pos.resize(part_num,0);
+	for(; c.active < part_num; c.active++){
+		if(parts[c.active].size > 0) c.bounds.push(tuple_<T,Z>(c.active,std::numeric_limits<T>::max()));
+	}
+
+	T score[16];
+	uint64_t written = 0;
+	while(written < count){
+		T bound = c.bounds.empty() ? std::numeric_limits<T>::lowest() : c.bounds.top().score;
+		if(!c.candidates.empty() && c.candidates.top().score >= bound){
+			out[written++] = c.candidates.top();
+			c.candidates.pop();
+			continue;
+		}
+		if(c.bounds.empty()) break;
+
+		uint64_t i = c.bounds.top().tid;
+		c.bounds.pop();
+		const PART &part = parts[i];
+		uint64_t b = c.pos[i]++;
+		const T *tuples = part.blocks[b].tuples;
+		uint64_t tuple_num = part.blocks[b].tuple_num;
+		const Z *tids = part.blocks[b].tids;
+		if(topk_zone<T>(part.blocks[b],query)){
+			for(uint64_t t = 0; t < tuple_num; t+=16){
+				topk_score16<T,S>(&tuples[t],B,query,score,fn);
+				uint32_t pass = topk_filter16<T>(&tuples[t],B,query);
+				uint64_t lanes = std::min((uint64_t)16, tuple_num - t);
+				for(uint8_t l = 0; l < lanes; l++){
+					if((pass & (1 << l)) && score[l] <= query.ceiling) c.candidates.push(tuple_<T,Z>(tids[t + l],score[l]));
+				}
+			}
+			c.tuple_count+=tuple_num;
+		}
+
+		if(c.pos[i] < part.block_num){
+			c.bounds.push(tuple_<T,Z>(i,topk_bound<T>(part.blocks[b],query,fn)));
+		}
+	}
+	c.emitted+=written;
+	return written;
+}
+
+/*
+ * Drain the heap into top in descending score order, truncated to k
+ */
+template<class T, class Z, class Q>
+static inline void topk_sorted(Q &q, uint64_t k, std::vector<tuple_<T,Z>> &top){
+	while(q.size() > k){ q.pop(); }
+	top.resize(q.size());
+	for(uint64_t i = q.size(); i > 0; i--){ top[i-1] = q.top(); q.pop(); }
+}
+
+/*
+ * Merge two descending arrays into out, truncated to k
+ */
+template<class T, class Z>
+static inline void topk_merge_sorted(const std::vector<tuple_<T,Z>> &a, const std::vector<tuple_<T,Z>> &b, uint64_t k, std::vector<tuple_<T,Z>> &out){
+	out.resize(std::min(k,(uint64_t)(a.size() + b.size())));
+	uint64_t i = 0, j = 0;
+	for(uint64_t m = 0; m < out.size(); m++){
+		out[m] = (j == b.size() || (i < a.size() && a[i].score >= b[j].score)) ? a[i++] : b[j++];
+	}
+}
+
+/*
+ * Pairwise tree reduction of the per thread sorted arrays into top[0], in log2(threads) rounds of merge and truncate to k.
+ * Called by every thread of the parallel region (it contains barriers); round r merges top[tid + 2^r] into top[tid]
+ * for tid a multiple of 2^(r+1), so the merges of a round run concurrently.
+ */
+template<class T, class Z>
+static inline void topk_tree_merge(std::vector<tuple_<T,Z>> *top, uint32_t tid, uint32_t threads, uint64_t k){
+	std::vector<tuple_<T,Z>> merged;
+	for(uint32_t step = 1; step < threads; step<<=1){
+		#pragma omp barrier
+		if(tid % (2*step) == 0 && tid + step < threads){
+			topk_merge_sorted<T,Z>(top[tid],top[tid + step],k,merged);
+			std::swap(top[tid],merged);
+		}
+	}
+	#pragma omp barrier
+}
+
+template<class T, class Z>
+static inline void topk_result(topk_heap<T,Z> &q, uint64_t k, TopKResult<T,Z> &r){
+	topk_sorted<T,Z>(q,k,r.tuples);
+	r.threshold = r.tuples.empty() ? 0 : r.tuples.back().score;
+}
+
+/*
+ * Write the top-k into out (capacity k) in descending score order, return the number of tuples written
+ */
+template<class T, class Z>
+static inline uint64_t topk_copy(topk_heap<T,Z> &q, uint64_t k, tuple_<T,Z> *out){
+	while(q.size() > k){ q.pop(); }
+	uint64_t size = q.size();
+	for(uint64_t i = size; i > 0; i--){ out[i-1] = q.top(); q.pop(); }
+	return size;
+}
+
+#endif
@@ -0,0 +1,253 @@
+#ifndef TOPK_CACHE_H
+#define TOPK_CACHE_H
+
+/*
+ * Result cache in front of any engine with query(const TopKQuery<T>&) (the AA subclasses or Planner).
+ * Entries are keyed by the canonical (attribute set, weights, filters) of a query: unless LD == 2 (the score
+ * depends on the attribute order there), attributes sorted by id and zero weight attributes dropped, so a query
+ * and the same query over a subset of its attributes with the rest weighted 0 share one entry. A cached top-k
+ * answers any k' <= k from its prefix. A larger k' keeps the tuples scoring above the cached threshold and
+ * resumes the engine below it (TopKQuery::ceiling) for the rest. Entries are evicted in LRU order once more than capacity tuples are stored; invalidate()
+ * drops everything when the table changes.
+ */
+
+#include "TopK.h"
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+#ifndef TCACHE_TUPLES
+	#define TCACHE_TUPLES (1 << 20) //default capacity in cached tuples
+#endif
+#define TCACHE_SLACK 1e-5 //relative slack of the resume ceiling, recomputed scores may differ in the last bits
+
+template<class T>
+struct TopKCacheKey{
+	TopKCacheKey(){
+		qq = 0; fq = 0;
+		for(uint8_t m = 0; m < NUM_DIMS; m++){ attr[m] = 0; weights[m] = 0; fattr[m] = 0; flo[m] = 0; fhi[m] = 0; }
+	}
+	uint8_t qq;
+	uint8_t attr[NUM_DIMS];//ascending attribute ids (query order when LD == 2)
+	T weights[NUM_DIMS];//weights[m] of attr[m]
+	uint8_t fq;
+	uint8_t fattr[NUM_DIMS];//ascending filtered attribute ids
+	T flo[NUM_DIMS];//range of fattr[m]
+	T fhi[NUM_DIMS];
+
+	bool operator==(const TopKCacheKey<T> &b) const{
+		if(this->qq != b.qq || this->fq != b.fq) return false;
+		for(uint8_t m = 0; m < this->qq; m++){
+			if(this->attr[m] != b.attr[m] || this->weights[m] != b.weights[m]) return false;
+		}
+		for(uint8_t m = 0; m < this->fq; m++){
+			if(this->fattr[m] != b.fattr[m] || this->flo[m] != b.flo[m] || this->fhi[m] != b.fhi[m]) return false;
+		}
+		return true;
+	}
+};
+
+template<class T>
+struct TopKCacheHash{
+	size_t operator()(const TopKCacheKey<T> &key) const{
+		uint64_t h = 14695981039346656037ULL;//FNV-1a
+		const uint8_t *bytes = reinterpret_cast<const uint8_t*>(key.weights);
+		for(uint8_t m = 0; m < key.qq; m++){
+			h = (h ^ key.attr[m]) * 1099511628211ULL;
+			for(uint8_t b = 0; b < sizeof(T); b++) h = (h ^ bytes[m*sizeof(T) + b]) * 1099511628211ULL;
+		}
+		const uint8_t *lo = reinterpret_cast<const uint8_t*>(key.flo);
+		const uint8_t *hi = reinterpret_cast<const uint8_t*>(key.fhi);
+		for(uint8_t m = 0; m < key.fq; m++){
+			h = (h ^ (key.fattr[m] | 0x100)) * 1099511628211ULL;
+			for(uint8_t b = 0; b < sizeof(T); b++) h = (h ^ lo[m*sizeof(T) + b]) * 1099511628211ULL;
+			for(uint8_t b = 0; b < sizeof(T); b++) h = (h ^ hi[m*sizeof(T) + b]) * 1099511628211ULL;
+		}
+		return h;
+	}
+};
+
+template<class T>
+static TopKCacheKey<T> topk_cache_key(const TopKQuery<T> &query){
+	TopKCacheKey<T> key;
+	uint8_t attr[NUM_DIMS];
+	for(uint8_t m = 0; m < query.qq; m++) attr[m] = query.attr[m];
+	#if LD != 2
+		std::sort(attr,attr + query.qq);//LD == 2 divides by qq after every attribute, the score depends on their order
+	#endif
+	for(uint8_t m = 0; m < query.qq; m++){
+		T w = query.weights[attr[m]];
+		#if LD != 2
+			if(w == 0) continue;
+		#endif
+		key.attr[key.qq] = attr[m];
+		key.weights[key.qq] = w == 0 ? 0 : w;//-0 and 0 hash alike
+		key.qq++;
+	}
+	uint8_t fattr[NUM_DIMS];
+	for(uint8_t m = 0; m < query.fq; m++) fattr[m] = query.fattr[m];
+	std::sort(fattr,fattr + query.fq);
+	for(uint8_t m = 0; m < query.fq; m++){
+		key.fattr[m] = fattr[m];
+		key.flo[m] = query.flo[fattr[m]];
+		key.fhi[m] = query.fhi[fattr[m]];
+	}
+	key.fq = query.fq;
+	return key;
+}
+
+template<class T, class Z>
+class TopKCache{
+	public:
+		TopKCache(uint64_t capacity = TCACHE_TUPLES){
+			this->capacity = capacity;
+			this->tuples = 0;
+			this->gen = 0;
+			this->hits = 0;
+			this->resumes = 0;
+			this->misses = 0;
+		}
+
+		template<class E>
+		TopKResult<T,Z> query(E &engine, const TopKQuery<T> &query);
+		void invalidate();
+		uint64_t generation(){ std::lock_guard<std::mutex> guard(this->lock); return this->gen; }
+
+		void benchmark();
+		void reset_stats(){ this->hits = 0; this->resumes = 0; this->misses = 0; }
+
+	private:
+		struct entry{
+			uint64_t k;//k of the query that produced tuples (tuples.size() < k means the table has fewer tuples)
+			std::vector<tuple_<T,Z>> tuples;
+			typename std::list<TopKCacheKey<T>>::iterator lru;
+		};
+
+		std::unordered_map<TopKCacheKey<T>,entry,TopKCacheHash<T>> entries;
+		std::list<TopKCacheKey<T>> lru;//most recently used first
+		uint64_t capacity;
+		uint64_t tuples;
+		uint64_t gen;
+		uint64_t hits;
+		uint64_t resumes;
+		uint64_t misses;
+		std::mutex lock;
+
+		void insert(const TopKCacheKey<T> &key, uint64_t k, std::vector<tuple_<T,Z>> &tuples, uint64_t gen);
+};
+
+/*
+ * Answer from the cache when possible, otherwise run (or resume) the query on engine and cache the result
+ */
+template<class T, class Z>
+template<class E>
+TopKResult<T,Z> TopKCache<T,Z>::query(E &engine, const TopKQuery<T> &query){
+	if(query.k == 0 || query.ceiling != std::numeric_limits<T>::max()) return engine.query(query);
+	TopKCacheKey<T> key = topk_cache_key<T>(query);
+	TopKResult<T,Z> r;
+	std::vector<tuple_<T,Z>> prefix;
+	bool resume = false;
+	T ceiling = 0;
+	uint64_t gen;
+	{
+		std::lock_guard<std::mutex> guard(this->lock);
+		gen = this->gen;
+		auto it = this->entries.find(key);
+		if(it != this->entries.end()){
+			entry &e = it->second;
+			this->lru.splice(this->lru.begin(),this->lru,e.lru);
+			if(query.k <= e.k || e.tuples.size() < e.k){//prefix of the cached result
+				uint64_t size = std::min(query.k,(uint64_t)e.tuples.size());
+				r.tuples.assign(e.tuples.begin(),e.tuples.begin() + size);
+				r.threshold = size > 0 ? r.tuples.back().score : 0;
+				this->hits++;
+				return r;
+			}
+			//Every tuple scoring above the cached threshold is cached, ties with it are searched for again
+			ceiling = e.tuples.back().score;
+			uint64_t p = 0;
+			while(p < e.tuples.size() && e.tuples[p].score > ceiling) p++;
+			prefix.assign(e.tuples.begin(),e.tuples.begin() + p);
+			resume = true;
+			this->resumes++;
+		}else{
+			this->misses++;
+		}
+	}
+
+	if(!resume){
+		r = engine.query(query);
+	}else{
+		//Prefix tuples within the slack of the ceiling are found again, drop them by id
+		ceiling+=(std::abs(ceiling) + 1) * TCACHE_SLACK;
+		std::unordered_set<Z> seen;
+		for(uint64_t i = 0; i < prefix.size(); i++) if(prefix[i].score <= ceiling) seen.insert(prefix[i].tid);
+		TopKQuery<T> rq = query;
+		rq.k = query.k - prefix.size() + seen.size();
+		rq.ceiling = ceiling;
+		r = engine.query(rq);
+		for(uint64_t i = 0; i < r.tuples.size() && prefix.size() < query.k; i++){
+			if(seen.find(r.tuples[i].tid) == seen.end()) prefix.push_back(r.tuples[i]);
+		}
+		std::stable_sort(prefix.begin(),prefix.end(),cmp_score<T,Z>);
+		r.tuples.swap(prefix);
+		r.threshold = r.tuples.empty() ? 0 : r.tuples.back().score;
+	}
+
+	std::vector<tuple_<T,Z>> copy = r.tuples;
+	this->insert(key,query.k,copy,gen);
+	return r;
+}
+
+/*
+ * Store (or replace) an entry unless the cache was invalidated since gen, then evict least recently used
+ * entries until at most capacity tuples remain
+ */
+template<class T, class Z>
+void TopKCache<T,Z>::insert(const TopKCacheKey<T> &key, uint64_t k, std::vector<tuple_<T,Z>> &tuples, uint64_t gen){
+	std::lock_guard<std::mutex> guard(this->lock);
+	if(gen != this->gen || tuples.size() > this->capacity) return;
+	auto it = this->entries.find(key);
+	if(it != this->entries.end()){
+		if(it->second.k >= k) return;//a concurrent query cached a larger k
+		this->tuples-=it->second.tuples.size();
+		this->lru.erase(it->second.lru);
+		this->entries.erase(it);
+	}
+	this->lru.push_front(key);
+	entry &e = this->entries[key];
+	e.k = k;
+	e.tuples.swap(tuples);
+	e.lru = this->lru.begin();
+	this->tuples+=e.tuples.size();
+
+	while(this->tuples > this->capacity){
+		auto last = this->entries.find(this->lru.back());
+		this->tuples-=last->second.tuples.size();
+		this->entries.erase(last);
+		this->lru.pop_back();
+	}
+}
+
+/*
+ * Drop all entries (call after the table or index behind the engine is reloaded); queries still running
+ * against the old data do not insert their results
+ */
+template<class T, class Z>
+void TopKCache<T,Z>::invalidate(){
+	std::lock_guard<std::mutex> guard(this->lock);
+	this->entries.clear();
+	this->lru.clear();
+	this->tuples = 0;
+	this->gen++;
+}
+
+template<class T, class Z>
+void TopKCache<T,Z>::benchmark(){
+	std::cout << "< Benchmark for TopK cache >" << std::endl;
+	std::cout << "hits: " << this->hits << " resumes: " << this->resumes << " misses: " << this->misses;
+	std::cout << " entries: " << this->entries.size() << " cached tuples: " << this->tuples << std::endl;
+}
+
+#endif
@@ -5,7 +5,10 @@
 * Vectorized Threshold Aggregation
 */
 
-#include "AA.h"
+#include "TopK.h"
+#include "../input/File.h"
+#include "index_io.h"
+#include "quant.h"
 
 #define VBLOCK_SIZE 1024
 #define VSPLITS 2
@@ -30,7 +33,11 @@ struct vta_block{
 	Z offset;
 	Z tuple_num;
 	T tarray[NUM_DIMS] __attribute__((aligned(32)));
+	T tmin[NUM_DIMS] __attribute__((aligned(32)));//attribute minimums of this and the following blocks
+	T zmin[NUM_DIMS];//zone map, attribute range of this block
+	T zmax[NUM_DIMS];
 	T tuples[VBLOCK_SIZE * NUM_DIMS] __attribute__((aligned(32)));
+	Z tids[VBLOCK_SIZE];//input row id of every tuple
 };
 
 template<class T, class Z>
@@ -48,33 +55,56 @@ static bool cmp_vta_pos(const vta_pos<Z> &a, const vta_pos<Z> &b){ return a.pos
 template<class T,class Z>
 static bool cmp_vta_pair(const vta_pair<T,Z> &a, const vta_pair<T,Z> &b){ return a.score > b.score; };
 
-template<class T,class Z>
+template<class T, class Z, class S = TopKSum<T>>
 class VTA : public AA<T,Z>{
 	public:
 		VTA(uint64_t n,uint64_t d) : AA<T,Z>(n,d)
 		{
 			this->algo = "VTA";
+			this->index_map = NULL;
+			this->index_bytes = 0;
+			for(uint64_t i = 0; i < VPARTITIONS; i++) this->qparts[i] = NULL;
 		}
 
 		~VTA(){
-
+			if(this->index_map!=NULL) munmap(this->index_map,this->index_bytes);
+			for(uint64_t i = 0; i < VPARTITIONS; i++) if(this->qparts[i]!=NULL) free(this->qparts[i]);
 		}
 		void init();
+		void init_stream(File<T> *f);
+		void save_index(std::string fname);
+		void load_index(std::string fname);
 		void findTopKscalar(uint64_t k,uint8_t qq, T *weights, uint8_t *attr);
 		void findTopKsimd(uint64_t k,uint8_t qq, T *weights, uint8_t *attr);
 		void findTopKthreads(uint64_t k,uint8_t qq, T *weights, uint8_t *attr);
 		void findTopKthreads2(uint64_t k,uint8_t qq, T *weights, uint8_t *attr);
 		void findTopKsimdMQ(uint64_t k,uint8_t qq, T *weights, uint8_t *attr, uint32_t tid);
+		void findTopKquant(uint64_t k,uint8_t qq, T *weights, uint8_t *attr);
+		void set_scoring(const S &fn){ this->fn = fn; }//scoring function of query(), see score.h
+		TopKResult<T,Z> query(const TopKQuery<T> &query) const;
+		uint64_t query(const TopKQuery<T> &query, tuple_<T,Z> *out) const;
+		uint64_t estimate(const TopKQuery<T> &query, T kth) const;
+		TopKCursor<T,Z> cursor(const TopKQuery<T> &query) const;
+		uint64_t next(TopKCursor<T,Z> &cursor, uint64_t count, tuple_<T,Z> *out) const;
 
 	private:
+		S fn;
 		vta_partition<T,Z> parts[VPARTITIONS];
+		char *index_map;
+		uint64_t index_bytes;
+
+		qtype *qparts[VPARTITIONS];//quantized tuples, same layout as the partition blocks
+		T qmin[NUM_DIMS];
+		T qscale[NUM_DIMS];
+
+		void alloc_partitions();
+		void build_partition(uint64_t i, const T *data, uint64_t stride, vta_pair<T,Z> *list, vta_pos<Z> *order, T *sorted);
+		void quantize_blocks();
+		void query_top(const TopKQuery<T> &query, std::vector<tuple_<T,Z>> &top, uint64_t &tuple_count) const;
 };
 
-template<class T, class Z>
-void VTA<T,Z>::init(){
-	normalize_transpose<T,Z>(this->cdata, this->n, this->d);
-	this->t.start();
-	//Allocate partition & blocks //
+template<class T, class Z, class S>
+void VTA<T,Z,S>::alloc_partitions(){
 	uint64_t part_offset = 0;
 	uint64_t part_size = ((this->n - 1) / VPARTITIONS) + 1;
 	for(uint64_t i = 0; i < VPARTITIONS; i++){
@@ -101,64 +131,246 @@ void VTA<T,Z>::init(){
 		}
 		part_offset += last - first;
 	}
-	//////////////////////////////////////////////////////////
+}
+
+/*
+ * Order the tuples of partition i by their first appearance in the sorted attribute lists and fill its blocks.
+ * Attribute m of local tuple j is data[m*stride + j]. A single pair list is sorted per attribute; only the
+ * sorted scores are kept (d x partition size) to extract the block thresholds.
+ */
+template<class T, class Z, class S>
+void VTA<T,Z,S>::build_partition(uint64_t i, const T *data, uint64_t stride, vta_pair<T,Z> *list, vta_pos<Z> *order, T *sorted){
+	//Initialize structure to determine relative order inside partition//
+	for(uint64_t j = 0; j < parts[i].size; j++){
+		order[j].id = j;
+		order[j].pos = parts[i].size;//Maximum appearance position//
+	}
+	//Find order of partition
+	for(uint8_t m = 0; m < this->d; m++){
+		//Create list for partition//
+		for(uint64_t j = 0; j < parts[i].size; j++){
+			list[j].id = j;
+			list[j].score = data[m*stride + j];
+		}
+		__gnu_parallel::sort(list,list + parts[i].size,cmp_vta_pair<T,Z>);
+
+		//Find minimum position appearance
+		for(uint64_t j = 0; j < parts[i].size; j++){
+			Z id = list[j].id;
+			order[id].pos = std::min(order[id].pos,(Z)j);//Minimum appearance position
+			sorted[m*parts[i].size + j] = list[j].score;
+		}
+	}
+	__gnu_parallel::sort(&order[0],(&order[0]) + parts[i].size,cmp_vta_pos<T,Z>);
+
+	//Split partition into blocks//
+	uint64_t bnum = 0;
+	for(uint64_t j = 0; j < parts[i].size; ){
+		uint64_t jj;
+		for(jj = 0; jj < parts[i].blocks[bnum].tuple_num; jj++){//For each block//
+			Z id = order[j+jj].id;//Get next tuple in order
+			for(uint8_t m = 0; m < this->d; m++){ parts[i].blocks[bnum].tuples[m*VBLOCK_SIZE + jj] = data[m*stride + id]; }
+			parts[i].blocks[bnum].tids[jj] = parts[i].offset + id;//partitions are contiguous row ranges
+		}
+		Z pos = order[j+jj-1].pos;
+		for(uint8_t m = 0; m < this->d; m++){ parts[i].blocks[bnum].tarray[m] = sorted[m*parts[i].size + pos]; }
+		j+=parts[i].blocks[bnum].tuple_num;
+		bnum++;
+	}
+	topk_block_bounds<T,VBLOCK_SIZE>(parts[i].blocks,bnum,this->d);//Lower bounds and zone maps
+}
+
+template<class T, class Z, class S>
+void VTA<T,Z,S>::init(){
+	if(!this->normalized) normalize_transpose<T,Z>(this->cdata, this->n, this->d);
+	this->t.start();
+	this->alloc_partitions();
 
 	//Initialize Partitions and Blocks//
 	uint64_t max_part_size = (((this->n - 1)/VPARTITIONS) + 1);
-	vta_pair<T,Z> **lists = (vta_pair<T,Z>**)malloc(sizeof(vta_pair<T,Z>*)*this->d);
-	for(uint8_t m = 0; m < this->d; m++){ lists[m] = (vta_pair<T,Z>*)malloc(sizeof(vta_pair<T,Z>)*max_part_size); }
+	vta_pair<T,Z> *list = (vta_pair<T,Z>*)malloc(sizeof(vta_pair<T,Z>)*max_part_size);
+	vta_pos<Z> *order = (vta_pos<Z>*)malloc(sizeof(vta_pos<Z>)*max_part_size);
+	T *sorted = (T*)malloc(sizeof(T)*max_part_size*this->d);
+	omp_set_num_threads(THREADS);
+
+	for(uint64_t i = 0; i < VPARTITIONS; i++) this->build_partition(i,&this->cdata[parts[i].offset],this->n,list,order,sorted);
+
+	free(this->cdata); this->cdata = NULL;
+	free(order);
+	free(list);
+	free(sorted);
+	if(QBITS > 0) this->quantize_blocks();
+	this->tt_init = this->t.lap();
+}
+
+/*
+ * Build the partitions directly from a binary snapshot. Each partition is a contiguous row range, so its
+ * columns are read (and normalized) into one staging buffer and turned into blocks before the next one.
+ * Peak memory is the blocks plus the staging/sort buffers of a single partition.
+ */
+template<class T, class Z, class S>
+void VTA<T,Z,S>::init_stream(File<T> *f){
+	this->t.start();
+	this->alloc_partitions();
+
+	uint64_t max_part_size = (((this->n - 1)/VPARTITIONS) + 1);
+	uint8_t all[NUM_DIMS];
+	for(uint8_t m = 0; m < NUM_DIMS; m++) all[m] = m;
+	T *staging = static_cast<T*>(aligned_alloc(32,sizeof(T)*max_part_size*this->d));
+	T *sorted = static_cast<T*>(aligned_alloc(32,sizeof(T)*max_part_size*this->d));
+	vta_pair<T,Z> *list = (vta_pair<T,Z>*)malloc(sizeof(vta_pair<T,Z>)*max_part_size);
 	vta_pos<Z> *order = (vta_pos<Z>*)malloc(sizeof(vta_pos<Z>)*max_part_size);
-	uint64_t poffset = 0;
 	omp_set_num_threads(THREADS);
 
 	for(uint64_t i = 0; i < VPARTITIONS; i++){
-		//Initialize structure to determine relative order inside partition//
-		for(uint64_t j = 0; j < parts[i].size; j++){
-			order[j].id = j;
-			order[j].pos = parts[i].size;//Maximum appearance position//
-		}
-		//Find order of partition
-		for(uint8_t m = 0; m < this->d; m++){
-			//Create lists for partition//
-			for(uint64_t j = 0; j < parts[i].size; j++){
-				lists[m][j].id = j;
-				lists[m][j].score = this->cdata[m*this->n + (poffset + j)];
-			}
-			__gnu_parallel::sort(lists[m],(lists[m]) + parts[i].size,cmp_vta_pair<T,Z>);
+		f->read_window_norm(staging,parts[i].offset,parts[i].size,max_part_size,this->d,all);
+		this->build_partition(i,staging,max_part_size,list,order,sorted);
+	}
+
+	free(staging);
+	free(sorted);
+	free(list);
+	free(order);
+	if(QBITS > 0) this->quantize_blocks();
+	this->tt_init = this->t.lap();
+}
 
-			//Find minimum position appearance
-			for(uint64_t j = 0; j < parts[i].size; j++){
-				Z id = lists[m][j].id;
-				order[id].pos = std::min(order[id].pos,(Z)j);//Minimum appearance position
+/*
+ * Build quantized copy of every block with a per attribute minimum and scale
+ */
+template<class T, class Z, class S>
+void VTA<T,Z,S>::quantize_blocks(){
+	T vmin[NUM_DIMS], vmax[NUM_DIMS];
+	for(uint64_t m = 0; m < this->d; m++){ vmin[m] = std::numeric_limits<T>::max(); vmax[m] = std::numeric_limits<T>::lowest(); }
+	for(uint64_t i = 0; i < VPARTITIONS; i++){
+		for(uint64_t b = 0; b < parts[i].block_num; b++){
+			T *tuples = parts[i].blocks[b].tuples;
+			for(uint64_t m = 0; m < this->d; m++){
+				for(uint64_t t = 0; t < parts[i].blocks[b].tuple_num; t++){
+					vmin[m] = std::min(vmin[m],tuples[m*VBLOCK_SIZE + t]);
+					vmax[m] = std::max(vmax[m],tuples[m*VBLOCK_SIZE + t]);
+				}
 			}
 		}
-		__gnu_parallel::sort(&order[0],(&order[0]) + parts[i].size,cmp_vta_pos<T,Z>);
-
-		//Split partition into blocks//
-		uint64_t bnum = 0;
-		for(uint64_t j = 0; j < parts[i].size; ){
-			uint64_t jj;
-			for(jj = 0; jj < parts[i].blocks[bnum].tuple_num; jj++){//For each block//
-				Z id = order[j+jj].id;//Get next tuple in order
-				for(uint8_t m = 0; m < this->d; m++){ parts[i].blocks[bnum].tuples[m*VBLOCK_SIZE + jj] = this->cdata[m*this->n + (poffset + id)]; }
+	}
+	for(uint64_t m = 0; m < this->d; m++) quant_params<T>(vmin[m],vmax[m],this->qmin[m],this->qscale[m]);
+
+	for(uint64_t i = 0; i < VPARTITIONS; i++){
+		if(this->qparts[i]!=NULL) free(this->qparts[i]);
+		this->qparts[i] = static_cast<qtype*>(aligned_alloc(32,sizeof(qtype)*parts[i].block_num*VBLOCK_SIZE*NUM_DIMS));
+		for(uint64_t b = 0; b < parts[i].block_num; b++){
+			T *tuples = parts[i].blocks[b].tuples;
+			qtype *qtuples = &this->qparts[i][b*VBLOCK_SIZE*NUM_DIMS];
+			Z tuple_num = parts[i].blocks[b].tuple_num;
+			for(uint64_t m = 0; m < this->d; m++){
+				for(uint64_t t = 0; t < VBLOCK_SIZE; t++){
+					qtuples[m*VBLOCK_SIZE + t] = t < tuple_num ? quantize<T>(tuples[m*VBLOCK_SIZE + t],this->qmin[m],this->qscale[m]) : 0;
+				}
 			}
-			Z pos = order[j+jj-1].pos;
-			for(uint8_t m = 0; m < this->d; m++){ parts[i].blocks[bnum].tarray[m] = lists[m][pos].score; }
-			j+=parts[i].blocks[bnum].tuple_num;
-			bnum++;
 		}
-		poffset += parts[i].size;
 	}
+}
 
-	free(this->cdata); this->cdata = NULL;
-	free(order);
-	for(uint8_t m = 0; m < this->d; m++){ free(lists[m]); }
-	free(lists);
+template<class T, class Z, class S>
+void VTA<T,Z,S>::save_index(std::string fname){
+	save_index_file<T,Z,vta_partition<T,Z>,vta_block<T,Z>>(fname,INDEX_VTA,this->n,this->d,VBLOCK_SIZE,this->parts,VPARTITIONS);
+}
+
+template<class T, class Z, class S>
+void VTA<T,Z,S>::load_index(std::string fname){
+	index_header h;
+	this->t.start();
+	this->index_map = map_index_file<T,Z,vta_block<T,Z>>(fname,INDEX_VTA,this->n,this->d,VBLOCK_SIZE,h,this->index_bytes);
+	if(h.part_num != VPARTITIONS){
+		std::cout << "Index partitions (" << h.part_num << ") != VPARTITIONS (" << VPARTITIONS << ")!!!" << std::endl;
+		exit(1);
+	}
+	assign_index_parts<vta_partition<T,Z>,vta_block<T,Z>>(this->index_map,h,this->parts);
+	if(this->cdata != NULL){ free(this->cdata); this->cdata = NULL; }
+	if(QBITS > 0) this->quantize_blocks();
 	this->tt_init = this->t.lap();
 }
 
-template<class T, class Z>
-void VTA<T,Z>::findTopKscalar(uint64_t k, uint8_t qq, T *weights, uint8_t *attr){
+/*
+ * Scan the blocks of each partition; TOPK_PARALLEL assigns partitions to threads round-robin
+ */
+template<class T, class Z, class S>
+void VTA<T,Z,S>::query_top(const TopKQuery<T> &query, std::vector<tuple_<T,Z>> &top, uint64_t &tuple_count) const{
+	if(query.policy == TOPK_PARALLEL){
+		uint32_t threads = std::max((uint64_t)1,std::min((uint64_t)query.threads,(uint64_t)VPARTITIONS));
+		std::vector<topk_heap<T,Z>> tq(threads);
+		std::vector<std::vector<tuple_<T,Z>>> tt(threads);
+		TopKShared<T> shared;//k-th score published across threads
+		std::vector<uint64_t> tcount(threads,0);
+		#pragma omp parallel num_threads(threads)
+		{
+			uint32_t tid = omp_get_thread_num();
+			uint32_t nt = omp_get_num_threads();
+			for(uint64_t i = tid; i < VPARTITIONS; i+=nt){
+				topk_scan_blocks<T,Z,VBLOCK_SIZE>(this->parts[i].blocks,this->parts[i].block_num,query,tq[tid],tcount[tid],this->fn,&shared);
+			}
+			topk_sorted<T,Z>(tq[tid],query.k,tt[tid]);
+			topk_tree_merge<T,Z>(tt.data(),tid,nt,query.k);
+		}
+		std::swap(top,tt[0]);
+		for(uint32_t i = 0; i < threads; i++) tuple_count+=tcount[i];
+	}else{
+		topk_heap<T,Z> q;
+		for(uint64_t i = 0; i < VPARTITIONS; i++){
+			topk_scan_blocks<T,Z,VBLOCK_SIZE>(this->parts[i].blocks,this->parts[i].block_num,query,q,tuple_count,this->fn);
+		}
+		topk_sorted<T,Z>(q,query.k,top);
+	}
+}
+
+/*
+ * Re-entrant top-k query (see TopK.h), results in descending score order
+ */
+template<class T, class Z, class S>
+TopKResult<T,Z> VTA<T,Z,S>::query(const TopKQuery<T> &query) const{
+	TopKResult<T,Z> r;
+	this->query_top(query,r.tuples,r.tuple_count);
+	r.threshold = r.tuples.empty() ? 0 : r.tuples.back().score;
+	return r;
+}
+
+template<class T, class Z, class S>
+uint64_t VTA<T,Z,S>::query(const TopKQuery<T> &query, tuple_<T,Z> *out) const{
+	std::vector<tuple_<T,Z>> top;
+	uint64_t tuple_count = 0;
+	this->query_top(query,top,tuple_count);
+	std::copy(top.begin(),top.end(),out);
+	return top.size();
+}
+
+/*
+ * Tuples query() scans when the k-th score is kth (see Planner.h)
+ */
+template<class T, class Z, class S>
+uint64_t VTA<T,Z,S>::estimate(const TopKQuery<T> &query, T kth) const{
+	uint64_t count = 0;
+	for(uint64_t i = 0; i < VPARTITIONS; i++) count+=topk_estimate_blocks<T>(this->parts[i].blocks,this->parts[i].block_num,query,kth,this->fn);
+	return count;
+}
+
+/*
+ * Paged top-k: cursor() opens a scan, next() returns the following count tuples in descending score order
+ * and resumes from the recorded block positions
+ */
+template<class T, class Z, class S>
+TopKCursor<T,Z> VTA<T,Z,S>::cursor(const TopKQuery<T> &query) const{
+	TopKCursor<T,Z> c;
+	c.query = query;
+	return c;
+}
+
+template<class T, class Z, class S>
+uint64_t VTA<T,Z,S>::next(TopKCursor<T,Z> &cursor, uint64_t count, tuple_<T,Z> *out) const{
+	return topk_cursor_next<T,Z,VBLOCK_SIZE>(this->parts,VPARTITIONS,cursor,count,out,this->fn);
+}
+
+template<class T, class Z, class S>
+void VTA<T,Z,S>::findTopKscalar(uint64_t k, uint8_t qq, T *weights, uint8_t *attr){
 	std::cout << this->algo << " find top-" << k << " scalar (" << (int)qq << "D) ...";
 	if(STATS_EFF) this->tuple_count = 0;
 	if(STATS_EFF) this->pop_count=0;
@@ -208,11 +420,10 @@ void VTA<T,Z>::findTopKscalar(uint64_t k, uint8_t qq, T *weights, uint8_t *attr)
 				if(STATS_EFF) this->tuple_count+=8;
 			}
 			T threshold = 0;
-			T *tarray = parts[i].blocks[b].tarray;
 			#if LD == 2
 				threshold /=qq;
 			#endif
-			for(uint8_t m = 0; m < qq; m++) threshold+=tarray[attr[m]]*weights[attr[m]];
+			threshold+=topk_bound<T>(parts[i].blocks[b],qq,weights,attr);
 			if(q.size() >= k && q.top().score >= threshold){ break; }
 		}
 	}
@@ -230,8 +441,8 @@ void VTA<T,Z>::findTopKscalar(uint64_t k, uint8_t qq, T *weights, uint8_t *attr)
 	this->threshold = threshold;
 }
 
-template<class T, class Z>
-void VTA<T,Z>::findTopKsimd(uint64_t k, uint8_t qq, T *weights, uint8_t *attr){
+template<class T, class Z, class S>
+void VTA<T,Z,S>::findTopKsimd(uint64_t k, uint8_t qq, T *weights, uint8_t *attr){
 	std::cout << this->algo << " find top-" << k << " simd (" << (int)qq << "D) ...";
 	if(STATS_EFF) this->tuple_count = 0;
 	if(STATS_EFF) this->pop_count=0;
@@ -241,6 +452,7 @@ void VTA<T,Z>::findTopKsimd(uint64_t k, uint8_t qq, T *weights, uint8_t *attr){
 	float score[16] __attribute__((aligned(32)));
 	__builtin_prefetch(score,1,3);
 	__m256 dim_num = _mm256_set_ps(qq,qq,qq,qq,qq,qq,qq,qq);
+	auto c = topk_candidates<T,Z>(q,k);
 //	__m256 _weight00,_weight01,_weight02,_weight03,_weight04,_weight05,_weight06,_weight07;
 //	if(qq =< 1)
 //	for(uint8_t m = 0; m < qq; m++){
@@ -254,7 +466,6 @@ void VTA<T,Z>::findTopKsimd(uint64_t k, uint8_t qq, T *weights, uint8_t *attr){
 			T *tuples = parts[i].blocks[b].tuples;
 			uint64_t id = parts[i].offset + parts[i].blocks[b].offset;
 			for(uint64_t t = 0; t < tuple_num; t+=16){
-				id+=t;
 				__m256 score00 = _mm256_setzero_ps();
 				__m256 score01 = _mm256_setzero_ps();
 //				__m256 score02 = _mm256_setzero_ps();
@@ -278,49 +489,13 @@ void VTA<T,Z>::findTopKsimd(uint64_t k, uint8_t qq, T *weights, uint8_t *attr){
 
 				_mm256_store_ps(&score[0],score00);
 				_mm256_store_ps(&score[8],score01);
-				//_mm256_stream_ps(&score[0],score00);
-				//_mm256_stream_ps(&score[8],score00);
-				if(q.size() < k){//insert if empty space in queue
-					q.push(tuple_<T,Z>(id,score[0]));
-					q.push(tuple_<T,Z>(id+1,score[1]));
-					q.push(tuple_<T,Z>(id+2,score[2]));
-					q.push(tuple_<T,Z>(id+3,score[3]));
-					q.push(tuple_<T,Z>(id+4,score[4]));
-					q.push(tuple_<T,Z>(id+5,score[5]));
-					q.push(tuple_<T,Z>(id+6,score[6]));
-					q.push(tuple_<T,Z>(id+7,score[7]));
-					q.push(tuple_<T,Z>(id+8,score[8]));
-					q.push(tuple_<T,Z>(id+9,score[9]));
-					q.push(tuple_<T,Z>(id+10,score[10]));
-					q.push(tuple_<T,Z>(id+11,score[11]));
-					q.push(tuple_<T,Z>(id+12,score[12]));
-					q.push(tuple_<T,Z>(id+13,score[13]));
-					q.push(tuple_<T,Z>(id+14,score[14]));
-					q.push(tuple_<T,Z>(id+15,score[15]));
-				}else{//delete smallest element if current score is bigger
-					if(q.top().score < score[0]){ q.pop(); q.push(tuple_<T,Z>(id,score[0])); }
-					if(q.top().score < score[1]){ q.pop(); q.push(tuple_<T,Z>(id+1,score[1])); }
-					if(q.top().score < score[2]){ q.pop(); q.push(tuple_<T,Z>(id+2,score[2])); }
-					if(q.top().score < score[3]){ q.pop(); q.push(tuple_<T,Z>(id+3,score[3])); }
-					if(q.top().score < score[4]){ q.pop(); q.push(tuple_<T,Z>(id+4,score[4])); }
-					if(q.top().score < score[5]){ q.pop(); q.push(tuple_<T,Z>(id+5,score[5])); }
-					if(q.top().score < score[6]){ q.pop(); q.push(tuple_<T,Z>(id+6,score[6])); }
-					if(q.top().score < score[7]){ q.pop(); q.push(tuple_<T,Z>(id+7,score[7])); }
-					if(q.top().score < score[8]){ q.pop(); q.push(tuple_<T,Z>(id+8,score[8])); }
-					if(q.top().score < score[9]){ q.pop(); q.push(tuple_<T,Z>(id+9,score[9])); }
-					if(q.top().score < score[10]){ q.pop(); q.push(tuple_<T,Z>(id+10,score[10])); }
-					if(q.top().score < score[11]){ q.pop(); q.push(tuple_<T,Z>(id+11,score[11])); }
-					if(q.top().score < score[12]){ q.pop(); q.push(tuple_<T,Z>(id+12,score[12])); }
-					if(q.top().score < score[13]){ q.pop(); q.push(tuple_<T,Z>(id+13,score[13])); }
-					if(q.top().score < score[14]){ q.pop(); q.push(tuple_<T,Z>(id+14,score[14])); }
-					if(q.top().score < score[15]){ q.pop(); q.push(tuple_<T,Z>(id+15,score[15])); }
-				}
+				c.push16(score,topk_lanes(tuple_num,t),id + t);
 				if(STATS_EFF) this->tuple_count+=16;
 			}
 
+			c.flush();
 			T threshold = 0;
-			T *tarray = parts[i].blocks[b].tarray;
-			for(uint8_t m = 0; m < qq; m++) threshold+=tarray[attr[m]]*weights[attr[m]];
+			threshold+=topk_bound<T>(parts[i].blocks[b],qq,weights,attr);
 			if(q.size() >= k && q.top().score >= threshold) break;
 		}
 	}
@@ -338,8 +513,8 @@ void VTA<T,Z>::findTopKsimd(uint64_t k, uint8_t qq, T *weights, uint8_t *attr){
 	this->threshold = threshold;
 }
 
-template<class T, class Z>
-void VTA<T,Z>::findTopKsimdMQ(uint64_t k, uint8_t qq, T *weights, uint8_t *attr, uint32_t tid){
+template<class T, class Z, class S>
+void VTA<T,Z,S>::findTopKsimdMQ(uint64_t k, uint8_t qq, T *weights, uint8_t *attr, uint32_t tid){
 	Time<msecs> t;
 	if(STATS_EFF) this->tuple_count = 0;
 	if(STATS_EFF) this->pop_count=0;
@@ -350,13 +525,13 @@ void VTA<T,Z>::findTopKsimdMQ(uint64_t k, uint8_t qq, T *weights, uint8_t *attr,
 	__builtin_prefetch(score,1,3);
 	t.start();
 	__m256 dim_num = _mm256_set_ps(qq,qq,qq,qq,qq,qq,qq,qq);
+	auto c = topk_candidates<T,Z>(q,k);
 	for(uint64_t i = 0; i < VPARTITIONS; i++){
 		for(uint64_t b = 0; b < parts[i].block_num; b++){
 			Z tuple_num = parts[i].blocks[b].tuple_num;
 			T *tuples = parts[i].blocks[b].tuples;
 			uint64_t id = parts[i].offset + parts[i].blocks[b].offset;
 			for(uint64_t t = 0; t < tuple_num; t+=16){
-				id+=t;
 				__m256 score00 = _mm256_setzero_ps();
 				__m256 score01 = _mm256_setzero_ps();
 				for(uint8_t m = 0; m < qq; m++){
@@ -372,58 +547,25 @@ void VTA<T,Z>::findTopKsimdMQ(uint64_t k, uint8_t qq, T *weights, uint8_t *attr,
 				}
 				_mm256_store_ps(&score[0],score00);
 				_mm256_store_ps(&score[8],score01);
-				if(q.size() < k){//insert if empty space in queue
-					q.push(tuple_<T,Z>(id,score[0]));
-					q.push(tuple_<T,Z>(id+1,score[1]));
-					q.push(tuple_<T,Z>(id+2,score[2]));
-					q.push(tuple_<T,Z>(id+3,score[3]));
-					q.push(tuple_<T,Z>(id+4,score[4]));
-					q.push(tuple_<T,Z>(id+5,score[5]));
-					q.push(tuple_<T,Z>(id+6,score[6]));
-					q.push(tuple_<T,Z>(id+7,score[7]));
-					q.push(tuple_<T,Z>(id+8,score[8]));
-					q.push(tuple_<T,Z>(id+9,score[9]));
-					q.push(tuple_<T,Z>(id+10,score[10]));
-					q.push(tuple_<T,Z>(id+11,score[11]));
-					q.push(tuple_<T,Z>(id+12,score[12]));
-					q.push(tuple_<T,Z>(id+13,score[13]));
-					q.push(tuple_<T,Z>(id+14,score[14]));
-					q.push(tuple_<T,Z>(id+15,score[15]));
-				}else{//delete smallest element if current score is bigger
-					if(q.top().score < score[0]){ q.pop(); q.push(tuple_<T,Z>(id,score[0])); }
-					if(q.top().score < score[1]){ q.pop(); q.push(tuple_<T,Z>(id+1,score[1])); }
-					if(q.top().score < score[2]){ q.pop(); q.push(tuple_<T,Z>(id+2,score[2])); }
-					if(q.top().score < score[3]){ q.pop(); q.push(tuple_<T,Z>(id+3,score[3])); }
-					if(q.top().score < score[4]){ q.pop(); q.push(tuple_<T,Z>(id+4,score[4])); }
-					if(q.top().score < score[5]){ q.pop(); q.push(tuple_<T,Z>(id+5,score[5])); }
-					if(q.top().score < score[6]){ q.pop(); q.push(tuple_<T,Z>(id+6,score[6])); }
-					if(q.top().score < score[7]){ q.pop(); q.push(tuple_<T,Z>(id+7,score[7])); }
-					if(q.top().score < score[8]){ q.pop(); q.push(tuple_<T,Z>(id+8,score[8])); }
-					if(q.top().score < score[9]){ q.pop(); q.push(tuple_<T,Z>(id+9,score[9])); }
-					if(q.top().score < score[10]){ q.pop(); q.push(tuple_<T,Z>(id+10,score[10])); }
-					if(q.top().score < score[11]){ q.pop(); q.push(tuple_<T,Z>(id+11,score[11])); }
-					if(q.top().score < score[12]){ q.pop(); q.push(tuple_<T,Z>(id+12,score[12])); }
-					if(q.top().score < score[13]){ q.pop(); q.push(tuple_<T,Z>(id+13,score[13])); }
-					if(q.top().score < score[14]){ q.pop(); q.push(tuple_<T,Z>(id+14,score[14])); }
-					if(q.top().score < score[15]){ q.pop(); q.push(tuple_<T,Z>(id+15,score[15])); }
-				}
+				c.push16(score,topk_lanes(tuple_num,t),id + t);
 				if(STATS_EFF) this->tuple_count+=16;
 			}
 
+			c.flush();
 			T threshold = 0;
-			T *tarray = parts[i].blocks[b].tarray;
-			for(uint8_t m = 0; m < qq; m++) threshold+=tarray[attr[m]]*weights[attr[m]];
+			threshold+=topk_bound<T>(parts[i].blocks[b],qq,weights,attr);
 			if(q.size() >= k && q.top().score >= threshold) break;
 		}
 	}
 	this->tt_array[tid] += t.lap();
 }
 
-template<class T, class Z>
-void VTA<T,Z>::findTopKthreads(uint64_t k, uint8_t qq, T *weights, uint8_t *attr){
+template<class T, class Z, class S>
+void VTA<T,Z,S>::findTopKthreads(uint64_t k, uint8_t qq, T *weights, uint8_t *attr){
 	uint32_t threads = THREADS < VPARTITIONS ? THREADS : VPARTITIONS;
 	Z tt_count[threads];
 	std::priority_queue<T, std::vector<tuple_<T,Z>>, PQComparison<T,Z>> q[threads];
+	std::vector<tuple_<T,Z>> top[threads];
 	omp_set_num_threads(threads);
 
 	std::cout << this->algo << " find top-" << k << " threads x "<< threads <<" (" << (int)qq << "D) ...";
@@ -431,6 +573,7 @@ void VTA<T,Z>::findTopKthreads(uint64_t k, uint8_t qq, T *weights, uint8_t *attr
 	if(STATS_EFF) this->pop_count=0;
 	if(this->res.size() > 0) this->res.clear();
 
+	TopKShared<T> shared;//k-th score published across threads
 	this->t.start();
 #pragma omp parallel
 {
@@ -439,13 +582,13 @@ void VTA<T,Z>::findTopKthreads(uint64_t k, uint8_t qq, T *weights, uint8_t *attr
 	uint32_t tid = omp_get_thread_num();
 	Z tuple_count = 0;
 	__m256 dim_num = _mm256_set_ps(qq,qq,qq,qq,qq,qq,qq,qq);
+	auto c = topk_candidates<T,Z>(q[tid],k,&shared);
 	for(uint64_t i = tid; i < VPARTITIONS; i+=threads){
 		for(uint64_t b = 0; b < parts[i].block_num; b++){
 			Z tuple_num = parts[i].blocks[b].tuple_num;
 			T *tuples = parts[i].blocks[b].tuples;
 			uint64_t id = parts[i].offset + parts[i].blocks[b].offset;
 			for(uint64_t t = 0; t < tuple_num; t+=16){
-				id+=t;
 				__m256 score00 = _mm256_setzero_ps();
 				__m256 score01 = _mm256_setzero_ps();
 				for(uint8_t m = 0; m < qq; m++){
@@ -462,57 +605,37 @@ void VTA<T,Z>::findTopKthreads(uint64_t k, uint8_t qq, T *weights, uint8_t *attr
 				_mm256_store_ps(&score[0],score00);
 				_mm256_store_ps(&score[8],score01);
 
-				for(uint8_t l = 0; l < 16; l++){
-					if(q[tid].size() < k){
-						q[tid].push(tuple_<T,Z>(id,score[l]));
-					}else if(q[tid].top().score < score[l]){
-						q[tid].pop(); q[tid].push(tuple_<T,Z>(id,score[l]));
-					}
-				}
+				c.push16(score,topk_lanes(tuple_num,t),id + t);
 				if(STATS_EFF) tuple_count+=16;
 			}
 
+			c.flush();
 			T threshold = 0;
-			T *tarray = parts[i].blocks[b].tarray;
-			for(uint8_t m = 0; m < qq; m++) threshold+=tarray[attr[m]]*weights[attr[m]];
-			if(q[tid].size() >= k && q[tid].top().score >= threshold) break;
+			threshold+=topk_bound<T>(parts[i].blocks[b],qq,weights,attr);
+			if(c.covers(threshold)) break;
 		}
 	}
 	if(STATS_EFF) tt_count[tid] = tuple_count;
+	topk_sorted<T,Z>(q[tid],k,top[tid]);
+	topk_tree_merge<T,Z>(top,tid,threads,k);
 }
 
-	std::priority_queue<T, std::vector<tuple_<T,Z>>, PQComparison<T,Z>> _q;
-	for(uint32_t m = 0; m < threads; m++){
-		while(!q[m].empty()){
-			if(_q.size() < k){
-				_q.push(q[m].top());
-			}else if(_q.top().score < q[m].top().score){
-				_q.pop();
-				_q.push(q[m].top());
-			}
-			q[m].pop();
-		}
-	}
 	this->tt_processing += this->t.lap();
 
 	if(STATS_EFF){ for(uint32_t i = 0; i < threads; i++) this->tuple_count +=tt_count[i]; }
-	T threshold = _q.top().score;
-	while(!_q.empty()){
-		//std::cout << this->algo <<" : " << q.top().tid << "," << q.top().score << std::endl;
-		this->res.push_back(_q.top());
-		_q.pop();
-	}
+	std::swap(this->res,top[0]);
+	T threshold = this->res.empty() ? 0 : this->res.back().score;
 	std::cout << std::fixed << std::setprecision(4);
 	std::cout << " threshold=[" << threshold <<"] (" << this->res.size() << ")" << std::endl;
 	this->threshold = threshold;
 }
 
-template<class T, class Z>
-void VTA<T,Z>::findTopKthreads2(uint64_t k, uint8_t qq, T *weights, uint8_t *attr){
+template<class T, class Z, class S>
+void VTA<T,Z,S>::findTopKthreads2(uint64_t k, uint8_t qq, T *weights, uint8_t *attr){
 	uint32_t threads = THREADS;
 	Z tt_count[threads];
 	std::priority_queue<T, std::vector<tuple_<T,Z>>, PQComparison<T,Z>> q[threads];
-	std::priority_queue<T, std::vector<tuple_<T,Z>>, PQComparison<T,Z>> _q;
+	std::vector<tuple_<T,Z>> top[threads];
 	omp_set_num_threads(threads);
 
 	std::cout << this->algo << " find top-" << k << " threads (2) x "<< threads <<" (" << (int)qq << "D) ...";
@@ -520,6 +643,7 @@ void VTA<T,Z>::findTopKthreads2(uint64_t k, uint8_t qq, T *weights, uint8_t *att
 	if(STATS_EFF) this->pop_count=0;
 	if(this->res.size() > 0) this->res.clear();
 
+	TopKShared<T> shared;//k-th score published across threads
 	this->t.start();
 #pragma omp parallel
 {
@@ -528,6 +652,7 @@ void VTA<T,Z>::findTopKthreads2(uint64_t k, uint8_t qq, T *weights, uint8_t *att
 	uint32_t tid = omp_get_thread_num();
 	Z tuple_count = 0;
 	__m256 dim_num = _mm256_set_ps(qq,qq,qq,qq,qq,qq,qq,qq);
+	auto c = topk_candidates<T,Z>(q[tid],k,&shared);
 	//for(uint64_t i = tid; i < VPARTITIONS; i+=threads){
 	for(uint64_t i = 0; i < VPARTITIONS; i++){
 		for(uint64_t b = 0; b < parts[i].block_num; b++){
@@ -541,7 +666,6 @@ void VTA<T,Z>::findTopKthreads2(uint64_t k, uint8_t qq, T *weights, uint8_t *att
 
 			//for(uint64_t t = 0; t < tuple_num; t+=16){
 			for(uint64_t t = start; t < end; t+=16){
-				id+=t;
 				__m256 score00 = _mm256_setzero_ps();
 				__m256 score01 = _mm256_setzero_ps();
 				for(uint8_t m = 0; m < qq; m++){
@@ -562,43 +686,126 @@ void VTA<T,Z>::findTopKthreads2(uint64_t k, uint8_t qq, T *weights, uint8_t *att
 				_mm256_store_ps(&score[0],score00);
 				_mm256_store_ps(&score[8],score01);
 
-				for(uint8_t l = 0; l < 16; l++){
-					if(q[tid].size() < k){
-						q[tid].push(tuple_<T,Z>(id,score[l]));
-					}else if(q[tid].top().score < score[l]){
-						q[tid].pop(); q[tid].push(tuple_<T,Z>(id,score[l]));
-					}
-				}
+				c.push16(score,topk_lanes(tuple_num,t),id + t);
 				if(STATS_EFF) tuple_count+=16;
 			}
 
+			c.flush();
 			T threshold = 0;
-			T *tarray = parts[i].blocks[b].tarray;
-			for(uint8_t m = 0; m < qq; m++) threshold+=tarray[attr[m]]*weights[attr[m]];
-			if(q[tid].size() >= k && q[tid].top().score >= threshold) break;
+			threshold+=topk_bound<T>(parts[i].blocks[b],qq,weights,attr);
+			if(c.covers(threshold)) break;
 		}
 	}
 	if(STATS_EFF) tt_count[tid] = tuple_count;
+	topk_sorted<T,Z>(q[tid],k,top[tid]);
+	topk_tree_merge<T,Z>(top,tid,threads,k);
+}
+	this->tt_processing += this->t.lap();
+
+	if(STATS_EFF){ for(uint32_t i = 0; i < threads; i++) this->tuple_count +=tt_count[i]; }
+	std::swap(this->res,top[0]);
+	T threshold = this->res.empty() ? 0 : this->res.back().score;
+	std::cout << std::fixed << std::setprecision(4);
+	std::cout << " threshold=[" << threshold <<"] (" << this->res.size() << ")" << std::endl;
+	this->threshold = threshold;
 }
-	for(uint32_t m = 0; m < threads; m++){
-		while(!q[m].empty()){
-			if(_q.size() < k){
-				_q.push(q[m].top());
-			}else if(_q.top().score < q[m].top().score){
-				_q.pop();
-				_q.push(q[m].top());
+
+/*
+ * Block scan over quantized tuples. Lower bounds feed the k-th largest lower bound that prunes
+ * candidates and stops the scan against the block threshold; candidates are rescored from the float block.
+ */
+template<class T, class Z, class S>
+void VTA<T,Z,S>::findTopKquant(uint64_t k, uint8_t qq, T *weights, uint8_t *attr){
+	std::cout << this->algo << " find top-" << k << " quant (" << (int)qq << "D) ...";
+	if(STATS_EFF) this->tuple_count = 0;
+	if(STATS_EFF) this->pop_count=0;
+	if(this->res.size() > 0) this->res.clear();
+	if(this->qparts[0] == NULL){
+		std::cout << "Quantized blocks are not initialized (QBITS=0)!!!" << std::endl;
+		exit(1);
+	}
+
+	T ew[NUM_DIMS];
+	quant_weights<T>(qq,weights,attr,ew);
+	T base, delta;
+	quant_bounds<T>(qq,ew,attr,this->qmin,this->qscale,base,delta);
+
+	std::priority_queue<T, std::vector<T>, std::greater<T>> lq;//k largest lower bounds
+	std::vector<tuple_<T,Z>> cand;//candidate id, upper bound
+	std::vector<T*> cpos;//candidate position inside its block
+	float lb[16] __attribute__((aligned(32)));
+	T thr = std::numeric_limits<T>::lowest();
+	this->t.start();
+	for(uint64_t i = 0; i < VPARTITIONS; i++){
+		for(uint64_t b = 0; b < parts[i].block_num; b++){
+			Z tuple_num = parts[i].blocks[b].tuple_num;
+			T *tuples = parts[i].blocks[b].tuples;
+			qtype *qtuples = &this->qparts[i][b*VBLOCK_SIZE*NUM_DIMS];
+			uint64_t id = parts[i].offset + parts[i].blocks[b].offset;
+			for(uint64_t t = 0; t < tuple_num; t+=16){
+				__m256 lb00 = _mm256_set1_ps(base);
+				__m256 lb01 = _mm256_set1_ps(base);
+				for(uint8_t m = 0; m < qq; m++){
+					const qtype *qcolumn = &qtuples[attr[m]*VBLOCK_SIZE + t];
+					__m256 _ws = _mm256_set1_ps(ew[m]*this->qscale[attr[m]]);
+					lb00 = _mm256_add_ps(lb00,_mm256_mul_ps(qload_ps(qcolumn),_ws));
+					lb01 = _mm256_add_ps(lb01,_mm256_mul_ps(qload_ps(qcolumn + 8),_ws));
+				}
+				if(STATS_EFF) this->tuple_count+=16;
+				__m256 _thr = _mm256_set1_ps(thr - delta);
+				uint32_t mask = _mm256_movemask_ps(_mm256_cmp_ps(lb00,_thr,_CMP_GE_OQ));
+				mask |= _mm256_movemask_ps(_mm256_cmp_ps(lb01,_thr,_CMP_GE_OQ)) << 8;
+				if(mask == 0) continue;
+
+				_mm256_store_ps(&lb[0],lb00);
+				_mm256_store_ps(&lb[8],lb01);
+				while(mask){
+					uint32_t l = __builtin_ctz(mask);
+					mask &= mask - 1;
+					if(t + l >= tuple_num) break;
+					if(lb[l] + delta < thr) continue;
+					cand.push_back(tuple_<T,Z>(id + t + l,lb[l] + delta));
+					cpos.push_back(&tuples[t + l]);
+					if(lq.size() < k){
+						lq.push(lb[l]);
+					}else if(lq.top() < lb[l]){
+						lq.pop(); lq.push(lb[l]);
+					}
+					if(lq.size() >= k) thr = lq.top();
+				}
 			}
-			q[m].pop();
+
+			T threshold = 0;
+			threshold+=topk_bound<T>(parts[i].blocks[b],qq,weights,attr);
+			if(lq.size() >= k && thr - QSLACK >= threshold) break;
+		}
+	}
+
+	//Refine candidates with exact scores
+	std::priority_queue<T, std::vector<tuple_<T,Z>>, PQComparison<T,Z>> q;
+	for(uint64_t c = 0; c < cand.size(); c++){
+		if(cand[c].score < thr) continue;
+		T *tuple = cpos[c];
+		T score = 0;
+		for(uint8_t m = 0; m < qq; m++){
+			score+= tuple[attr[m]*VBLOCK_SIZE] * weights[attr[m]];
+			#if LD == 2
+				score/=qq;
+			#endif
+		}
+		if(q.size() < k){
+			q.push(tuple_<T,Z>(cand[c].tid,score));
+		}else if(q.top().score < score){
+			q.pop(); q.push(tuple_<T,Z>(cand[c].tid,score));
 		}
 	}
 	this->tt_processing += this->t.lap();
 
-	if(STATS_EFF){ for(uint32_t i = 0; i < threads; i++) this->tuple_count +=tt_count[i]; }
-	T threshold = _q.top().score;
-	while(!_q.empty()){
-		//std::cout << this->algo <<" : " << q.top().tid << "," << q.top().score << std::endl;
-		this->res.push_back(_q.top());
-		_q.pop();
+	while(q.size() > k){ q.pop(); }
+	T threshold = q.top().score;
+	while(!q.empty()){
+		this->res.push_back(q.top());
+		q.pop();
 	}
 	std::cout << std::fixed << std::setprecision(4);
 	std::cout << " threshold=[" << threshold <<"] (" << this->res.size() << ")" << std::endl;
@@ -0,0 +1,12 @@
+/*
+ * One width of the CPU benchmarks, compiled with -DNUM_DIMS=<d> -DDIMS_NS=dims_<d> (see cpu/dims.h)
+ */
+
+#include "dims.h"
+
+namespace DIMS_NS{
+	#include "../validation/bench_cpu.h"
+	#if NUM_DIMS <= SLA_MAX_DIMS
+		#include "../skyline/hybrid/hybrid.cpp"
+	#endif
+}
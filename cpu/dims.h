@@ -0,0 +1,56 @@
+#ifndef DIMS_H
+#define DIMS_H
+
+/*
+ * Runtime dimensionality. The aggregation algorithms keep their per-tuple arrays, block bounds and skyline
+ * masks sized by NUM_DIMS, so cpu/dims.cpp is compiled once per width in DIMS_WIDTHS, each copy in its own
+ * namespace (dims_<d>), and cpu/dispatch.cpp picks the copy matching -d at runtime.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include <cmath>
+#include <climits>
+#include <inttypes.h>
+#include <stdint.h>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <limits>
+#include <mutex>
+#include <atomic>
+#include <ratio>
+#include <ctime>
+#include <chrono>
+#include <parallel/algorithm>
+#include <omp.h>
+#include <immintrin.h>
+#include <tmmintrin.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+//Width independent headers, included once outside the per width namespaces
+#include "../time/Time.h"
+#include "../input/File.h"
+#include "AA.h"
+
+//Supported widths, keep in sync with DIMS_LIST in the Makefile
+#define DIMS_WIDTHS(X) X(2) X(3) X(4) X(5) X(6) X(7) X(8) X(9) X(10) X(11) X(12) X(13) X(14) X(15) X(16) X(32)
+#define DIMS_MAX 32
+
+#endif
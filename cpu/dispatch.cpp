@@ -0,0 +1,41 @@
+#include "dims.h"
+#include "../tools/ArgParser.h"
+
+//Weak, so widths left out of DIMS_LIST resolve to NULL and are reported at runtime
+#define DIMS_DECLARE(W) namespace dims_##W{ void bench_main(std::string fname, uint64_t n, uint64_t d) __attribute__((weak)); }
+DIMS_WIDTHS(DIMS_DECLARE)
+
+typedef void (*bench_main_t)(std::string, uint64_t, uint64_t);
+
+int main(int argc, char **argv){
+	ArgParser ap;
+	ap.parseArgs(argc,argv);
+	if(!ap.exists("-f")){
+		std::cout << "Missing file input!!!" << std::endl;
+		exit(1);
+	}
+
+	if(!ap.exists("-d")){
+		std::cout << "Missing d!!!" << std::endl;
+		exit(1);
+	}
+
+	if(!ap.exists("-n")){
+		std::cout << "Missing n!!!" << std::endl;
+		exit(1);
+	}
+
+	uint64_t n = ap.getInt("-n");
+	uint64_t d = ap.getInt("-d");
+
+	bench_main_t bench[DIMS_MAX+1] = { NULL };
+	#define DIMS_REGISTER(W) bench[W] = dims_##W::bench_main;
+	DIMS_WIDTHS(DIMS_REGISTER)
+	if(d > DIMS_MAX || bench[d] == NULL){
+		std::cout << "Unsupported d (build widths: DIMS_LIST in the Makefile)!!!" << std::endl;
+		exit(1);
+	}
+	bench[d](ap.getString("-f"),n,d);
+
+	return 0;
+}
@@ -0,0 +1,172 @@
+#ifndef INDEX_IO_H
+#define INDEX_IO_H
+
+/*
+ * Persistent block index layout shared by VTA, PTA and SLA
+ * [index_header][partition table: part_num x index_part][padding to INDEX_ALIGN][blocks of partition 0]...[blocks of partition part_num-1]
+ * Blocks are stored exactly as they are laid out in memory, so a mapped file can be queried in place.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define INDEX_MAGIC "TOPKINDX"
+#define INDEX_VERSION 4
+#define INDEX_ALIGN 4096
+
+#define INDEX_VTA 0
+#define INDEX_PTA 1
+#define INDEX_SLA 2
+
+struct index_header{
+	char magic[8];
+	uint32_t version;
+	uint32_t algo;
+	uint64_t n;
+	uint64_t d;
+	uint32_t dims;//NUM_DIMS used to size the blocks
+	uint32_t block_size;
+	uint32_t t_bytes;
+	uint32_t z_bytes;
+	uint64_t block_bytes;
+	uint64_t part_num;
+	uint64_t block_offset;//byte offset of the first block, multiple of INDEX_ALIGN
+};
+
+struct index_part{
+	uint64_t offset;
+	uint64_t size;
+	uint64_t block_num;
+};
+
+static inline bool index_exists(std::string fname){
+	struct stat st;
+	return stat(fname.c_str(),&st) == 0;
+}
+
+/*
+ * Write partitions and their blocks to fname
+ */
+template<class T, class Z, class P, class B>
+void save_index_file(std::string fname, uint32_t algo, uint64_t n, uint64_t d, uint32_t block_size, P *parts, uint64_t part_num){
+	index_header h;
+	memset(&h,0,sizeof(index_header));
+	memcpy(h.magic,INDEX_MAGIC,8);
+	h.version = INDEX_VERSION;
+	h.algo = algo;
+	h.n = n;
+	h.d = d;
+	h.dims = NUM_DIMS;
+	h.block_size = block_size;
+	h.t_bytes = sizeof(T);
+	h.z_bytes = sizeof(Z);
+	h.block_bytes = sizeof(B);
+	h.part_num = part_num;
+	uint64_t table_bytes = sizeof(index_header) + sizeof(index_part) * part_num;
+	h.block_offset = ((table_bytes - 1)/INDEX_ALIGN + 1) * INDEX_ALIGN;
+
+	FILE *f = fopen(fname.c_str(), "wb");
+	if (f == NULL) {
+		std::cout << "Error opening index file!!!!" << std::endl;
+		exit(1);
+	}
+	fwrite(&h,sizeof(index_header),1,f);
+	for(uint64_t i = 0; i < part_num; i++){
+		index_part p;
+		p.offset = parts[i].offset;
+		p.size = parts[i].size;
+		p.block_num = (parts[i].size == 0) ? 0 : parts[i].block_num;
+		fwrite(&p,sizeof(index_part),1,f);
+	}
+	std::vector<char> pad(h.block_offset - table_bytes, 0);
+	fwrite(pad.data(),sizeof(char),pad.size(),f);
+	for(uint64_t i = 0; i < part_num; i++){
+		if(parts[i].size == 0) continue;
+		fwrite(parts[i].blocks,sizeof(B),parts[i].block_num,f);
+	}
+	fclose(f);
+}
+
+/*
+ * Map fname and validate it against the current build configuration.
+ * Returns the mapped region; the partition table starts right after the header.
+ */
+template<class T, class Z, class B>
+char* map_index_file(std::string fname, uint32_t algo, uint64_t n, uint64_t d, uint32_t block_size, index_header &h, uint64_t &bytes){
+	int fd = open(fname.c_str(), O_RDONLY);
+	if (fd < 0) {
+		std::cout << "Error opening index file!!!!" << std::endl;
+		exit(1);
+	}
+	struct stat st;
+	fstat(fd,&st);
+	bytes = st.st_size;
+	if(bytes < sizeof(index_header)){
+		std::cout << "Invalid index file!!!" << std::endl;
+		exit(1);
+	}
+	char *map = (char*)mmap(NULL, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED){
+		std::cout << "Error mapping index file!!!" << std::endl;
+		exit(1);
+	}
+
+	memcpy(&h,map,sizeof(index_header));
+	if(memcmp(h.magic,INDEX_MAGIC,8) != 0 || h.version != INDEX_VERSION){
+		std::cout << "Invalid index file or unsupported version!!!" << std::endl;
+		exit(1);
+	}
+	if(h.algo != algo || h.n != n || h.d != d || h.dims != NUM_DIMS || h.block_size != block_size ||
+			h.t_bytes != sizeof(T) || h.z_bytes != sizeof(Z) || h.block_bytes != sizeof(B)){
+		std::cout << "Index file does not match current configuration!!!" << std::endl;
+		exit(1);
+	}
+
+	//partition table must fit in the file and end before the blocks
+	uint64_t table_end = sizeof(index_header) + h.part_num * sizeof(index_part);
+	if(h.part_num > (bytes - sizeof(index_header))/sizeof(index_part) || h.block_offset < table_end || h.block_offset > bytes){
+		std::cout << "Index file truncated!!!" << std::endl;
+		exit(1);
+	}
+
+	uint64_t max_blocks = (bytes - h.block_offset)/sizeof(B);
+	uint64_t total_blocks = 0;
+	index_part *ip = (index_part*)(map + sizeof(index_header));
+	for(uint64_t i = 0; i < h.part_num; i++){
+		if(ip[i].block_num > max_blocks - total_blocks){
+			std::cout << "Index file truncated!!!" << std::endl;
+			exit(1);
+		}
+		total_blocks+=ip[i].block_num;
+	}
+	return map;
+}
+
+/*
+ * Point partitions to their blocks inside the mapped region
+ */
+template<class P, class B>
+void assign_index_parts(char *map, const index_header &h, P *parts){
+	index_part *ip = (index_part*)(map + sizeof(index_header));
+	B *blocks = (B*)(map + h.block_offset);
+	for(uint64_t i = 0; i < h.part_num; i++){
+		parts[i].offset = ip[i].offset;
+		parts[i].size = ip[i].size;
+		parts[i].block_num = ip[i].block_num;
+		parts[i].blocks = blocks;
+		blocks+=ip[i].block_num;
+	}
+}
+
+#endif
@@ -41,12 +41,7 @@ int main(int argc, char **argv){
 //		nl = ap.getInt("-nl");
 //	}
 
-	if (TA_B == 1){ bench_ta(ap.getString("-f"),n,d,KKS,KKE); }
-	if (TPAr_B == 1){ bench_tpar(ap.getString("-f"),n,d,KKS,KKE); }
-	if (TPAc_B == 1){ bench_tpac(ap.getString("-f"),n,d,KKS,KKE);	}
-	if (VTA_B == 1){ bench_vta(ap.getString("-f"),n,d,KKS,KKE); }
-	if (PTA_B == 1){ bench_pta(ap.getString("-f"),n,d,KKS,KKE); }
-	if (SLA_B == 1){ bench_sla(ap.getString("-f"),n,d,KKS,KKE); }
+	bench_main(ap.getString("-f"),n,d);
 
 	return 0;
 }
@@ -0,0 +1,80 @@
+#ifndef QUANT_H
+#define QUANT_H
+
+/*
+ * Fixed point (8/16-bit) column storage.
+ * Each attribute keeps a minimum and a scale so that qmin + q*qscale <= v <= qmin + (q+1)*qscale.
+ * Scans over quantized columns produce lower/upper score bounds; only candidates whose upper
+ * bound reaches the k-th largest lower bound are rescored from the float columns.
+ */
+
+#include <immintrin.h>
+#include <cstdint>
+#include <cmath>
+
+#ifndef QBITS
+#define QBITS 0
+#endif
+
+#if QBITS == 8
+	typedef uint8_t qtype;
+	#define QLEVELS 255
+#else
+	typedef uint16_t qtype;
+	#define QLEVELS 65535
+#endif
+#define QSLACK 1e-5//absorbs float rounding between bounds and exact scores
+
+template<class T>
+static inline void quant_params(T vmin, T vmax, T &qmin, T &qscale){
+	qmin = vmin;
+	qscale = (vmax - vmin)/QLEVELS;
+	if(qscale <= 0) qscale = 1;
+}
+
+template<class T>
+static inline qtype quantize(T v, T qmin, T qscale){
+	T l = (v - qmin)/qscale;
+	if(l <= 0) return 0;
+	if(l >= QLEVELS) return QLEVELS;
+	return (qtype)l;
+}
+
+//Load 8 quantized values and widen them to float
+static inline __m256 qload_ps(const qtype *p){
+#if QBITS == 8
+	return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)p)));
+#else
+	return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)p)));
+#endif
+}
+
+/*
+ * Effective weight of each queried attribute (LD == 2 divides the running score by qq after every attribute)
+ */
+template<class T>
+static inline void quant_weights(uint8_t qq, T *weights, uint8_t *attr, T *ew){
+	for(uint8_t m = 0; m < qq; m++){
+		ew[m] = weights[attr[m]];
+		#if LD == 2
+			for(uint8_t j = m; j < qq; j++) ew[m]/=qq;
+		#endif
+	}
+}
+
+/*
+ * Score bounds of a quantized tuple: base + sum(ew[m]*qscale*q) is a lower bound and adding delta gives an upper
+ * bound. A negative weight reaches its lower bound at the top of the quantization interval.
+ */
+template<class T>
+static inline void quant_bounds(uint8_t qq, const T *ew, const uint8_t *attr, const T *qmin, const T *qscale, T &base, T &delta){
+	base = 0; delta = 0;
+	for(uint8_t m = 0; m < qq; m++){
+		base+=ew[m]*qmin[attr[m]];
+		if(ew[m] < 0) base+=ew[m]*qscale[attr[m]];
+		delta+=std::abs(ew[m])*qscale[attr[m]];
+	}
+	delta+=QSLACK;
+}
+
+#endif
@@ -0,0 +1,232 @@
+#ifndef CPU_RADIX_SELECT_H
+#define CPU_RADIX_SELECT_H
+
+/*
+ * Top-k of a score column by radix select (CPU port of gpu/radix_select.h), O(n) for any k.
+ * Scores are written as order preserving 32-bit keys (float bit pattern, sign handled) into a scratch
+ * column, 0 marks rows that do not qualify (filters, ceiling). Four passes of 8-bit digits, most significant
+ * first, build per thread histograms of the keys matching the digits chosen so far (AVX2 key, digit and
+ * prefix extraction) and narrow down the key of the k-th largest score; one more pass compacts the winners.
+ */
+
+#include "TopK.h"
+
+#ifndef RADIX_MIN_K
+	#define RADIX_MIN_K 32768 //TPAc/TPAr query() use radix select once the heap entries of all threads (k per thread) reach RADIX_MIN_K
+#endif
+#define RADIX_BITS 8
+#define RADIX_BINS (1 << RADIX_BITS)
+#define RADIX_COMPACT 8 //compact the keys matching the chosen digits once they are at most 1/RADIX_COMPACT of the scanned ones
+
+static inline uint32_t radix_key(float v){
+	union { float f; uint32_t i; } u = { v };
+	return (u.i & 0x80000000) ? ~u.i : (u.i | 0x80000000);
+}
+
+static inline float radix_value(uint32_t key){
+	union { uint32_t i; float f; } u = { (key & 0x80000000) ? (key & 0x7FFFFFFF) : ~key };
+	return u.f;
+}
+
+static inline __m256i radix_key_ps(__m256 v){
+	__m256i vi = _mm256_castps_si256(v);
+	__m256i sign = _mm256_srai_epi32(vi,31);//all ones for negative scores
+	return _mm256_xor_si256(vi,_mm256_or_si256(sign,_mm256_set1_epi32(0x80000000)));
+}
+
+/*
+ * Keys of rows [first,last) of a column-major table (n rows), 0 for rows outside the filters or above the ceiling
+ */
+template<class T, class S = TopKSum<T>>
+static inline void radix_score_columns(const T *cdata, uint64_t n, uint64_t first, uint64_t last, const TopKQuery<T> &query, uint32_t *keys, const S &fn = S()){
+	T score[16];
+	__m256 ceiling = _mm256_set1_ps(query.ceiling);
+	uint64_t i = first;
+	for(; i + 16 <= last; i+=16){
+		topk_score16<T,S>(&cdata[i],n,query,score,fn);
+		uint32_t pass = topk_filter16<T>(&cdata[i],n,query);
+		for(uint8_t h = 0; h < 2; h++){
+			__m256 s = _mm256_loadu_ps(&score[h*8]);
+			__m256i mask = _mm256_castps_si256(_mm256_cmp_ps(s,ceiling,_CMP_LE_OQ));
+			uint32_t p = (pass >> (h*8)) & 0xFF;
+			__m256i lanes = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(p),_mm256_setr_epi32(1,2,4,8,16,32,64,128)),_mm256_setzero_si256());
+			mask = _mm256_andnot_si256(lanes,mask);
+			_mm256_storeu_si256((__m256i*)&keys[i + h*8],_mm256_and_si256(radix_key_ps(s),mask));
+		}
+	}
+	for(; i < last; i++){
+		T s = topk_score<T,S>(&cdata[i],n,query,fn);
+		keys[i] = (topk_pass<T>(&cdata[i],n,query) && s <= query.ceiling) ? radix_key(s) : 0;
+	}
+}
+
+/*
+ * Keys of rows [first,last) of a row-major table (d attributes per row)
+ */
+template<class T>
+static inline void radix_score_rows(const T *cdata, uint64_t d, uint64_t first, uint64_t last, const TopKQuery<T> &query, uint32_t *keys){
+	for(uint64_t i = first; i < last; i++){
+		const T *tuple = &cdata[i*d];
+		T s = topk_score<T>(tuple,1,query);
+		keys[i] = (topk_pass<T>(tuple,1,query) && s <= query.ceiling) ? radix_key(s) : 0;
+	}
+}
+
+//Radix select instead of per thread heaps, whose cost grows with k and the thread count
+template<class T>
+static inline bool radix_query(const TopKQuery<T> &query){
+	uint64_t threads = query.policy == TOPK_PARALLEL ? std::max((uint32_t)1,query.threads) : 1;
+	return query.k*threads >= RADIX_MIN_K;
+}
+
+//First row of chunk c when n rows are split into chunks equal parts
+static inline uint64_t radix_first(uint64_t n, uint32_t chunks, uint32_t c){ return ((uint64_t)c)*n/chunks; }
+
+/*
+ * Histogram of digit (key >> shift) & 0xFF over the nonzero keys of [first,last) with (key & pmask) == prefix.
+ * Lanes count into 4 interleaved copies, scores cluster in few digits and a single counter would serialize the increments.
+ */
+static inline void radix_histogram(const uint32_t *keys, uint64_t first, uint64_t last, uint32_t prefix, uint32_t pmask, uint32_t shift, uint64_t *bins){
+	uint32_t digits[8] __attribute__((aligned(32)));
+	uint32_t h[4][RADIX_BINS] = {{0}};
+	__m256i _prefix = _mm256_set1_epi32(prefix);
+	__m256i _pmask = _mm256_set1_epi32(pmask);
+	__m256i _dmask = _mm256_set1_epi32(RADIX_BINS - 1);
+	__m128i _shift = _mm_cvtsi32_si128(shift);
+	uint64_t i = first;
+	while(i + 8 <= last){
+		uint64_t end = std::min(last,i + ((uint64_t)1 << 30));//keep the 32-bit counters from overflowing
+		for(; i + 8 <= end; i+=8){
+			__m256i key = _mm256_loadu_si256((const __m256i*)&keys[i]);
+			__m256i match = _mm256_cmpeq_epi32(_mm256_and_si256(key,_pmask),_prefix);
+			match = _mm256_andnot_si256(_mm256_cmpeq_epi32(key,_mm256_setzero_si256()),match);
+			uint32_t m = _mm256_movemask_ps(_mm256_castsi256_ps(match));
+			if(m == 0) continue;
+			_mm256_store_si256((__m256i*)digits,_mm256_and_si256(_mm256_srl_epi32(key,_shift),_dmask));
+			if(m == 0xFF){
+				h[0][digits[0]]++; h[1][digits[1]]++; h[2][digits[2]]++; h[3][digits[3]]++;
+				h[0][digits[4]]++; h[1][digits[5]]++; h[2][digits[6]]++; h[3][digits[7]]++;
+				continue;
+			}
+			while(m){
+				uint32_t l = __builtin_ctz(m);
+				h[l & 3][digits[l]]++;
+				m&=m - 1;
+			}
+		}
+		for(uint32_t d = 0; d < RADIX_BINS; d++){
+			bins[d]+=h[0][d] + h[1][d] + h[2][d] + h[3][d];
+			h[0][d] = h[1][d] = h[2][d] = h[3][d] = 0;
+		}
+	}
+	for(; i < last; i++){
+		if(keys[i] != 0 && (keys[i] & pmask) == prefix) bins[(keys[i] >> shift) & (RADIX_BINS - 1)]++;
+	}
+}
+
+/*
+ * Key of the k-th largest nonzero key, 0 when at most k keys are nonzero (all of them qualify).
+ * Once few keys match the chosen digits they are compacted so that the remaining passes only read those.
+ */
+static inline uint32_t radix_select_findK(const uint32_t *keys, uint64_t n, uint64_t k, uint32_t threads){
+	std::vector<uint64_t> tbins(((uint64_t)threads)*RADIX_BINS);
+	std::vector<uint32_t> cand[2];//compacted keys matching the prefix
+	const uint32_t *src = keys;
+	uint64_t m = n;
+	uint32_t prefix = 0;
+	uint32_t pmask = 0;
+	uint64_t kk = k;//rank of the k-th largest among the keys matching prefix
+	for(int32_t shift = 32 - RADIX_BITS; shift >= 0; shift-=RADIX_BITS){
+		std::fill(tbins.begin(),tbins.end(),0);
+		#pragma omp parallel num_threads(threads)
+		{
+			for(uint32_t c = omp_get_thread_num(); c < threads; c+=omp_get_num_threads()){
+				radix_histogram(src,radix_first(m,threads,c),radix_first(m,threads,c+1),prefix,pmask,shift,&tbins[((uint64_t)c)*RADIX_BINS]);
+			}
+		}
+		uint64_t bins[RADIX_BINS];
+		uint64_t total = 0;
+		for(uint32_t d = 0; d < RADIX_BINS; d++){
+			bins[d] = 0;
+			for(uint32_t t = 0; t < threads; t++) bins[d]+=tbins[((uint64_t)t)*RADIX_BINS + d];
+			total+=bins[d];
+		}
+		if(pmask == 0 && total <= k) return 0;
+
+		uint32_t digit = 0;
+		uint64_t above = 0;
+		for(int32_t d = RADIX_BINS - 1; d >= 0; d--){
+			if(above + bins[d] >= kk){ digit = d; break; }
+			above+=bins[d];
+		}
+		kk-=above;
+		prefix|=digit << shift;
+		pmask|=(RADIX_BINS - 1) << shift;
+		if(shift == 0 || bins[digit] > m/RADIX_COMPACT) continue;
+
+		//Chunk c of the compacted keys starts after the matches of the chunks before it
+		std::vector<uint64_t> offset(threads + 1,0);
+		for(uint32_t t = 0; t < threads; t++) offset[t+1] = offset[t] + tbins[((uint64_t)t)*RADIX_BINS + digit];
+		std::vector<uint32_t> &dst = cand[src == cand[0].data() ? 1 : 0];
+		dst.resize(bins[digit]);
+		#pragma omp parallel num_threads(threads)
+		{
+			for(uint32_t c = omp_get_thread_num(); c < threads; c+=omp_get_num_threads()){
+				uint64_t o = offset[c];
+				for(uint64_t i = radix_first(m,threads,c); i < radix_first(m,threads,c+1); i++){
+					if(src[i] != 0 && (src[i] & pmask) == prefix) dst[o++] = src[i];
+				}
+			}
+		}
+		src = dst.data();
+		m = bins[digit];
+	}
+	return prefix;
+}
+
+/*
+ * Top-k of the key column into out (capacity k) in descending score order, return the number of tuples written.
+ * Keys above the k-th are taken, ties with it fill the remaining slots in row order.
+ */
+template<class T, class Z>
+static inline uint64_t radix_select_topk(const uint32_t *keys, uint64_t n, uint64_t k, uint32_t threads, tuple_<T,Z> *out){
+	static_assert(sizeof(T) == sizeof(uint32_t), "Radix select works on 32-bit float scores");
+	if(k == 0 || n == 0) return 0;
+	threads = std::max((uint32_t)1,threads);
+	uint32_t kth = radix_select_findK(keys,n,k,threads);
+
+	std::vector<uint64_t> above(threads + 1,0);
+	std::vector<uint64_t> ties(threads + 1,0);
+	#pragma omp parallel num_threads(threads)
+	{
+		for(uint32_t c = omp_get_thread_num(); c < threads; c+=omp_get_num_threads()){
+			uint64_t a = 0, t = 0;
+			for(uint64_t i = radix_first(n,threads,c); i < radix_first(n,threads,c+1); i++){ a+=(keys[i] > kth); t+=(keys[i] == kth); }
+			above[c+1] = a;
+			ties[c+1] = kth != 0 ? t : 0;
+		}
+	}
+	for(uint32_t t = 0; t < threads; t++){ above[t+1]+=above[t]; ties[t+1]+=ties[t]; }
+	uint64_t need = std::min(k,above[threads] + ties[threads]) - above[threads];//ties taken
+
+	#pragma omp parallel num_threads(threads)
+	{
+		for(uint32_t c = omp_get_thread_num(); c < threads; c+=omp_get_num_threads()){
+			uint64_t a = above[c];
+			uint64_t t = std::min(ties[c],need);
+			uint64_t tlast = std::min(ties[c+1],need);
+			for(uint64_t i = radix_first(n,threads,c); i < radix_first(n,threads,c+1); i++){
+				if(keys[i] > kth){
+					out[a++] = tuple_<T,Z>(i,radix_value(keys[i]));
+				}else if(keys[i] == kth && kth != 0 && t < tlast){
+					out[above[threads] + t++] = tuple_<T,Z>(i,radix_value(keys[i]));
+				}
+			}
+		}
+	}
+	uint64_t size = above[threads] + need;
+	std::sort(out,out + size,cmp_score<T,Z>);
+	return size;
+}
+
+#endif
@@ -0,0 +1,165 @@
+#ifndef SCORE_H
+#define SCORE_H
+
+/*
+ * Monotone scoring functions for the query kernels of TopK.h. A score folds one term per queried attribute:
+ *
+ *	acc = init(); for each attribute a: acc = combine(acc,term(a,x[a],w[a]))
+ *
+ * term is monotone in x (non-decreasing when increasing(a,w), non-increasing otherwise) and combine is
+ * non-decreasing in both arguments, so evaluating the score at the per attribute block bounds bounds the scores
+ * of the following tuples (topk_bound). Every functor has a scalar and an AVX (_ps) version of each step that
+ * produce the same values; kernels are instantiated per functor, so there is no per-tuple dispatch.
+ */
+
+#include <immintrin.h>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <algorithm>
+
+/*
+ * Weighted sum (the default)
+ */
+template<class T>
+struct TopKSum{
+	inline T init() const{ return 0; }
+	inline T term(uint8_t a, T x, T w) const{ return x*w; }
+	inline T combine(T acc, T v) const{ return acc + v; }
+	inline bool increasing(uint8_t a, T w) const{ return w >= 0; }
+
+	inline __m256 init_ps() const{ return _mm256_setzero_ps(); }
+	inline __m256 term_ps(uint8_t a, __m256 x, __m256 w) const{ return _mm256_mul_ps(x,w); }
+	inline __m256 combine_ps(__m256 acc, __m256 v) const{ return _mm256_add_ps(acc,v); }
+};
+
+/*
+ * Weighted L_p norm raised to the p-th power, sum(w*x^P) (same ranking as the norm, no root per tuple).
+ * Attributes are normalized to [0,1], so x^P is non-decreasing.
+ */
+template<class T, uint32_t P>
+struct TopKLp : public TopKSum<T>{
+	inline T term(uint8_t a, T x, T w) const{
+		T p = x;
+		for(uint32_t i = 1; i < P; i++) p*=x;
+		return p*w;
+	}
+	inline __m256 term_ps(uint8_t a, __m256 x, __m256 w) const{
+		__m256 p = x;
+		for(uint32_t i = 1; i < P; i++) p = _mm256_mul_ps(p,x);
+		return _mm256_mul_ps(p,w);
+	}
+};
+
+/*
+ * Largest weighted attribute, max(w*x)
+ */
+template<class T>
+struct TopKMax : public TopKSum<T>{
+	inline T init() const{ return std::numeric_limits<T>::lowest(); }
+	inline T combine(T acc, T v) const{ return std::max(acc,v); }
+	inline __m256 init_ps() const{ return _mm256_set1_ps(std::numeric_limits<T>::lowest()); }
+	inline __m256 combine_ps(__m256 acc, __m256 v) const{ return _mm256_max_ps(acc,v); }
+};
+
+/*
+ * Smallest weighted attribute, min(w*x)
+ */
+template<class T>
+struct TopKMin : public TopKSum<T>{
+	inline T init() const{ return std::numeric_limits<T>::max(); }
+	inline T combine(T acc, T v) const{ return std::min(acc,v); }
+	inline __m256 init_ps() const{ return _mm256_set1_ps(std::numeric_limits<T>::max()); }
+	inline __m256 combine_ps(__m256 acc, __m256 v) const{ return _mm256_min_ps(acc,v); }
+};
+
+/*
+ * log2 from the float exponent and a polynomial on the mantissa, exact at powers of two and monotone,
+ * absolute error below 2e-4. 0 maps to -127.
+ */
+#define SCORE_LOG_C1 1.4380732f
+#define SCORE_LOG_C2 -0.6747667f
+#define SCORE_LOG_C3 0.3170007f
+#define SCORE_LOG_C4 (1.0f - SCORE_LOG_C1 - SCORE_LOG_C2 - SCORE_LOG_C3)
+
+static inline float score_log2(float x){
+	union { float f; uint32_t i; } u = { x };
+	float e = (float)((int32_t)(u.i >> 23) - 127);
+	u.i = (u.i & 0x007FFFFF) | 0x3F800000;
+	float t = u.f - 1.0f;
+	return e + t*(SCORE_LOG_C1 + t*(SCORE_LOG_C2 + t*(SCORE_LOG_C3 + t*SCORE_LOG_C4)));
+}
+
+static inline __m256 score_log2_ps(__m256 x){
+	__m256i xi = _mm256_castps_si256(x);
+	__m256 e = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(xi,23),_mm256_set1_epi32(127)));
+	__m256 t = _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(xi,_mm256_set1_epi32(0x007FFFFF)),_mm256_set1_epi32(0x3F800000)));
+	t = _mm256_sub_ps(t,_mm256_set1_ps(1.0f));
+	__m256 p = _mm256_set1_ps(SCORE_LOG_C4);
+	p = _mm256_add_ps(_mm256_mul_ps(p,t),_mm256_set1_ps(SCORE_LOG_C3));
+	p = _mm256_add_ps(_mm256_mul_ps(p,t),_mm256_set1_ps(SCORE_LOG_C2));
+	p = _mm256_add_ps(_mm256_mul_ps(p,t),_mm256_set1_ps(SCORE_LOG_C1));
+	return _mm256_add_ps(e,_mm256_mul_ps(p,t));
+}
+
+/*
+ * Weighted geometric mean in log space, sum(w*log2(x)) (same ranking as prod(x^w))
+ */
+template<class T>
+struct TopKGeo : public TopKSum<T>{
+	inline T term(uint8_t a, T x, T w) const{ return score_log2(x)*w; }
+	inline __m256 term_ps(uint8_t a, __m256 x, __m256 w) const{ return _mm256_mul_ps(score_log2_ps(x),w); }
+};
+
+/*
+ * Weighted sum of piecewise linear utilities, sum(w*u_a(x)). u_a interpolates K knots (x ascending,
+ * y non-decreasing) and is constant outside them; the default knots give u_a(x) = x on [0,1].
+ */
+template<class T, uint32_t K>
+struct TopKPiecewise : public TopKSum<T>{
+	TopKPiecewise(){
+		for(uint8_t a = 0; a < NUM_DIMS; a++){
+			T xs[K];
+			for(uint32_t j = 0; j < K; j++) xs[j] = ((T)j)/(K-1);
+			this->set_utility(a,xs,xs);
+		}
+	}
+
+	void set_utility(uint8_t a, const T *xs, const T *ys){
+		for(uint32_t j = 1; j < K; j++){
+			if(xs[j] <= xs[j-1] || ys[j] < ys[j-1]){
+				std::cout << "Utility knots must be ascending and non-decreasing!!!" << std::endl;
+				exit(1);
+			}
+		}
+		this->y0[a] = ys[0];
+		for(uint32_t j = 0; j + 1 < K; j++){
+			this->x0[a][j] = xs[j];
+			this->len[a][j] = xs[j+1] - xs[j];
+			this->slope[a][j] = (ys[j+1] - ys[j])/(xs[j+1] - xs[j]);
+		}
+	}
+
+	inline T term(uint8_t a, T x, T w) const{
+		T u = this->y0[a];
+		for(uint32_t j = 0; j + 1 < K; j++) u+=this->slope[a][j]*std::min(std::max(x - this->x0[a][j],(T)0),this->len[a][j]);
+		return u*w;
+	}
+	inline __m256 term_ps(uint8_t a, __m256 x, __m256 w) const{
+		__m256 u = _mm256_set1_ps(this->y0[a]);
+		for(uint32_t j = 0; j + 1 < K; j++){
+			__m256 s = _mm256_sub_ps(x,_mm256_set1_ps(this->x0[a][j]));
+			s = _mm256_min_ps(_mm256_max_ps(s,_mm256_setzero_ps()),_mm256_set1_ps(this->len[a][j]));
+			u = _mm256_add_ps(u,_mm256_mul_ps(s,_mm256_set1_ps(this->slope[a][j])));
+		}
+		return _mm256_mul_ps(u,w);
+	}
+
+	T y0[NUM_DIMS];
+	T x0[NUM_DIMS][K-1];
+	T len[NUM_DIMS][K-1];
+	T slope[NUM_DIMS][K-1];
+};
+
+#endif
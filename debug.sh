@@ -68,6 +68,30 @@ MQTHREADS=16
 STATS_EFF=false
 #Choose workload for multi-query evaluation
 WORKLOAD=$((1024*128))
+#Persist and reuse VTA/PTA/SLA indexes (LD=0 or real data only)
+IDX=0
+#Seed for in-memory generation, 0:time based
+SEED=0
+#Stream TPAc input from a binary snapshot instead of loading it (LD=0 or real data only)
+STREAM=0
+#Quantized TPAc columns and VTA blocks scanned before exact rescoring (IMP=1), 0:float only, 8/16:bits per value
+QBITS=0
+#Normalize while loading from file and skip it in init() (LD=0 or real data only)
+FNORM=0
+#Tuple id width, 32:uint32_t ids for tables below 4B rows, 64:uint64_t ids
+TID=64
+#Radix select top-k in the TPAc/TPAr benchmarks instead of a heap (IMP=1/2)
+RADIX=0
+#Range filter on the first attribute for BATCH/PLAN/PAGE queries, percent of its range kept (0:disabled)
+FILTER=0
+#Page through VTA/PTA/SLA results with a cursor, tuples per page (0:disabled)
+PAGE=0
+#Serve planner queries (PLAN=1) through the top-k result cache
+CACHE=0
+#Queries per shared TPAc scan (WORKLOAD random weight vectors), 0:disabled
+BATCH=0
+#Route queries through the cost based planner over the enabled TPAc/VTA/PTA/SLA
+PLAN=0
 
 if [ ! -z $1 ]
 then
@@ -81,6 +105,8 @@ TA_B=0
 TPAc_B=0
 #TPAr Benchmark
 TPAr_B=0
+#BTA Benchmark
+BTA_B=0
 #VTA Benhmark
 VTA_B=0
 #PTA Benchmark
@@ -94,7 +120,7 @@ SLA_B=0
 ####################################
 if [ $device -eq 0 ]
 then
-	make cpu_cc DIMS=$DIMS QM=$QM QD=$QD IMP=$IMP ITER=$ITER LD=$LD DISTR=$DSTR TA_B=$TA_B TPAc_B=$TPAc_B TPAr_B=$TPAr_B VTA_B=$VTA_B PTA_B=$PTA_B SLA_B=$SLA_B KKS=$KKS KKE=$KKE MQTHREADS=$MQTHREADS STATS_EFF=$STATS_EFF WORKLOAD=$WORKLOAD
+	make cpu_cc DIMS=$DIMS QM=$QM QD=$QD IMP=$IMP ITER=$ITER LD=$LD DISTR=$DSTR TA_B=$TA_B TPAc_B=$TPAc_B TPAr_B=$TPAr_B BTA_B=$BTA_B VTA_B=$VTA_B PTA_B=$PTA_B SLA_B=$SLA_B KKS=$KKS KKE=$KKE MQTHREADS=$MQTHREADS STATS_EFF=$STATS_EFF WORKLOAD=$WORKLOAD IDX=$IDX STREAM=$STREAM QBITS=$QBITS FNORM=$FNORM SEED=$SEED PLAN=$PLAN BATCH=$BATCH CACHE=$CACHE PAGE=$PAGE FILTER=$FILTER TID=$TID RADIX=$RADIX
 else
 	make gpu_cc DIMS=$DIMS QM=$QM QD=$QD IMP=$IMP ITER=$ITER LD=$LD DISTR=$DSTR KKS=$KKS KKE=$KKE STATS_EFF=$STATS_EFF WORKLOAD=$WORKLOAD
 fi
@@ -6,14 +6,58 @@
 #include <iostream>
 #include <cstdint>
 #include <cstring>
+#include <cmath>
+#include <vector>
+#include <limits>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <omp.h>
+#include <immintrin.h>
 
 #include "../time/Time.h"
+#include "../common/common.h"
 #include "randdataset-1.1.0/src/randdataset.h"
 
+/*
+ * Binary column-major snapshot layout
+ * [snap_header][min: d x T][max: d x T][padding to SNAP_ALIGN][column 0: n x T]...[column d-1: n x T]
+ */
+#define SNAP_MAGIC "TOPKSNAP"
+#define SNAP_VERSION 1
+#define SNAP_ALIGN 4096
+
+#define SNAP_DTYPE_FLOAT 0
+#define SNAP_DTYPE_UINT64 1
+
+#define FILE_THREADS 16 //CSV PARSING THREADS
+#define FILE_SLICE (64*1024) //values copied and normalized per task when loading a snapshot
+#ifndef STREAM_WINDOW
+#define STREAM_WINDOW (1 << 20)//rows per window when streaming from a snapshot
+#endif
+#ifndef GEN_SEED
+#define GEN_SEED 0 //in-memory generation seed, 0 picks a time based seed
+#endif
+
+struct snap_header{
+	char magic[8];
+	uint32_t version;
+	uint32_t dtype;
+	uint64_t n;
+	uint64_t d;
+	uint64_t normalized;
+	uint64_t data_offset;//byte offset of the first column, multiple of SNAP_ALIGN
+};
+
+template<class T>
+static uint32_t snap_dtype(){ return std::is_same<T,float>::value ? SNAP_DTYPE_FLOAT : SNAP_DTYPE_UINT64; }
+
 template<class T>
 class File{
 	public:
-		File(){}
+		File(){ this->sfd=-1; this->fuse_norm=false; }
 		File(std::string fname,bool gpu, uint64_t n, uint64_t d){
 			this->fname = fname;
 			this->delimiter=',';
@@ -22,6 +66,9 @@ class File{
 			this->d = d;
 			this->gpu=gpu;
 			this->packed=false;
+			this->normalized=false;
+			this->fuse_norm=false;
+			this->sfd=-1;
 		}
 
 		File(std::string fname,bool gpu){
@@ -31,6 +78,9 @@ class File{
 			this->count();
 			this->gpu=gpu;
 			this->packed=false;
+			this->normalized=false;
+			this->fuse_norm=false;
+			this->sfd=-1;
 		}
 		File(std::string fname,char delimiter,bool transpose,bool gpu){
 			this->fname=fname;
@@ -39,21 +89,41 @@ class File{
 			this->count();
 			this->gpu=gpu;
 			this->packed=false;
+			this->normalized=false;
+			this->fuse_norm=false;
+			this->sfd=-1;
 		}
 
 		~File(){
 			//if(this->data!=NULL && !this->gpu){ free(data); this->data = NULL; }
+			this->close_stream();
 		}
 
 		void load();
 		void load(T *&data);
 		void gen(T *&data, int8_t type);
+		void gen(T *&data, int8_t type, uint64_t seed);
 
 		void store(std::string fname, T *data);
+		void store_snapshot(std::string fname, T *data, bool normalized);
 		uint64_t items(){return this->d;}
 		uint64_t rows(){return this->n;}
 		T* get_dt(){ return this->data; }
 		void set_transpose(bool transpose){ this->transpose = transpose; }
+		bool is_snapshot();
+		bool is_normalized(){ return this->normalized; }
+		void set_normalize(bool fuse_norm){ this->fuse_norm = fuse_norm; }//min-max normalize while loading
+		T* get_min(){ return this->mmin.data(); }
+		T* get_max(){ return this->mmax.data(); }
+		//newline aligned chunk byte offsets and the first row of each chunk (FILE_THREADS+1 entries)
+		const std::vector<uint64_t>& get_chunk_offsets(){ return this->chunk_offsets; }
+		const std::vector<uint64_t>& get_chunk_rows(){ return this->chunk_rows; }
+
+		//windowed access to snapshot columns without loading the whole table
+		void open_stream();
+		void read_window(T *buf, uint64_t first, uint64_t rows, uint64_t stride, uint8_t qq, uint8_t *attr);
+		void read_window_norm(T *buf, uint64_t first, uint64_t rows, uint64_t stride, uint8_t qq, uint8_t *attr);
+		void close_stream();
 
 		//testing
 		void sample(){ this->sample(10); };
@@ -64,7 +134,11 @@ class File{
 		void line_specifier();
 		void read_scanf();
 		void read_scanf_t();
+		bool read_parallel();
+		void index_rows(const char *map, uint64_t size);
 		void write_printf_t();
+		void read_snapshot();
+		void read_snapshot_header(snap_header &h);
 		int fetch(T *&p, uint64_t d, FILE *f);
 		void flush(T *&p, uint64_t d, FILE *f);
 
@@ -82,6 +156,17 @@ class File{
 		bool transpose;
 		bool gpu;
 		bool packed;
+
+		bool normalized;
+		bool fuse_norm;
+		std::vector<T> mmin;
+		std::vector<T> mmax;
+
+		int sfd;
+		uint64_t sdata_offset;
+
+		std::vector<uint64_t> chunk_offsets;
+		std::vector<uint64_t> chunk_rows;
 };
 
 template<class T>
@@ -107,25 +192,41 @@ void File<T>::line_specifier(){
 
 template<class T>
 void File<T>::count(){
-	FILE *fp = fopen(this->fname.c_str(), "r");
-	int size = 16*1024*1024;
-	int bytes = 0;
-	char *buffer = (char*) malloc (size);
-	this->d=0;
-	this->n=0;
+	if(this->is_snapshot()){
+		snap_header h;
+		this->read_snapshot_header(h);
+		this->n = h.n;
+		this->d = h.d;
+		return;
+	}
 
-	bytes = fread(buffer,sizeof(char),size, fp);
-	(this->d)++;
-	for(int i = 0; i < bytes; i++){//Count D
-		if( buffer[i] == ',' ) (this->d)++;
-		if( buffer[i] == '\n' ) break;
+	int fd = open(this->fname.c_str(), O_RDONLY);
+	if (fd < 0) {
+		std::cout << "Error opening file!!!!" << std::endl;
+		exit(1);
 	}
-	do{//Count N
-		for(int i = 0; i < bytes; i++) if( buffer[i] == '\n') (this->n)++;
-	}while( (bytes = fread(buffer,sizeof(char),size, fp)) > 0 );
+	struct stat st;
+	fstat(fd,&st);
+	uint64_t size = st.st_size;
+	this->d=1;
+	this->n=0;
+	if(size == 0){ close(fd); return; }
+	const char *map = (const char*)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if(map == MAP_FAILED){
+		std::cout << "Error mapping file!!!" << std::endl;
+		exit(1);
+	}
+	madvise((void*)map, size, MADV_SEQUENTIAL);
 
-	fclose(fp);
-	free(buffer);
+	const char *nl = (const char*)memchr(map, '\n', size);//Count D
+	const char *fend = (nl == NULL) ? map + size : nl;
+	for(const char *p = map; p < fend; p++) if( *p == this->delimiter ) (this->d)++;
+
+	this->index_rows(map,size);//Count N
+	this->n = this->chunk_rows.back();
+
+	munmap((void*)map, size);
+	close(fd);
 	//std::cout << "dim: (" << (this->n) << "," << (this->d) << ")"<<std::endl;
 }
 
@@ -150,6 +251,7 @@ int File<T>::fetch(T *&p, uint64_t d, FILE *f){
 			break;
 		case 7:
 			count = fscanf(f,this->fetch_row,&p[0],&p[1],&p[2],&p[3],&p[4],&p[5],&p[6]);
+			break;
 		case 8:
 			count = fscanf(f,this->fetch_row,&p[0],&p[1],&p[2],&p[3],&p[4],&p[5],&p[6],&p[7]);
 			break;
@@ -230,6 +332,200 @@ int File<T>::fetch(T *&p, uint64_t d, FILE *f){
 	return count;
 }
 
+static const double pow10_table[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/*
+ * Parse a decimal number ([+-]digits[.digits][(e|E)[+-]digits]) starting at p.
+ * Returns a pointer to the first character after the number (integral T skip the rest of the field up to delimiter).
+ */
+template<class T>
+static inline const char* parse_decimal(const char *p, const char *end, T &v, char delimiter){
+	while(p < end && (*p == ' ' || *p == '\t')) p++;
+	bool neg = false;
+	if(p < end && (*p == '-' || *p == '+')){ neg = (*p == '-'); p++; }
+
+	uint64_t mant = 0;
+	int32_t exp = 0;
+	uint32_t digits = 0;
+	while(p < end && (uint8_t)(*p - '0') < 10){
+		if(digits < 19){ mant = mant * 10 + (*p - '0'); digits+=(mant != 0); }else{ exp++; }
+		p++;
+	}
+	if(std::is_integral<T>::value){
+		v = (T)(neg ? -(int64_t)mant : mant);
+		while(p < end && *p != delimiter && *p != '\n' && *p != '\r') p++;
+		return p;
+	}
+
+	if(p < end && *p == '.'){
+		p++;
+		while(p < end && (uint8_t)(*p - '0') < 10){
+			if(digits < 19){ mant = mant * 10 + (*p - '0'); digits+=(mant != 0); exp--; }
+			p++;
+		}
+	}
+	if(p < end && (*p == 'e' || *p == 'E')){
+		p++;
+		bool eneg = false;
+		if(p < end && (*p == '-' || *p == '+')){ eneg = (*p == '-'); p++; }
+		int32_t e = 0;
+		while(p < end && (uint8_t)(*p - '0') < 10){ if(e < 100000) e = e * 10 + (*p - '0'); p++; }
+		exp += eneg ? -e : e;
+	}
+
+	double value = (double)mant;
+	if(exp < 0){
+		value = (-exp <= 22) ? value / pow10_table[-exp] : value / std::pow(10.0,-exp);
+	}else if(exp > 0){
+		value = (exp <= 22) ? value * pow10_table[exp] : value * std::pow(10.0,exp);
+	}
+	v = (T)(neg ? -value : value);
+	return p;
+}
+
+/*
+ * Count non-empty lines in [p,end) assuming p is at the beginning of a line.
+ * Newlines are located 32 bytes at a time (cmpeq + movemask); a newline that directly follows
+ * another newline (or the chunk start) terminates an empty line and is not counted.
+ */
+static inline uint64_t count_rows(const char *p, const char *end){
+	uint64_t rows = 0;
+	uint32_t prev = 1;
+	const __m256i nl = _mm256_set1_epi8('\n');
+	while(p + 32 <= end){
+		__m256i v = _mm256_loadu_si256((const __m256i*)p);
+		uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v,nl));
+		uint32_t empty = mask & ((mask << 1) | prev);
+		rows += _mm_popcnt_u32(mask) - _mm_popcnt_u32(empty);
+		prev = mask >> 31;
+		p+=32;
+	}
+	for(; p < end; p++){
+		if(*p == '\n'){ rows += (prev == 0); prev = 1; }else{ prev = 0; }
+	}
+	if(prev == 0) rows++;//last line without newline
+	return rows;
+}
+
+/*
+ * Split a mapped CSV file into FILE_THREADS newline aligned chunks and count their rows in parallel.
+ * chunk_rows[c] is the first row of chunk c; chunk_rows[FILE_THREADS] is the total number of rows.
+ */
+template<class T>
+void File<T>::index_rows(const char *map, uint64_t size){
+	uint32_t threads = FILE_THREADS;
+	this->chunk_offsets.assign(threads + 1, 0);
+	this->chunk_rows.assign(threads + 1, 0);
+	std::vector<uint64_t> &bounds = this->chunk_offsets;
+	bounds[threads] = size;
+	for(uint32_t c = 1; c < threads; c++){//Align chunk boundaries to the beginning of a line
+		uint64_t b = std::max(bounds[c-1], (size * c) / threads);
+		const char *nl = (b < size) ? (const char*)memchr(map + b, '\n', size - b) : NULL;
+		bounds[c] = (b == 0) ? 0 : (nl == NULL ? size : (nl - map) + 1);
+	}
+
+	std::vector<uint64_t> rows(threads, 0);
+#pragma omp parallel num_threads(threads)
+{
+	for(uint32_t c = omp_get_thread_num(); c < threads; c+=omp_get_num_threads()){
+		rows[c] = count_rows(map + bounds[c], map + bounds[c+1]);
+	}
+}
+	for(uint32_t c = 0; c < threads; c++) this->chunk_rows[c+1] = this->chunk_rows[c] + rows[c];
+}
+
+/*
+ * Parse a mapped CSV file in parallel. The file is split into FILE_THREADS newline aligned chunks, strided over the threads.
+ * Chunk row offsets are reused from count() when available, so each thread starts writing at its first
+ * row directly into the row-major or column-major (transpose) layout.
+ */
+template<class T>
+bool File<T>::read_parallel(){
+	int fd = open(this->fname.c_str(), O_RDONLY);
+	if (fd < 0) {
+		std::cout << "Error opening file!!!!" << std::endl;
+		exit(1);
+	}
+	struct stat st;
+	fstat(fd,&st);
+	uint64_t size = st.st_size;
+	if(size == 0){ close(fd); return true; }
+	const char *map = (const char*)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if(map == MAP_FAILED){ close(fd); return false; }
+	madvise((void*)map, size, MADV_SEQUENTIAL);
+
+	uint32_t threads = FILE_THREADS;
+	if(this->chunk_offsets.size() != threads + 1 || this->chunk_offsets[threads] != size) this->index_rows(map,size);
+	const std::vector<uint64_t> &bounds = this->chunk_offsets;
+	const std::vector<uint64_t> &first = this->chunk_rows;
+
+	uint64_t n = this->n;
+	uint64_t d = this->d;
+	char delimiter = this->delimiter;
+	bool transpose = this->transpose;
+	T *data = this->data;
+	bool fuse_norm = this->fuse_norm;
+	std::vector<T> tmin(threads * d, std::numeric_limits<T>::max());
+	std::vector<T> tmax(threads * d, std::numeric_limits<T>::lowest());
+	std::vector<T> mm(d);
+	this->mmin.assign(d, std::numeric_limits<T>::max());
+	this->mmax.assign(d, std::numeric_limits<T>::lowest());
+#pragma omp parallel num_threads(threads)
+{
+	for(uint32_t c = omp_get_thread_num(); c < threads; c+=omp_get_num_threads()){
+		const char *p = map + bounds[c];
+		const char *end = map + bounds[c+1];
+		uint64_t i = first[c];
+		T *vmin = &tmin[c*d];
+		T *vmax = &tmax[c*d];
+
+		while(p < end && i < n){
+			if(*p == '\n'){ p++; continue; }
+			for(uint64_t m = 0; m < d; m++){
+				T v = 0;
+				p = parse_decimal<T>(p, end, v, delimiter);
+				if(transpose){ data[m*n + i] = v; }else{ data[i*d + m] = v; }
+				vmin[m] = std::min(vmin[m],v);
+				vmax[m] = std::max(vmax[m],v);
+				if(p < end && *p == delimiter) p++;
+			}
+			while(p < end && *p != '\n') p++;
+			i++;
+		}
+	}
+
+	#pragma omp barrier
+	#pragma omp single
+	{
+		for(uint32_t t = 0; t < threads; t++){
+			for(uint64_t m = 0; m < d; m++){
+				this->mmin[m] = std::min(this->mmin[m],tmin[t*d + m]);
+				this->mmax[m] = std::max(this->mmax[m],tmax[t*d + m]);
+			}
+		}
+		for(uint64_t m = 0; m < d; m++) mm[m] = this->mmax[m] - this->mmin[m];
+	}
+	if(fuse_norm){//Scale the rows of the chunks of this thread while they are still in cache
+		for(uint32_t c = omp_get_thread_num(); c < threads; c+=omp_get_num_threads()){
+			uint64_t start = std::min(first[c],n);
+			uint64_t len = std::min(first[c+1],n) - start;
+			if(transpose){
+				for(uint64_t m = 0; m < d; m++) scale_column(&data[m*n + start],len,this->mmin[m],mm[m]);
+			}else{
+				scale_rows(&data[start*d],len,d,this->mmin.data(),mm.data());
+			}
+		}
+	}
+}
+	if(fuse_norm) this->normalized = true;
+	munmap((void*)map, size);
+	close(fd);
+	return true;
+}
+
 template<class T>
 void File<T>::read_scanf(){
 	FILE *f=NULL;
@@ -294,18 +590,128 @@ void File<T>::read_scanf_t(){
 	free(buffer);
 }
 
+template<class T>
+bool File<T>::is_snapshot(){
+	char magic[8];
+	FILE *f = fopen(this->fname.c_str(), "rb");
+	if (f == NULL) return false;
+	size_t bytes = fread(magic,sizeof(char),8,f);
+	fclose(f);
+	return bytes == 8 && memcmp(magic,SNAP_MAGIC,8) == 0;
+}
+
+template<class T>
+void File<T>::read_snapshot_header(snap_header &h){
+	FILE *f = fopen(this->fname.c_str(), "rb");
+	if (f == NULL) {
+		std::cout << "Error opening file!!!!" << std::endl;
+		exit(1);
+	}
+	if(fread(&h,sizeof(snap_header),1,f) != 1 || memcmp(h.magic,SNAP_MAGIC,8) != 0){
+		std::cout << "Invalid snapshot header!!!" << std::endl;
+		exit(1);
+	}
+	if(h.version != SNAP_VERSION){
+		std::cout << "Unsupported snapshot version (" << h.version << ")!!!" << std::endl;
+		exit(1);
+	}
+	if(h.dtype != snap_dtype<T>()){
+		std::cout << "Snapshot dtype does not match requested type!!!" << std::endl;
+		exit(1);
+	}
+	fclose(f);
+}
+
+/*
+ * Map snapshot and copy columns into the preallocated (aligned) data buffer
+ */
+template<class T>
+void File<T>::read_snapshot(){
+	snap_header h;
+	this->read_snapshot_header(h);
+	if(h.n != this->n || h.d != this->d){
+		std::cout << "Snapshot dimensions (" << h.n << "," << h.d << ") != (" << this->n << "," << this->d << ")!!!" << std::endl;
+		exit(1);
+	}
+
+	int fd = open(this->fname.c_str(), O_RDONLY);
+	struct stat st;
+	fstat(fd,&st);
+	if((uint64_t)st.st_size < h.data_offset + sizeof(T) * h.n * h.d){
+		std::cout << "Snapshot file truncated!!!" << std::endl;
+		exit(1);
+	}
+	char *map = (char*)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if(map == MAP_FAILED){
+		std::cout << "Error mapping snapshot!!!" << std::endl;
+		exit(1);
+	}
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+	this->normalized = (h.normalized != 0);
+	this->mmin.assign((T*)(map + sizeof(snap_header)), (T*)(map + sizeof(snap_header)) + this->d);
+	this->mmax.assign((T*)(map + sizeof(snap_header)) + this->d, (T*)(map + sizeof(snap_header)) + 2 * this->d);
+
+	T *cols = (T*)(map + h.data_offset);
+	uint64_t n = this->n;
+	uint64_t d = this->d;
+	if(this->fuse_norm && !this->normalized){//Scale each slice right after copying it
+		std::vector<T> mm(d);
+		for(uint64_t m = 0; m < d; m++) mm[m] = this->mmax[m] - this->mmin[m];
+		uint64_t slices = (n - 1)/FILE_SLICE + 1;
+		if (this->transpose){
+			#pragma omp parallel for schedule(dynamic)
+			for(uint64_t s = 0; s < d * slices; s++){
+				uint64_t m = s / slices;
+				uint64_t first = (s % slices) * FILE_SLICE;
+				uint64_t len = std::min((uint64_t)FILE_SLICE, n - first);
+				memcpy(&this->data[m*n + first], &cols[m*n + first], sizeof(T)*len);
+				scale_column(&this->data[m*n + first],len,this->mmin[m],mm[m]);
+			}
+		}else{
+			#pragma omp parallel for schedule(static)
+			for(uint64_t i = 0; i < n; i++){
+				for(uint64_t m = 0; m < d; m++){ this->data[i*d + m] = (cols[m*n + i] - this->mmin[m])/mm[m]; }
+			}
+		}
+		this->normalized = true;
+	}else if (this->transpose){
+		#pragma omp parallel for schedule(static)
+		for(uint64_t m = 0; m < d; m++){ memcpy(&this->data[m*n], &cols[m*n], sizeof(T)*n); }
+	}else{
+		#pragma omp parallel for schedule(static)
+		for(uint64_t i = 0; i < n; i++){
+			for(uint64_t m = 0; m < d; m++){ this->data[i*d + m] = cols[m*n + i]; }
+		}
+	}
+
+	munmap(map, st.st_size);
+	close(fd);
+}
+
 template<class T>
 void File<T>::load(){
 	this->data = (T*)malloc(sizeof(T) * (this->n) * (this->d));
 	//this->count();
-	this->line_specifier();
-
 	Time<msecs> t;
 	t.start();
-	if (!this->transpose){
-		this->read_scanf();
-	}else{
-		this->read_scanf_t();
+	if(this->is_snapshot()){
+		this->read_snapshot();
+		t.lap("Read elapsed time (ms)!!!");
+		return;
+	}
+	this->line_specifier();
+
+	if(!this->read_parallel()){//Fall back to fscanf for inputs that cannot be mapped
+		if (!this->transpose){
+			this->read_scanf();
+		}else{
+			this->read_scanf_t();
+		}
+		if(this->fuse_norm){
+			if (!this->transpose){ normalize<T,uint64_t>(this->data,this->n,this->d); }else{ normalize_transpose<T,uint64_t>(this->data,this->n,this->d); }
+			this->normalized = true;
+		}
 	}
 	t.lap("Read elapsed time (ms)!!!");
 }
@@ -319,20 +725,38 @@ void File<T>::load(T *& data){
 		data = static_cast<T*>(aligned_alloc(1024, sizeof(T) * (this->n) * (this->d)));
 	}
 	this->data=data;
+	if(this->is_snapshot()){
+		this->read_snapshot();
+		return;
+	}
 	this->line_specifier();
 
 	Time<msecs> t;
 	//t.start();
-	if (!this->transpose){
-		this->read_scanf();
-	}else{
-		this->read_scanf_t();
+	if(!this->read_parallel()){//Fall back to fscanf for inputs that cannot be mapped
+		if (!this->transpose){
+			this->read_scanf();
+		}else{
+			this->read_scanf_t();
+		}
+		if(this->fuse_norm){
+			if (!this->transpose){ normalize<T,uint64_t>(this->data,this->n,this->d); }else{ normalize_transpose<T,uint64_t>(this->data,this->n,this->d); }
+			this->normalized = true;
+		}
 	}
 	//t.lap("Read elapsed time (ms)!!!");
 }
 
 template<class T>
 void File<T>::gen(T *&data, int8_t type){
+	this->gen(data,type,GEN_SEED != 0 ? GEN_SEED : time(NULL));
+}
+
+/*
+ * Generate data in parallel; the output depends only on the seed, not on the number of threads
+ */
+template<class T>
+void File<T>::gen(T *&data, int8_t type, uint64_t seed){
 	if(data == NULL){
 		data = static_cast<T*>(aligned_alloc(32, sizeof(T) * (this->n) * (this->d)));
 	}
@@ -344,12 +768,12 @@ void File<T>::gen(T *&data, int8_t type){
 	}
 
 	if( type == 0 ){
-		generate_corr_inmem(this->data,this->n,this->d,this->transpose);
+		generate_corr_inmem(this->data,this->n,this->d,this->transpose,seed);
 	}else if ( type == 1 ){
-		generate_indep_inmem(this->data,this->n,this->d,this->transpose);
+		generate_indep_inmem(this->data,this->n,this->d,this->transpose,seed);
 	}else if ( type == 2 ){
 		std::cout << "Anticorrelated\n";
-		generate_anti_inmem(this->data,this->n,this->d,this->transpose);
+		generate_anti_inmem(this->data,this->n,this->d,this->transpose,seed);
 	}
 }
 
@@ -440,6 +864,134 @@ void File<T>::store(std::string fname, T * data){
 	}
 }
 
+/*
+ * Write data as a binary column-major snapshot together with the min/max of each attribute
+ */
+template<class T>
+void File<T>::store_snapshot(std::string fname, T *data, bool normalized){
+	this->data = data;
+	uint64_t n = this->n;
+	uint64_t d = this->d;
+
+	this->mmin.assign(d,std::numeric_limits<T>::max());
+	this->mmax.assign(d,std::numeric_limits<T>::lowest());
+	if (this->transpose){
+		#pragma omp parallel for schedule(dynamic)
+		for(uint64_t m = 0; m < d; m++) minmax_column(&data[m*n],n,this->mmin[m],this->mmax[m]);
+	}else{
+		minmax_rows(data,n,d,this->mmin.data(),this->mmax.data());
+	}
+	this->normalized = normalized;
+
+	snap_header h;
+	memset(&h,0,sizeof(snap_header));
+	memcpy(h.magic,SNAP_MAGIC,8);
+	h.version = SNAP_VERSION;
+	h.dtype = snap_dtype<T>();
+	h.n = n;
+	h.d = d;
+	h.normalized = normalized ? 1 : 0;
+	h.data_offset = ((sizeof(snap_header) + 2 * sizeof(T) * d - 1)/SNAP_ALIGN + 1) * SNAP_ALIGN;
+
+	FILE *f = fopen(fname.c_str(), "wb");
+	if (f == NULL) {
+		std::cout << "Error opening file!!!!" << std::endl;
+		exit(1);
+	}
+	fwrite(&h,sizeof(snap_header),1,f);
+	fwrite(this->mmin.data(),sizeof(T),d,f);
+	fwrite(this->mmax.data(),sizeof(T),d,f);
+	std::vector<char> pad(h.data_offset - sizeof(snap_header) - 2 * sizeof(T) * d, 0);
+	fwrite(pad.data(),sizeof(char),pad.size(),f);
+
+	if (this->transpose){
+		fwrite(data,sizeof(T),n*d,f);
+	}else{
+		T *column = (T*)malloc(sizeof(T) * n);
+		for(uint64_t m = 0; m < d; m++){
+			for(uint64_t i = 0; i < n; i++){ column[i] = data[i*d + m]; }
+			fwrite(column,sizeof(T),n,f);
+		}
+		free(column);
+	}
+	fclose(f);
+}
+
+/*
+ * Open snapshot for windowed reads. Only the header and min/max are loaded.
+ */
+template<class T>
+void File<T>::open_stream(){
+	if(!this->is_snapshot()){
+		std::cout << "Streaming requires a binary snapshot (see reorder_run -b)!!!" << std::endl;
+		exit(1);
+	}
+	snap_header h;
+	this->read_snapshot_header(h);
+	if(h.n != this->n || h.d != this->d){
+		std::cout << "Snapshot dimensions (" << h.n << "," << h.d << ") != (" << this->n << "," << this->d << ")!!!" << std::endl;
+		exit(1);
+	}
+	this->close_stream();
+	this->sfd = open(this->fname.c_str(), O_RDONLY);
+	if(this->sfd < 0){
+		std::cout << "Error opening file!!!!" << std::endl;
+		exit(1);
+	}
+	posix_fadvise(this->sfd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	this->mmin.resize(this->d);
+	this->mmax.resize(this->d);
+	if(pread(this->sfd, this->mmin.data(), sizeof(T) * this->d, sizeof(snap_header)) != (ssize_t)(sizeof(T) * this->d) ||
+			pread(this->sfd, this->mmax.data(), sizeof(T) * this->d, sizeof(snap_header) + sizeof(T) * this->d) != (ssize_t)(sizeof(T) * this->d)){
+		std::cout << "Snapshot file truncated!!!" << std::endl;
+		exit(1);
+	}
+	this->normalized = (h.normalized != 0);
+	this->sdata_offset = h.data_offset;
+}
+
+/*
+ * Read rows [first,first+rows) of columns attr[0..qq) into buf[m*stride].
+ * Hints the kernel to start fetching the following window of each column.
+ */
+template<class T>
+void File<T>::read_window(T *buf, uint64_t first, uint64_t rows, uint64_t stride, uint8_t qq, uint8_t *attr){
+	for(uint8_t m = 0; m < qq; m++){
+		char *dst = (char*)&buf[m*stride];
+		uint64_t bytes = sizeof(T) * rows;
+		off_t offset = this->sdata_offset + sizeof(T) * (attr[m] * this->n + first);
+		while(bytes > 0){
+			ssize_t r = pread(this->sfd, dst, bytes, offset);
+			if(r <= 0){
+				std::cout << "Error reading snapshot window!!!" << std::endl;
+				exit(1);
+			}
+			dst+=r; offset+=r; bytes-=r;
+		}
+		uint64_t next = first + rows;
+		if(next < this->n){
+			uint64_t ahead = std::min(rows, this->n - next);
+			posix_fadvise(this->sfd, this->sdata_offset + sizeof(T) * (attr[m] * this->n + next), sizeof(T) * ahead, POSIX_FADV_WILLNEED);
+		}
+	}
+}
+
+/*
+ * Same as read_window but min-max normalizes each column unless the snapshot is already normalized.
+ */
+template<class T>
+void File<T>::read_window_norm(T *buf, uint64_t first, uint64_t rows, uint64_t stride, uint8_t qq, uint8_t *attr){
+	this->read_window(buf,first,rows,stride,qq,attr);
+	if(this->normalized) return;
+	for(uint8_t m = 0; m < qq; m++) scale_column(&buf[m*stride],rows,this->mmin[attr[m]],this->mmax[attr[m]] - this->mmin[attr[m]]);
+}
+
+template<class T>
+void File<T>::close_stream(){
+	if(this->sfd >= 0){ close(this->sfd); this->sfd = -1; }
+}
+
 template<class T>
 void File<T>::sample(uint64_t limit){
 	if(!this->transpose){
@@ -5,7 +5,8 @@
 #include <cstdio>
 
 #include <parallel/algorithm>
-#include <unordered_set>
+#include <limits>
+#include <vector>
 
 template<class T, class Z>
 struct reorder_pair{
@@ -16,11 +17,16 @@ struct reorder_pair{
 template<class T,class Z>
 static bool cmp_reorder_pair(const reorder_pair<T,Z> &a, const reorder_pair<T,Z> &b){ return a.score > b.score; };
 
+/*
+ * Reorder tuples by their first appearance when scanning the sorted attribute lists round-robin
+ * (rank 0 of every list, then rank 1, ...). Position i*d + m of the scan is a key; a bitmap marks the
+ * first key of every tuple and prefix popcounts over the bitmap give each tuple its output position.
+ */
 template<class T,class Z>
 void reorder_transpose(std::string fname,uint64_t n, uint64_t d){
 	File<T> f(fname,false,n,d);
 	f.set_transpose(true);
-	T *cdata_in = (T*)malloc(sizeof(float)*n*d);
+	T *cdata_in = NULL;
 
 	std::cout << "Loading data from file for reordering !!!" <<std::endl;
 	f.load(cdata_in);
@@ -29,8 +35,9 @@ void reorder_transpose(std::string fname,uint64_t n, uint64_t d){
 	reorder_pair<T,Z> *lists = (reorder_pair<T,Z>*)malloc(sizeof(reorder_pair<T,Z>)*n*d);
 
 	//Create lists
-	for(uint8_t m = 0; m < d; m++){
-		for(uint64_t i = 0; i < n; i++){
+	#pragma omp parallel for schedule(static)
+	for(uint64_t i = 0; i < n; i++){
+		for(uint8_t m = 0; m < d; m++){
 			lists[m*n + i].id = i;
 			lists[m*n + i].score = cdata_in[m*n + i];
 		}
@@ -38,29 +45,89 @@ void reorder_transpose(std::string fname,uint64_t n, uint64_t d){
 	//Sort lists
 	for(uint8_t m = 0;m<d;m++){ __gnu_parallel::sort(&lists[m*n],(&lists[m*n]) + n,cmp_reorder_pair<T,Z>); }
 
+	//First appearance key of every tuple (each id appears once per list)
+	uint64_t *first = (uint64_t*)malloc(sizeof(uint64_t)*n);
+	#pragma omp parallel for schedule(static)
+	for(uint64_t i = 0; i < n; i++) first[i] = std::numeric_limits<uint64_t>::max();
+	for(uint8_t m = 0; m < d; m++){
+		#pragma omp parallel for schedule(static)
+		for(uint64_t i = 0; i < n; i++){
+			Z id = lists[m*n + i].id;
+			first[id] = std::min(first[id],i*d + m);
+		}
+	}
+
+	//Visited bitmap over keys
+	uint64_t words = (n*d - 1)/64 + 1;
+	uint64_t *bitmap = (uint64_t*)calloc(words,sizeof(uint64_t));
+	#pragma omp parallel for schedule(static)
+	for(uint64_t w = 0; w < words; w++){//each thread owns whole words
+		uint64_t bits = 0;
+		uint64_t kend = std::min((w+1)*64, n*d);
+		for(uint64_t key = w*64; key < kend; key++){
+			Z id = lists[(key % d)*n + key / d].id;
+			if(first[id] == key) bits |= ((uint64_t)1) << (key & 63);
+		}
+		bitmap[w] = bits;
+	}
+
+	//Prefix popcount per chunk of words, then copy tuples in key order (chunks strided over the threads of the team)
+	uint32_t threads = omp_get_max_threads();
+	std::vector<uint64_t> offset(threads + 1, 0);
 	T *cdata_out = (T*)malloc(sizeof(T)*n*d);
-	std::unordered_set<Z> eset;
-	uint64_t ii = 0;
-	for(uint64_t i = 0; i < n; i++){
-		for(uint8_t m = 0; m < d; m++){
-			reorder_pair<T,Z> p = lists[m*n + i];
-			if(eset.find(p.id) == eset.end()){
-				eset.insert(p.id);
-				for(uint8_t j = 0; j < d; j++){ cdata_out[j * n + ii] = cdata_in[j * n + p.id]; }
-				ii++;
+	#pragma omp parallel num_threads(threads)
+	{
+		for(uint32_t c = omp_get_thread_num(); c < threads; c+=omp_get_num_threads()){
+			uint64_t count = 0;
+			for(uint64_t w = (words * c) / threads; w < (words * (c + 1)) / threads; w++) count+=_mm_popcnt_u64(bitmap[w]);
+			offset[c+1] = count;
+		}
+		#pragma omp barrier
+		#pragma omp single
+		{
+			for(uint32_t t = 0; t < threads; t++) offset[t+1]+=offset[t];
+		}
+		for(uint32_t c = omp_get_thread_num(); c < threads; c+=omp_get_num_threads()){
+			uint64_t ii = offset[c];
+			for(uint64_t w = (words * c) / threads; w < (words * (c + 1)) / threads; w++){
+				uint64_t bits = bitmap[w];
+				while(bits){
+					uint64_t key = w*64 + __builtin_ctzll(bits);
+					bits &= bits - 1;
+					Z id = lists[(key % d)*n + key / d].id;
+					for(uint8_t j = 0; j < d; j++){ cdata_out[j * n + ii] = cdata_in[j * n + id]; }
+					ii++;
+				}
 			}
 		}
 	}
 
 	std::string fname2 = fname + "_o";
-	std::cout << "Storing to " << fname2 << std::endl;
-	f.store(fname2,cdata_out);
+	std::cout << "Storing snapshot to " << fname2 << std::endl;
+	f.store_snapshot(fname2,cdata_out,false);
 
 	free(cdata_in);
 	free(cdata_out);
 	free(lists);
+	free(first);
+	free(bitmap);
 }
 
+template<class T>
+void convert_snapshot(std::string fname,uint64_t n, uint64_t d){
+	File<T> f(fname,false,n,d);
+	f.set_transpose(true);
+	T *cdata = NULL;
+
+	std::cout << "Loading data from file for conversion !!!" <<std::endl;
+	f.load(cdata);
+
+	std::string fname2 = fname + "_b";
+	std::cout << "Storing snapshot to " << fname2 << std::endl;
+	f.store_snapshot(fname2,cdata,false);
+
+	free(cdata);
+}
 
 int main(int argc, char **argv){
 	ArgParser ap;
@@ -83,6 +150,11 @@ int main(int argc, char **argv){
 	uint64_t n = ap.getInt("-n");
 	uint64_t d = ap.getInt("-d");
 
+	if(ap.exists("-b")){
+		convert_snapshot<float>(ap.getString("-f"),n,d);
+		return 0;
+	}
+
 	//reorder(ap.getString("-f"),n,d);
 	reorder_transpose<float,uint32_t>(ap.getString("-f"),n,d);
 
@@ -31,6 +31,7 @@
 
 #include "port.h"
 #include "randdataset.h"
+#include <omp.h>
 
 /*
  * some macros for warnings/errors
@@ -252,6 +253,56 @@ random_normal(double med, double var)
 	return random_peak(med - var, med + var, 12);
 }
 
+/*
+ * rand_seed
+ *
+ *	Initializes an independent generator state (splitmix64 of seed and stream).
+ */
+static rand_state
+rand_seed(uint64_t seed, uint64_t stream)
+{
+	rand_state r;
+	uint64_t z = seed + (stream + 1) * 0x9E3779B97F4A7C15ULL;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	r.s = z ^ (z >> 31);
+	if (r.s == 0) r.s = 0x9E3779B97F4A7C15ULL;
+	return r;
+}
+
+/*
+ * random_equal_r
+ *
+ *	returns a random value x \in [min,max) from generator state r (xorshift64*)
+ */
+static inline double
+random_equal_r(rand_state *r, double min, double max)
+{
+	r->s ^= r->s >> 12;
+	r->s ^= r->s << 25;
+	r->s ^= r->s >> 27;
+	double x = (double) ((r->s * 0x2545F4914F6CDD1DULL) >> 11) * (1.0 / 9007199254740992.0);
+	return x * (max - min) + min;
+}
+
+static inline double
+random_peak_r(rand_state *r, double min, double max, int dim)
+{
+	int		d;
+	double	sum = 0.0;
+
+	for (d = 0; d < dim; d++)
+		sum += random_equal_r(r, 0.0, 1.0);
+	sum /= dim;
+	return sum * (max - min) + min;
+}
+
+static inline double
+random_normal_r(rand_state *r, double med, double var)
+{
+	return random_peak_r(r, med - var, med + var, 12);
+}
+
 /*
  * output_vector
  *
@@ -322,42 +373,52 @@ generate_indep(int count, int dim)
 	free(x);
 }
 
-void generate_indep_inmem(float *data, uint64_t n, uint64_t d, bool transpose){
-
-	float progress = 0.0;
-	uint64_t step = 1024;
-	uint64_t ii = 0;
-	srand(time(NULL));
-
+/*
+ * store_vector
+ *
+ *	Writes x[0..d-1] as row i of data in row-major or column-major (transpose) layout.
+ */
+static inline void
+store_vector(float *data, uint64_t n, uint64_t d, bool transpose, uint64_t i, double *x)
+{
 	if(!transpose){
-		for(uint64_t i = 0; i < n;i++){
-			for(uint64_t m = 0; m < d;m++){
-				data[i*d + m] = random_equal(0, 1);
-			}
-
-			if((ii & (step - 1)) == 0){
-				std::cout << "Progress: [" << int(progress * 100.0) << "] %\r";
-				std::cout.flush();
-				progress += ((float)step)/n; // for demonstration only
-			}
-			ii++;
-		}
+		for (uint64_t m = 0; m < d; m++) data[i*d + m] = x[m];
 	}else{
-		for(uint64_t i = 0; i < n;i++){
-			for(uint64_t m = 0; m < d;m++){
-				data[m*n + i] = random_equal(0, 1);
-			}
+		for (uint64_t m = 0; m < d; m++) data[m*n + i] = x[m];
+	}
+}
 
-			if((ii & (step - 1)) == 0){
-				std::cout << "Progress: [" << int(progress * 100.0) << "] %\r";
-				std::cout.flush();
-				progress += ((float)step)/n; // for demonstration only
+/*
+ *	In-memory generators split rows into GEN_CHUNK sized chunks, each with its own generator seeded
+ *	from (seed, chunk index). Chunks are filled in parallel and the output depends only on the seed.
+ */
+void generate_indep_inmem(float *data, uint64_t n, uint64_t d, bool transpose, uint64_t seed){
+	uint64_t chunks = (n + GEN_CHUNK - 1) / GEN_CHUNK;
+
+	#pragma omp parallel for schedule(dynamic)
+	for(uint64_t c = 0; c < chunks; c++){
+		rand_state r = rand_seed(seed, c);
+		uint64_t last = (c + 1) * GEN_CHUNK < n ? (c + 1) * GEN_CHUNK : n;
+		if(!transpose){
+			for(uint64_t i = c * GEN_CHUNK; i < last;i++){
+				for(uint64_t m = 0; m < d;m++){
+					data[i*d + m] = random_equal_r(&r, 0, 1);
+				}
+			}
+		}else{
+			for(uint64_t i = c * GEN_CHUNK; i < last;i++){
+				for(uint64_t m = 0; m < d;m++){
+					data[m*n + i] = random_equal_r(&r, 0, 1);
+				}
 			}
-			ii++;
 		}
 	}
 }
 
+void generate_indep_inmem(float *data, uint64_t n, uint64_t d, bool transpose){
+	generate_indep_inmem(data, n, d, transpose, time(NULL));
+}
+
 /*
  * generate_corr
  *
@@ -396,52 +457,42 @@ generate_corr(int count, int dim)
 	free(x);
 }
 
-void generate_corr_inmem(float *data, uint64_t n, uint64_t d, bool transpose){
-	double *x = (double *) malloc(sizeof(double) * d);
-	uint64_t count = 0;
-	float progress = 0.0;
-	uint64_t step = 1024;
-	uint64_t ii = 0;
-	srand(time(NULL));
-
-	while (count < n)
-	{
-		do
-		{
-			double	v = random_peak(0, 1, d);
-			double	l = v <= 0.5 ? v : 1.0 - v;
+void generate_corr_inmem(float *data, uint64_t n, uint64_t d, bool transpose, uint64_t seed){
+	uint64_t chunks = (n + GEN_CHUNK - 1) / GEN_CHUNK;
 
-			for (uint64_t m = 0; m < d; m++)
-				x[m] = v;
-
-			for (uint64_t m = 0; m < d; m++)
+	#pragma omp parallel
+	{
+		double *x = (double *) malloc(sizeof(double) * d);
+		#pragma omp for schedule(dynamic)
+		for(uint64_t c = 0; c < chunks; c++){
+			rand_state r = rand_seed(seed, c);
+			uint64_t last = (c + 1) * GEN_CHUNK < n ? (c + 1) * GEN_CHUNK : n;
+			for(uint64_t i = c * GEN_CHUNK; i < last; i++)
 			{
-				double h = random_normal(0, l);
-				x[m] += h;
-				x[(m + 1) % d] -= h;
-			}
-		} while (!is_vector_ok(d, x));
-
-		if(!transpose){
-			for (uint64_t m = 0; m < d; m++){
-				data[count*d + m] = x[m];
-			}
-		}else{
-			for (uint64_t m = 0; m < d; m++){
-				data[m*n + count] = x[m];
+				do
+				{
+					double	v = random_peak_r(&r, 0, 1, d);
+					double	l = v <= 0.5 ? v : 1.0 - v;
+
+					for (uint64_t m = 0; m < d; m++)
+						x[m] = v;
+
+					for (uint64_t m = 0; m < d; m++)
+					{
+						double h = random_normal_r(&r, 0, l);
+						x[m] += h;
+						x[(m + 1) % d] -= h;
+					}
+				} while (!is_vector_ok(d, x));
+				store_vector(data, n, d, transpose, i, x);
 			}
 		}
-		count++;
-
-		if((ii & (step - 1)) == 0){
-			std::cout << "Progress: [" << int(progress * 100.0) << "] %\r";
-			std::cout.flush();
-			progress += ((float)step)/n; // for demonstration only
-		}
-		ii++;
+		free(x);
 	}
-	std::cout.flush();
-	free(x);
+}
+
+void generate_corr_inmem(float *data, uint64_t n, uint64_t d, bool transpose){
+	generate_corr_inmem(data, n, d, transpose, time(NULL));
 }
 
 /*
@@ -479,57 +530,42 @@ generate_anti(int count, int dim)
 	}
 }
 
-void generate_anti_inmem(float *data,uint64_t n, uint64_t d, bool transpose){
-	double *x = (double *) malloc(sizeof(double) * d);
-	uint64_t count = 0;
-	float progress = 0.0;
-	uint64_t step = 1024;
-	uint64_t ii = 0;
-	srand(time(NULL));
-
-	while (count < n)
-	{
-		do
-		{
-			double	v = random_normal(0.5, 0.25);
-			double	l = v <= 0.5 ? v : 1.0 - v;
-			if( l == 0 ){
-				std::cout << l << " , " << v << std::endl;
-				exit(1);
-			}
-
-			for (uint64_t m = 0; m < d; m++)
-				x[m] = v;
+void generate_anti_inmem(float *data,uint64_t n, uint64_t d, bool transpose, uint64_t seed){
+	uint64_t chunks = (n + GEN_CHUNK - 1) / GEN_CHUNK;
 
-			for (uint64_t m = 0; m < d; m++)
+	#pragma omp parallel
+	{
+		double *x = (double *) malloc(sizeof(double) * d);
+		#pragma omp for schedule(dynamic)
+		for(uint64_t c = 0; c < chunks; c++){
+			rand_state r = rand_seed(seed, c);
+			uint64_t last = (c + 1) * GEN_CHUNK < n ? (c + 1) * GEN_CHUNK : n;
+			for(uint64_t i = c * GEN_CHUNK; i < last; i++)
 			{
-				double h = random_equal(-l, l);
-				//while (h < 0.001 || h > -0.001) h = random_equal(-l, l);
-				x[m] += h;
-				x[(m + 1) % d] -= h;
-			}
-		} while (!is_vector_ok(d, x));
-
-		if(!transpose){
-			for (uint64_t m = 0; m < d; m++){
-				data[count*d + m] = x[m];
-			}
-		}else{
-			for (uint64_t m = 0; m < d; m++){
-				data[m*n + count] = x[m];
+				do
+				{
+					double	v = random_normal_r(&r, 0.5, 0.25);
+					double	l = v <= 0.5 ? v : 1.0 - v;
+
+					for (uint64_t m = 0; m < d; m++)
+						x[m] = v;
+
+					for (uint64_t m = 0; m < d; m++)
+					{
+						double h = random_equal_r(&r, -l, l);
+						x[m] += h;
+						x[(m + 1) % d] -= h;
+					}
+				} while (!is_vector_ok(d, x));
+				store_vector(data, n, d, transpose, i, x);
 			}
 		}
-		count++;
-
-		if((ii & (step - 1)) == 0){
-			std::cout << "Progress: [" << int(progress * 100.0) << "] %\r";
-			std::cout.flush();
-			progress += ((float)step)/n; // for demonstration only
-		}
-		ii++;
+		free(x);
 	}
-	std::cout.flush();
-	free(x);
+}
+
+void generate_anti_inmem(float *data,uint64_t n, uint64_t d, bool transpose){
+	generate_anti_inmem(data, n, d, transpose, time(NULL));
 }
 
 /*
@@ -23,6 +23,15 @@ static double random_equal(double min, double max);
 static double random_peak(double min, double max, int dim);
 static double random_normal(double med, double var);
 
+#define GEN_CHUNK 65536 //rows per generator stream for in-memory generation
+
+typedef struct { uint64_t s; } rand_state;
+
+static rand_state rand_seed(uint64_t seed, uint64_t stream);
+static inline double random_equal_r(rand_state *r, double min, double max);
+static inline double random_peak_r(rand_state *r, double min, double max, int dim);
+static inline double random_normal_r(rand_state *r, double med, double var);
+
 static void output_vector(int dim, double *x);
 static int is_vector_ok(int dim, double *x);
 
@@ -34,6 +43,10 @@ void generate_indep_inmem(float *data,uint64_t n, uint64_t d, bool transpose);
 void generate_corr_inmem(float *data,uint64_t n, uint64_t d, bool transpose);
 void generate_anti_inmem(float *data,uint64_t n, uint64_t d, bool transpose);
 
+void generate_indep_inmem(float *data,uint64_t n, uint64_t d, bool transpose, uint64_t seed);
+void generate_corr_inmem(float *data,uint64_t n, uint64_t d, bool transpose, uint64_t seed);
+void generate_anti_inmem(float *data,uint64_t n, uint64_t d, bool transpose, uint64_t seed);
+
 static void usage();
 
 #endif
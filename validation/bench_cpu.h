@@ -12,64 +12,56 @@
 #include "../cpu/LSA.h"
 #include "../cpu/TPAc.h"
 #include "../cpu/TPAr.h"
+#include "../cpu/BTA.h"
 #include "../cpu/VTA.h"
 #include "../cpu/PTA.h"
-#include "../cpu/SLA.h"
+#if NUM_DIMS <= SLA_MAX_DIMS
+	#include "../cpu/SLA.h"
+#endif
+#include "../cpu/Planner.h"
+#include "../cpu/TopKCache.h"
 
-float weights[8] = { 1,1,1,1,1,1,1,1 };//Q0
+#ifndef TID
+	#define TID 64
+#endif
+#ifndef RADIX
+	#define RADIX 0
+#endif
+
+//Tuple id type of the benchmarked engines, TID=32 halves tuple, predicate and heap entries (tables below 4B rows)
+#if TID == 32
+	typedef uint32_t tid_t;
+#else
+	typedef uint64_t tid_t;
+#endif
+
+float weights[NUM_DIMS];//Q0, all ones
 //float weights[8] = { 0.1,0.2,0.3,0.4,0.5,0.6,0.7,0.8 };//Q1
 //float weights[8] = { 0.8,0.7,0.6,0.5,0.4,0.3,0.2,0.1 };//Q2
 //float weights[8] = { 0.1,0.2,0.3,0.4,0.4,0.3,0.2,0.1 };//Q3
 //float weights[8] = { 0.4,0.3,0.2,0.1,0.1,0.2,0.3,0.4 };//Q4
 
-#if QM == 0
-	#if NUM_DIMS == 2
-		uint8_t attr[1][2] = { {0,1} };
-	#elif NUM_DIMS == 3
-		uint8_t attr[2][3] = { {1,2,0}, {0,1,2} };
-	#elif NUM_DIMS == 4
-		uint8_t attr[3][4] = { {2,3,0,0}, {1,2,3,0}, {0,1,2,3} };
-	#elif NUM_DIMS == 5
-		uint8_t attr[4][5] = { {3,4,0,0,0}, {2,3,4,0,0}, {1,2,3,4,0}, {0,1,2,3,4} };
-	#elif NUM_DIMS == 6
-		uint8_t attr[5][6] = { {4,5,0,0,0,0}, {3,4,5,0,0,0}, {2,3,4,5,0,0}, {1,2,3,4,5,0}, {0,1,2,3,4,5} };
-	#elif NUM_DIMS == 7
-		uint8_t attr[6][7] = {
-				{5,6,0,0,0,0,0}, {4,5,6,0,0,0,0}, {3,4,5,6,0,0,0},
-				{2,3,4,5,6,0,0}, {1,2,3,4,5,6,0}, {0,1,2,3,4,5,6} };
-	#else
-		uint8_t attr[7][8] = {
-				{6,7,0,0,0,0,0,0}, {5,6,7,0,0,0,0,0}, {4,5,6,7,0,0,0,0},
-				{3,4,5,6,7,0,0,0}, {2,3,4,5,6,7,0,0}, {1,2,3,4,5,6,7,0}, {0,1,2,3,4,5,6,7}
-		};
-	#endif
-#else
-	#if NUM_DIMS == 2
-		uint8_t attr[1][2] = { {0,1} };
-	#elif NUM_DIMS == 3
-		uint8_t attr[2][3] = { {0,1,0}, {0,1,2} };
-	#elif NUM_DIMS == 4
-		uint8_t attr[3][4] = { {0,1,0,0}, {0,1,2,0}, {0,1,2,3} };
-	#elif NUM_DIMS == 5
-		uint8_t attr[4][5] = { {0,1,0,0,0}, {0,1,2,0,0}, {0,1,2,3,0}, {0,1,2,3,4} };
-	#elif NUM_DIMS == 6
-		uint8_t attr[5][6] = {{0,1,0,0,0,0}, {0,1,2,0,0,0},  {0,1,2,3,0,0}, {0,1,2,3,4,0}, {0,1,2,3,4,5} };
-	#elif NUM_DIMS == 7
-		uint8_t attr[7][8] = {
-			{0,1,0,0,0,0,0}, {0,1,2,0,0,0,0}, {0,1,2,3,0,0,0},
-			{0,1,2,3,4,0,0}, {0,1,2,3,4,5,0}, {0,1,2,3,4,5,6}
-		};
-	#else
-		uint8_t attr[7][8] = {
-				{0,1,0,0,0,0,0,0}, {0,1,2,0,0,0,0,0}, {0,1,2,3,0,0,0,0},
-				{0,1,2,3,4,0,0,0}, {0,1,2,3,4,5,0,0}, {0,1,2,3,4,5,6,0}, {0,1,2,3,4,5,6,7}
-		};
-	#endif
-#endif
+//attr[qq-2]: the qq queried attributes, the last (QM=0) or first (QM=1) ones
+uint8_t attr[NUM_DIMS-1][NUM_DIMS];
+
+static struct bench_query_init{
+	bench_query_init(){
+		for(uint8_t m = 0; m < NUM_DIMS; m++) weights[m] = 1;
+		for(uint8_t qq = 2; qq <= NUM_DIMS; qq++){
+			for(uint8_t m = 0; m < NUM_DIMS; m++) attr[qq-2][m] = 0;
+			for(uint8_t m = 0; m < qq; m++) attr[qq-2][m] = (QM == 0) ? NUM_DIMS - qq + m : m;
+		}
+	}
+} bench_query_init_;
 
 
 const std::string distributions[3] ={"correlated","independent","anticorrelated"};
 
+//FILTER > 0: query benchmarks keep tuples whose first (normalized) attribute is at most FILTER percent
+static inline void bench_filter(TopKQuery<float> &query){
+	if(FILTER > 0) query.set_filter(0,0,FILTER/100.0f);
+}
+
 uint8_t work_array[WORKLOAD];
 
 void random_workload(){
@@ -82,7 +74,8 @@ void random_workload(){
 
 void bench_ta(std::string fname,uint64_t n, uint64_t d, uint64_t ks, uint64_t ke){
 	File<float> f(fname,false,n,d);
-	TA<float,uint64_t> ta(f.rows(),f.items());
+	f.set_normalize(FNORM == 1);
+	TA<float,tid_t> ta(f.rows(),f.items());
 
 	if (LD != 1){
 		std::cout << "Loading data from file !!!" <<std::endl;
@@ -92,6 +85,7 @@ void bench_ta(std::string fname,uint64_t n, uint64_t d, uint64_t ks, uint64_t ke
 		f.gen(ta.get_cdata(),DISTR);
 	}
 
+	ta.set_normalized(f.is_normalized());
 	ta.init();
 	ta.set_iter(ITER);
 	uint8_t q = 2;
@@ -112,7 +106,8 @@ void bench_ta(std::string fname,uint64_t n, uint64_t d, uint64_t ks, uint64_t ke
 
 void bench_tpar(std::string fname,uint64_t n, uint64_t d, uint64_t ks, uint64_t ke){
 	File<float> f(fname,false,n,d);
-	TPAr<float,uint64_t> tpar(f.rows(),f.items());
+	f.set_normalize(FNORM == 1);
+	TPAr<float,tid_t> tpar(f.rows(),f.items());
 
 	if (LD != 1){
 		std::cout << "Loading data from file !!!" <<std::endl;
@@ -122,6 +117,7 @@ void bench_tpar(std::string fname,uint64_t n, uint64_t d, uint64_t ks, uint64_t
 		f.gen(tpar.get_cdata(),DISTR);
 	}
 
+	tpar.set_normalized(f.is_normalized());
 	tpar.init();
 	tpar.set_iter(ITER);
 	uint8_t q = 2;
@@ -131,6 +127,8 @@ void bench_tpar(std::string fname,uint64_t n, uint64_t d, uint64_t ks, uint64_t
 			//Warm up
 			if (IMP == 0){
 				tpar.findTopKscalar(k,i,weights,attr[i-q]);
+			}else if(RADIX == 1 && (IMP == 1 || IMP == 2)){
+				tpar.findTopKradix(k,i,weights,attr[i-q]);
 			}else if(IMP == 1){
 				tpar.findTopKsimd(k,i,weights,attr[i-q]);
 			}else if(IMP == 2){
@@ -141,6 +139,8 @@ void bench_tpar(std::string fname,uint64_t n, uint64_t d, uint64_t ks, uint64_t
 			for(uint8_t m = 0; m < ITER;m++){
 				if (IMP == 0){
 					tpar.findTopKscalar(k,i,weights,attr[i-q]);
+				}else if(RADIX == 1 && (IMP == 1 || IMP == 2)){
+					tpar.findTopKradix(k,i,weights,attr[i-q]);
 				}else if(IMP == 1){
 					tpar.findTopKsimd(k,i,weights,attr[i-q]);
 				}else if(IMP == 2){
@@ -154,27 +154,80 @@ void bench_tpar(std::string fname,uint64_t n, uint64_t d, uint64_t ks, uint64_t
 
 void bench_tpac(std::string fname,uint64_t n, uint64_t d, uint64_t ks, uint64_t ke){
 	File<float> f(fname,false,n,d);
-	TPAc<float,uint64_t> tpac(f.rows(),f.items());
+	f.set_normalize(FNORM == 1);
+	TPAc<float,tid_t> tpac(f.rows(),f.items());
 	f.set_transpose(true);
 
-	if (LD != 1){
-		std::cout << "Loading data from file !!!" <<std::endl;
-		f.load(tpac.get_cdata());
+	if(STREAM == 1){
+		if(LD == 1 || IMP > 2){
+			std::cout << "Streaming requires data on disk and IMP < 3!!!" << std::endl;
+			exit(1);
+		}
+		std::cout << "Streaming data from snapshot !!!" <<std::endl;
+		f.open_stream();
+		tpac.set_stream(&f);
 	}else{
-		std::cout << "Generating ( "<< distributions[DISTR] <<" ) data in memory !!!" <<std::endl;
-		f.gen(tpac.get_cdata(),DISTR);
-	}
+		if (LD != 1){
+			std::cout << "Loading data from file !!!" <<std::endl;
+			f.load(tpac.get_cdata());
+		}else{
+			std::cout << "Generating ( "<< distributions[DISTR] <<" ) data in memory !!!" <<std::endl;
+			f.gen(tpac.get_cdata(),DISTR);
+		}
 
-	tpac.init();
+		tpac.set_normalized(f.is_normalized());
+		tpac.init();
+	}
 	tpac.set_iter(ITER);
 	uint8_t q = 2;
-	if(IMP!=3){
+	if(BATCH > 0){
+		if(STREAM == 1 || IMP > 2){
+			std::cout << "Batch evaluation requires data in memory and IMP < 3!!!" << std::endl;
+			exit(1);
+		}
+		//WORKLOAD queries with random weights, BATCH of them share one pass over the table
+		std::vector<TopKQuery<float>> queries(WORKLOAD);
+		std::vector<TopKResult<float,tid_t>> results(WORKLOAD);
+		srand(time(NULL));
+		for(uint64_t k = ks; k <= ke; k*=2){
+			for(uint8_t i = q; i <= f.items();i+=QD){
+				std::cout << "Benchmark <<<-------------" << f.rows() << "," << (int)i << "," << k << "------------->>> " << std::endl;
+				for(uint64_t j = 0; j < WORKLOAD; j++){
+					queries[j].k = k;
+					queries[j].qq = i;
+					queries[j].policy = IMP == 2 ? TOPK_PARALLEL : TOPK_SEQUENTIAL;
+					for(uint8_t m = 0; m < i; m++) queries[j].attr[m] = attr[i-q][m];
+					for(uint8_t m = 0; m < NUM_DIMS; m++) queries[j].weights[m] = static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
+					bench_filter(queries[j]);
+				}
+				Time<msecs> t;
+				double tt_processing = 0;
+				for(uint8_t m = 0; m < ITER;m++){
+					t.start();
+					for(uint64_t j = 0; j < WORKLOAD; j+=BATCH){
+						tpac.query_batch(&queries[j],std::min((uint64_t)BATCH,WORKLOAD - j),&results[j]);
+					}
+					tt_processing+=t.lap();
+				}
+				std::cout << std::fixed << std::setprecision(8);
+				std::cout << "< Benchmark for TPAc batch ( " << BATCH << " ) algorithm >" << std::endl;
+				std::cout << "tt_procesing: " << tt_processing/ITER << std::endl;
+				std::cout << "queries_per_second: " << WORKLOAD/(tt_processing/ITER/1000) << std::endl;
+			}
+		}
+	}else if(IMP!=3){
 		for(uint64_t k = ks; k <= ke; k*=2){
 			for(uint8_t i = q; i <= f.items();i+=QD){
 				std::cout << "Benchmark <<<-------------" << f.rows() << "," << (int)i << "," << k << "------------->>> " << std::endl;
 				//Warm up
-				if (IMP == 0){
+				if (STREAM == 1){
+					tpac.findTopKstream(k,i,weights,attr[i-q]);
+				}else if (IMP == 0){
 					tpac.findTopKscalar(k,i,weights,attr[i-q]);
+				}else if(RADIX == 1 && (IMP == 1 || IMP == 2)){
+					tpac.findTopKradix(k,i,weights,attr[i-q]);
+				}else if(IMP == 1 && QBITS > 0){
+					tpac.findTopKquant(k,i,weights,attr[i-q]);
 				}else if(IMP == 1){
 					tpac.findTopKsimd(k,i,weights,attr[i-q]);
 				}else if(IMP == 2){
@@ -183,8 +236,14 @@ void bench_tpac(std::string fname,uint64_t n, uint64_t d, uint64_t ks, uint64_t
 				tpac.reset_clocks();
 				//Benchmark
 				for(uint8_t m = 0; m < ITER;m++){
-					if (IMP == 0){
+					if (STREAM == 1){
+						tpac.findTopKstream(k,i,weights,attr[i-q]);
+					}else if (IMP == 0){
 						tpac.findTopKscalar(k,i,weights,attr[i-q]);
+					}else if(RADIX == 1 && (IMP == 1 || IMP == 2)){
+						tpac.findTopKradix(k,i,weights,attr[i-q]);
+					}else if(IMP == 1 && QBITS > 0){
+						tpac.findTopKquant(k,i,weights,attr[i-q]);
 					}else if(IMP == 1){
 						tpac.findTopKsimd(k,i,weights,attr[i-q]);
 					}else if(IMP == 2){
@@ -236,29 +295,128 @@ void bench_tpac(std::string fname,uint64_t n, uint64_t d, uint64_t ks, uint64_t
 	}
 }
 
-void bench_vta(std::string fname,uint64_t n, uint64_t d, uint64_t ks, uint64_t ke){
+void bench_bta(std::string fname,uint64_t n, uint64_t d, uint64_t ks, uint64_t ke){
 	File<float> f(fname,false,n,d);
-	VTA<float,uint64_t> vta(f.rows(),f.items());
+	f.set_normalize(FNORM == 1);
+	BTA<float,tid_t> bta(f.rows(),f.items());
 	f.set_transpose(true);
 
 	if (LD != 1){
 		std::cout << "Loading data from file !!!" <<std::endl;
-		f.load(vta.get_cdata());
+		f.load(bta.get_cdata());
 	}else{
 		std::cout << "Generating ( "<< distributions[DISTR] <<" ) data in memory !!!" <<std::endl;
-		f.gen(vta.get_cdata(),DISTR);
+		f.gen(bta.get_cdata(),DISTR);
+	}
+
+	bta.set_normalized(f.is_normalized());
+	bta.init();
+	bta.set_iter(ITER);
+	uint8_t q = 2;
+	for(uint64_t k = ks; k <= ke; k*=2){
+		for(uint8_t i = q; i <= f.items();i+=QD){
+			std::cout << "Benchmark <<<-------------" << f.rows() << "," << (int)i << "," << k << "------------->>> " << std::endl;
+			//Warm up
+			if(IMP == 2){
+				bta.findTopKthreads(k,i,weights,attr[i-q]);
+			}else{
+				bta.findTopKsimd(k,i,weights,attr[i-q]);
+			}
+			bta.reset_clocks();
+			//Benchmark
+			for(uint8_t m = 0; m < ITER;m++){
+				if(IMP == 2){
+					bta.findTopKthreads(k,i,weights,attr[i-q]);
+				}else{
+					bta.findTopKsimd(k,i,weights,attr[i-q]);
+				}
+			}
+			bta.benchmark();
+		}
+	}
+}
+
+/*
+ * Page through the top-k of each query with a cursor, PAGE tuples per call
+ */
+template<class A>
+void bench_pages(A &a, std::string algo, uint64_t n, uint64_t d, uint64_t ks, uint64_t ke){
+	std::vector<tuple_<float,tid_t>> page(PAGE);
+	TopKQuery<float> query;
+	for(uint8_t m = 0; m < NUM_DIMS; m++) query.weights[m] = weights[m];
+	bench_filter(query);
+	uint8_t q = 2;
+	for(uint64_t k = ks; k <= ke; k*=2){
+		for(uint8_t i = q; i <= d;i+=QD){
+			std::cout << "Benchmark <<<-------------" << n << "," << (int)i << "," << k << "------------->>> " << std::endl;
+			query.qq = i;
+			for(uint8_t m = 0; m < i; m++) query.attr[m] = attr[i-q][m];
+			Time<msecs> t;
+			double tt_processing = 0;
+			uint64_t tuple_count = 0;
+			for(uint8_t m = 0; m < ITER;m++){
+				t.start();
+				TopKCursor<float,tid_t> c = a.cursor(query);
+				for(uint64_t j = 0; j < k; j+=PAGE){
+					if(a.next(c,std::min((uint64_t)PAGE,k - j),&page[0]) == 0) break;
+				}
+				tt_processing+=t.lap();
+				tuple_count = c.tuple_count;
+			}
+			std::cout << std::fixed << std::setprecision(8);
+			std::cout << "< Benchmark for " << algo << " cursor ( " << PAGE << " ) algorithm >" << std::endl;
+			std::cout << "tt_procesing: " << tt_processing/ITER << std::endl;
+			if(STATS_EFF) std::cout << "tuple_count: " << tuple_count << std::endl;
+		}
 	}
+}
+
+void bench_vta(std::string fname,uint64_t n, uint64_t d, uint64_t ks, uint64_t ke){
+	File<float> f(fname,false,n,d);
+	f.set_normalize(FNORM == 1);
+	VTA<float,tid_t> vta(f.rows(),f.items());
+	f.set_transpose(true);
 
-	vta.init();
+	std::string iname = fname + "_vta";
+	if(IDX == 1 && LD != 1 && index_exists(iname)){
+		std::cout << "Loading index from file !!!" <<std::endl;
+		vta.load_index(iname);
+	}else if(STREAM == 1){
+		if(LD == 1){
+			std::cout << "Streaming requires data on disk!!!" << std::endl;
+			exit(1);
+		}
+		std::cout << "Building index from snapshot stream !!!" <<std::endl;
+		f.open_stream();
+		vta.init_stream(&f);
+		f.close_stream();
+		if(IDX == 1) vta.save_index(iname);
+	}else{
+		if (LD != 1){
+			std::cout << "Loading data from file !!!" <<std::endl;
+			f.load(vta.get_cdata());
+		}else{
+			std::cout << "Generating ( "<< distributions[DISTR] <<" ) data in memory !!!" <<std::endl;
+			f.gen(vta.get_cdata(),DISTR);
+		}
+
+		vta.set_normalized(f.is_normalized());
+		vta.init();
+		if(IDX == 1 && LD != 1) vta.save_index(iname);
+	}
 	vta.set_iter(ITER);
 	uint8_t q = 2;
-	if(IMP < 3){
+	if(PAGE > 0){
+		bench_pages(vta,"VTA",f.rows(),f.items(),ks,ke);
+	}else if(IMP < 3){
 		for(uint64_t k = ks; k <= ke; k*=2){
 			for(uint8_t i = q; i <= f.items();i+=QD){
 				std::cout << "Benchmark <<<-------------" << f.rows() << "," << (int)i << "," << k << "------------->>> " << std::endl;
 				//Warm up
 				if (IMP == 0){
 					vta.findTopKscalar(k,i,weights,attr[i-q]);
+				}else if(IMP == 1 && QBITS > 0){
+					vta.findTopKquant(k,i,weights,attr[i-q]);
 				}else if(IMP == 1){
 					vta.findTopKsimd(k,i,weights, attr[i-q]);
 				}else if(IMP == 2){
@@ -269,6 +427,8 @@ void bench_vta(std::string fname,uint64_t n, uint64_t d, uint64_t ks, uint64_t k
 				for(uint8_t m = 0; m < ITER;m++){
 					if (IMP == 0){
 						vta.findTopKscalar(k,i,weights,attr[i-q]);
+					}else if(IMP == 1 && QBITS > 0){
+						vta.findTopKquant(k,i,weights,attr[i-q]);
 					}else if(IMP == 1){
 						vta.findTopKsimd(k,i,weights,attr[i-q]);
 					}else if(IMP == 2){
@@ -320,23 +480,45 @@ void bench_vta(std::string fname,uint64_t n, uint64_t d, uint64_t ks, uint64_t k
 	}
 }
 
+#if NUM_DIMS <= PTA_MAX_DIMS
 void bench_pta(std::string fname,uint64_t n, uint64_t d, uint64_t ks, uint64_t ke){
 	File<float> f(fname,false,n,d);
-	PTA<float,uint64_t> pta(f.rows(),f.items());
+	f.set_normalize(FNORM == 1);
+	PTA<float,tid_t> pta(f.rows(),f.items());
 	f.set_transpose(true);
 
-	if (LD != 1){
-		std::cout << "Loading data from file !!!" <<std::endl;
-		f.load(pta.get_cdata());
+	std::string iname = fname + "_pta";
+	if(IDX == 1 && LD != 1 && index_exists(iname)){
+		std::cout << "Loading index from file !!!" <<std::endl;
+		pta.load_index(iname);
+	}else if(STREAM == 1){
+		if(LD == 1){
+			std::cout << "Streaming requires data on disk!!!" << std::endl;
+			exit(1);
+		}
+		std::cout << "Building index from snapshot stream !!!" <<std::endl;
+		f.open_stream();
+		pta.init_stream(&f);
+		f.close_stream();
+		if(IDX == 1) pta.save_index(iname);
 	}else{
-		std::cout << "Generating ( "<< distributions[DISTR] <<" ) data in memory !!!" <<std::endl;
-		f.gen(pta.get_cdata(),DISTR);
-	}
+		if (LD != 1){
+			std::cout << "Loading data from file !!!" <<std::endl;
+			f.load(pta.get_cdata());
+		}else{
+			std::cout << "Generating ( "<< distributions[DISTR] <<" ) data in memory !!!" <<std::endl;
+			f.gen(pta.get_cdata(),DISTR);
+		}
 
-	pta.init();
+		pta.set_normalized(f.is_normalized());
+		pta.init();
+		if(IDX == 1 && LD != 1) pta.save_index(iname);
+	}
 	pta.set_iter(ITER);
 	uint8_t q = 2;
-	if(IMP<3){
+	if(PAGE > 0){
+		bench_pages(pta,"PTA",f.rows(),f.items(),ks,ke);
+	}else if(IMP<3){
 		for(uint64_t k = ks; k <= ke; k*=2){
 			for(uint8_t i = q; i <= f.items();i+=QD){
 				std::cout << "Benchmark <<<-------------" << f.rows() << "," << (int)i << "," << k << "------------->>> " << std::endl;
@@ -400,22 +582,42 @@ void bench_pta(std::string fname,uint64_t n, uint64_t d, uint64_t ks, uint64_t k
 		}
 	}
 }
+#else
+void bench_pta(std::string fname,uint64_t n, uint64_t d, uint64_t ks, uint64_t ke){
+	std::cout << "PTA supports up to " << PTA_MAX_DIMS << " attributes!!!" << std::endl;
+	exit(1);
+}
+#endif
 
+#if NUM_DIMS <= SLA_MAX_DIMS
 void bench_sla(std::string fname,uint64_t n, uint64_t d, uint64_t ks,uint64_t ke){
 	File<float> f(fname,false,n,d);
-	SLA<float,uint64_t> sla(f.rows(),f.items());
+	f.set_normalize(FNORM == 1);
+	SLA<float,tid_t> sla(f.rows(),f.items());
 	f.set_transpose(true);
 
-	if (LD != 1){
-		std::cout << "Loading data from file !!!" <<std::endl;
-		f.load(sla.get_cdata());
+	std::string iname = fname + "_sla";
+	if(IDX == 1 && LD != 1 && index_exists(iname)){
+		std::cout << "Loading index from file !!!" <<std::endl;
+		sla.load_index(iname);
 	}else{
-		std::cout << "Generating ( "<< distributions[DISTR] <<" ) data in memory !!!" <<std::endl;
-		f.gen(sla.get_cdata(),DISTR);
-	}
+		if (LD != 1){
+			std::cout << "Loading data from file !!!" <<std::endl;
+			f.load(sla.get_cdata());
+		}else{
+			std::cout << "Generating ( "<< distributions[DISTR] <<" ) data in memory !!!" <<std::endl;
+			f.gen(sla.get_cdata(),DISTR);
+		}
 
-	sla.init();
+		sla.set_normalized(f.is_normalized());
+		sla.init();
+		if(IDX == 1 && LD != 1) sla.save_index(iname);
+	}
 	sla.set_iter(ITER);
+	if(PAGE > 0){
+		bench_pages(sla,"SLA",f.rows(),f.items(),ks,ke);
+		return;
+	}
 	uint8_t q = 2;
 	for(uint64_t k = ks; k <= ke; k*=2){
 		for(uint8_t i = q; i <= f.items();i+=QD){
@@ -443,10 +645,101 @@ void bench_sla(std::string fname,uint64_t n, uint64_t d, uint64_t ks,uint64_t ke
 		}
 	}
 }
+#else
+void bench_sla(std::string fname,uint64_t n, uint64_t d, uint64_t ks,uint64_t ke){
+	std::cout << "SLA supports up to " << SLA_MAX_DIMS << " attributes!!!" << std::endl;
+	exit(1);
+}
+#endif
+
+/*
+ * Route queries through the planner. The enabled TPAc, VTA, PTA and SLA instances are built from one load
+ * (the TPAc table is always kept, it provides the planner sample and the data of the other indexes).
+ */
+void bench_plan(std::string fname,uint64_t n, uint64_t d, uint64_t ks, uint64_t ke){
+	File<float> f(fname,false,n,d);
+	f.set_normalize(FNORM == 1);
+	f.set_transpose(true);
+	TPAc<float,tid_t> tpac(f.rows(),f.items());
+	VTA<float,tid_t> vta(f.rows(),f.items());
+	Planner<float,tid_t> planner(f.rows(),f.items());
+#if NUM_DIMS <= PTA_MAX_DIMS
+	PTA<float,tid_t> pta(f.rows(),f.items());
+#endif
+#if NUM_DIMS <= SLA_MAX_DIMS
+	SLA<float,tid_t> sla(f.rows(),f.items());
+#endif
+
+	if (LD != 1){
+		std::cout << "Loading data from file !!!" <<std::endl;
+		f.load(tpac.get_cdata());
+	}else{
+		std::cout << "Generating ( "<< distributions[DISTR] <<" ) data in memory !!!" <<std::endl;
+		f.gen(tpac.get_cdata(),DISTR);
+	}
+	tpac.set_normalized(f.is_normalized());
+	tpac.init();
+
+	uint64_t bytes = sizeof(float) * f.rows() * f.items();
+	if(TPAc_B == 1) planner.set_tpac(&tpac);
+	if(VTA_B == 1){
+		vta.set_cdata(static_cast<float*>(aligned_alloc(32,bytes)));
+		memcpy(vta.get_cdata(),tpac.get_cdata(),bytes);
+		vta.set_normalized(true);
+		vta.init();
+		planner.set_vta(&vta);
+	}
+#if NUM_DIMS <= PTA_MAX_DIMS
+	if(PTA_B == 1){
+		pta.set_cdata(static_cast<float*>(aligned_alloc(32,bytes)));
+		memcpy(pta.get_cdata(),tpac.get_cdata(),bytes);
+		pta.set_normalized(true);
+		pta.init();
+		planner.set_pta(&pta);
+	}
+#endif
+#if NUM_DIMS <= SLA_MAX_DIMS
+	if(SLA_B == 1){
+		sla.set_cdata(static_cast<float*>(aligned_alloc(32,bytes)));
+		memcpy(sla.get_cdata(),tpac.get_cdata(),bytes);
+		sla.set_normalized(true);
+		sla.init();
+		planner.set_sla(&sla);
+	}
+#endif
+	planner.sample(tpac.get_cdata());
+	TopKCache<float,tid_t> cache;
+
+	TopKQuery<float> query;
+	query.policy = IMP == 2 ? TOPK_PARALLEL : TOPK_SEQUENTIAL;
+	for(uint8_t m = 0; m < NUM_DIMS; m++) query.weights[m] = weights[m];
+	bench_filter(query);
+	uint8_t q = 2;
+	for(uint64_t k = ks; k <= ke; k*=2){
+		for(uint8_t i = q; i <= f.items();i+=QD){
+			std::cout << "Benchmark <<<-------------" << f.rows() << "," << (int)i << "," << k << "------------->>> " << std::endl;
+			query.k = k;
+			query.qq = i;
+			for(uint8_t m = 0; m < i; m++) query.attr[m] = attr[i-q][m];
+			//Warm up
+			if(CACHE == 0) planner.query(query);
+			planner.reset_clocks();
+			cache.reset_stats();
+			//Benchmark
+			TopKResult<float,tid_t> r;
+			for(uint8_t m = 0; m < ITER;m++){
+				r = CACHE == 1 ? cache.query(planner,query) : planner.query(query);
+			}
+			std::cout << "threshold: " << r.threshold << std::endl;
+			planner.benchmark();
+			if(CACHE == 1) cache.benchmark();
+		}
+	}
+}
 
 void bench_msa(std::string fname,uint64_t n, uint64_t d, uint64_t k){
 	File<float> f(fname,false,n,d);
-	MSA<float,uint64_t> msa(f.rows(),f.items());
+	MSA<float,tid_t> msa(f.rows(),f.items());
 	f.set_transpose(true);
 
 	std::cout << "Loading data from file !!!" << std::endl;
@@ -460,7 +753,7 @@ void bench_msa(std::string fname,uint64_t n, uint64_t d, uint64_t k){
 
 void bench_lsa(std::string fname,uint64_t n, uint64_t d, uint64_t k){
 	File<float> f(fname,false,n,d);
-	LSA<float,uint64_t> lsa(f.rows(),f.items());
+	LSA<float,tid_t> lsa(f.rows(),f.items());
 	f.set_transpose(true);
 
 	std::cout << "Loading data from file !!!" << std::endl;
@@ -473,5 +766,22 @@ void bench_lsa(std::string fname,uint64_t n, uint64_t d, uint64_t k){
 	lsa.benchmark();
 }
 
+/*
+ * Run the benchmarks selected at compile time on one input
+ */
+void bench_main(std::string fname, uint64_t n, uint64_t d){
+	if (PLAN == 1){
+		bench_plan(fname,n,d,KKS,KKE);
+		return;
+	}
+
+	if (TA_B == 1){ bench_ta(fname,n,d,KKS,KKE); }
+	if (TPAr_B == 1){ bench_tpar(fname,n,d,KKS,KKE); }
+	if (TPAc_B == 1){ bench_tpac(fname,n,d,KKS,KKE);	}
+	if (BTA_B == 1){ bench_bta(fname,n,d,KKS,KKE); }
+	if (VTA_B == 1){ bench_vta(fname,n,d,KKS,KKE); }
+	if (PTA_B == 1){ bench_pta(fname,n,d,KKS,KKE); }
+	if (SLA_B == 1){ bench_sla(fname,n,d,KKS,KKE); }
+}
 
 #endif